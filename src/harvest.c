@@ -24,13 +24,54 @@
 #include <stdbool.h>
 #include <stdarg.h>
 #include <time.h>
+#include <stdatomic.h>
 
 /* configurations */
 #define BASE_RESOLUTION_WIDTH  1366
 #define BASE_RESOLUTION_HEIGHT 768
 #define BASE_ASPECT_RATIO      (BASE_RESOLUTION_WIDTH / BASE_RESOLUTION_HEIGHT)
 #define SECOND_MS              1000
-#define FRAME_TIME             (SECOND_MS / 60)
+#define TICK_RATE              120       /* game simulation steps per second */
+#define TICK_TIME              (1.0 / TICK_RATE)
+#define FRAME_RATE             60        /* frames drawn per second (unless HARVEST_FPS is set) */
+#define MAX_TICKS_PER_FRAME    8         /* simulation steps run before drawing, lost time beyond is dropped */
+#define TILE_SIZE              8         /* triangles are rasterized in tiles of TILE_SIZE x TILE_SIZE pixels */
+#define SUBPIXEL_BITS          4         /* fixed point precision of edge functions */
+#define GUARD_BAND             (1 << 16) /* maximum vertex coordinate of triangles */
+#define MAX_REGIONS            16        /* dirty regions kept per frame */
+#define REGION_SLACK           4096      /* pixels that may be needlessly redrawn to join two regions */
+#define DIRTY_FRAMES           3         /* frames of dirty regions kept (current and two previous) */
+#define MEMORY_WIDTH           1920      /* default resolution of memory frame buffer */
+#define MEMORY_HEIGHT          1080
+#define BIN_SIZE               128       /* side of screen bins draw commands are sorted into (multiple of TILE_SIZE) */
+#define MAX_DRAW_THREADS       16        /* maximum threads executing bins */
+#define MIN_THREADED_COMMANDS  64        /* fewer commands are executed on calling thread only */
+#define MIN_THREADED_PARTICLES 4096      /* fewer particles are drawn on calling thread only (when HARVEST_THREADED_PARTICLES is set) */
+#define MAX_ENTITIES           1024      /* enemies and projectiles alive at once in game */
+#define ENEMY_SPAWN_TIME       0.5       /* seconds between enemies */
+#define GRID_CELL_SIZE         32        /* side of collision grid cells in pixels */
+#define MAX_INPUT_BYTES        256       /* bytes read from input per tick */
+#define ESCAPE_TIME            0.05      /* seconds an escape sequence may take to arrive whole */
+#define KEY_DELAY_TIME         0.75      /* seconds before terminal starts repeating held key (longer than usual delays, 660 ms on X) */
+#define KEY_TAP_TIME           0.025     /* seconds of movement a terminal key press is worth before it repeats (12 px at 1920 px wide) */
+#define KEY_REPEAT_TIME        0.1       /* seconds between repeats of held key by terminal */
+#define SNAPSHOTS              3         /* game states handed from simulation to drawing (one written, one drawn and one free) */
+#define SNAPSHOT_FRESH         4u        /* flag of free snapshot index when newer than drawn one */
+#define MAX_SEQUENCE_SIZE      64        /* bytes of longest escape sequence written to console */
+#define CLI_RESIZE_POLL_MS     250       /* milliseconds between console size checks where resizes aren't signaled */
+#define HUD_FRAMES             120       /* frame times kept for frame rate and graph */
+#define HUD_MARGIN             8         /* pixels between screen corner and HUD */
+#define HUD_GRAPH_HEIGHT       32        /* pixels of frame time graph (twice the target frame time) */
+#define CAPTURE_SLOTS          8         /* frames waiting to be written before capture drops them */
+#define GAME_SEED              1         /* seed of enemy spawns (recorded with input) */
+#define MAX_PARTICLES          16384     /* explosion and thruster particles alive at once in game */
+#define PARTICLE_EMITTERS      8         /* emitter configs of one particle pool */
+#define PARTICLE_SHADES        16        /* colors particles fade through over their life */
+#define PARTICLE_BATCH         64        /* particles placed at once before drawing them (multiple of 4) */
+#define PARTICLE_CHUNK         8192      /* particles sorted into rows of bins by one thread (multiple of PARTICLE_BATCH) */
+#define PARTICLE_CELLS         16        /* screen is split in at most PARTICLE_CELLS x PARTICLE_CELLS cells to mark areas particles were drawn on */
+#define INPUT_LOG_MAGIC        "HRV2"    /* first bytes of input logs (header holds key source since version 2) */
+#define INPUT_LOG_RECORD       7         /* bytes per logged key event (tick, key and state) */
 
 /* platform specific stuff */
 #if defined(_WIN32) || defined(_WIND64) || defined(__MINGW32__) || defined (__MINGW64__)
@@ -58,6 +99,11 @@
 	#include <unistd.h>
 	#include <fcntl.h>
 	#include <termios.h>
+	#include <pthread.h>
+	#include <errno.h>
+	#include <poll.h>
+	#include <signal.h>
+	#include <linux/input.h>
 
 	#define MAX_DISPLAY_NAME 64      /* maximum size of display name */
 	#define CLI_CURSOR_START_INDEX 1 /* where the console cursor starts */
@@ -77,11 +123,78 @@
 	typedef int64_t long_t;
 #endif
 
+/* vector instructions */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#undef __SSE2_ARCH__
+	#define __SSE2_ARCH__ 1
+
+	#include <emmintrin.h>
+#endif
+
 typedef unsigned char ubyte_t;
 
 /* define function macros */
 #define ABS(x) ((x < 0) ? x * -1 : x)
 #define SGN(x) ((x < 0) ? -1 : (x == 0) ? 0 : 1)
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+/* define enum types */
+typedef enum backend_e
+{
+	BACKEND_DEVICE, /* linux frame buffer device */
+	BACKEND_MEMORY  /* pages on anonymous or shared memory (headless) */
+} backend_t;
+
+typedef enum command_type_e
+{
+	COMMAND_RECT,     /* rectangle from first to second vertex (exclusive) */
+	COMMAND_TRIANGLE, /* triangle of three vertices */
+	COMMAND_LINE,     /* line from first to second vertex */
+	COMMAND_SPRITE    /* sprite with top left corner at first vertex */
+} command_type_t;
+
+typedef enum execution_e
+{
+	EXECUTION_COMMANDS,   /* draw commands sorted into each bin */
+	EXECUTION_SORT_SPOTS, /* sort particles of each chunk into rows of bins */
+	EXECUTION_DRAW_SPOTS  /* draw particles sorted into each row of bins */
+} execution_t;
+
+typedef enum input_key_e
+{
+	/* NOTE: other keys are their (lowercase) character */
+	INPUT_KEY_ESCAPE = 27,
+	INPUT_KEY_UP = 256,
+	INPUT_KEY_DOWN,
+	INPUT_KEY_RIGHT,
+	INPUT_KEY_LEFT,
+	INPUT_KEYS /* number of key codes */
+} input_key_t;
+
+typedef enum entity_kind_e
+{
+	ENTITY_ENEMY,     /* triangle moving down the screen */
+	ENTITY_PROJECTILE /* rectangle shot by player */
+} entity_kind_t;
+
+typedef enum emitter_kind_e
+{
+	EMITTER_EXPLOSION = 0, /* debris flying all around destroyed enemy */
+	EMITTER_THRUSTER = 1   /* exhaust trailing below player */
+} emitter_kind_t;
+
+typedef enum present_e
+{
+	PRESENT_COPY, /* copy back buffer to visible memory */
+	PRESENT_FLIP  /* copy back buffer to hidden page and pan display to it */
+} present_t;
+
+typedef enum cli_event_e
+{
+	CLI_EVENT_KEY = 1,   /* key can be read from console */
+	CLI_EVENT_RESIZE = 2 /* console may have been resized */
+} cli_event_t;
 
 /* define struct types */
 typedef struct vertice_s
@@ -90,12 +203,57 @@ typedef struct vertice_s
 	long_t y;
 } vertice_t;
 
-typedef struct console_s
+typedef struct edge_s
 {
-	console_mode_t old_mode;     /* previous mode */
-	vertice_t      size;         /* console size (columns X rows) */
-	double         aspect_ratio; /* aspect ratio from console size */
-} console_t;
+	int64_t origin; /* edge function value at first pixel */
+	int32_t step_x; /* value change per pixel to the right */
+	int32_t step_y; /* value change per pixel down */
+} edge_t;
+
+typedef struct region_s
+{
+	vertice_t start; /* first pixel */
+	vertice_t end;   /* pixel after last one (exclusive) */
+} region_t;
+
+typedef struct region_list_s
+{
+	region_t regions[MAX_REGIONS]; /* regions that don't overlap much */
+	size_t   count;                /* number of regions */
+} region_list_t;
+
+typedef struct key_event_s
+{
+	uint16_t key;     /* input_key_t */
+	bool     pressed; /* pressed (or repeated) instead of released */
+} key_event_t;
+
+typedef struct input_log_s
+{
+	FILE*       file;      /* log recorded or replayed (NULL when neither) */
+	bool        replaying; /* keys come from log instead of keyboard */
+	uint32_t    next_tick; /* tick of next logged event (replay) */
+	key_event_t next;      /* next logged event, key 0 marks last tick (replay) */
+	uint32_t    ticks;     /* ticks handled since init */
+} input_log_t;
+
+typedef struct input_s
+{
+	bool         evdev;                             /* keys come from input device instead of terminal */
+	bool         timed_release;                     /* keys are let go by timeout (terminal or replay of it) instead of release events */
+#ifndef __WINDOWS__
+	int          fd;                                /* stdin or input device */
+	int          old_flags;                         /* stdin file status flags */
+#endif
+	ubyte_t      pending[16];                       /* start of escape sequence still arriving */
+	size_t       pending_count;                     /* bytes of escape sequence */
+	double       pending_time;                      /* time escape sequence started */
+	input_log_t* log;                               /* log key events are recorded to (NULL when not recording) */
+	uint64_t     down[(INPUT_KEYS + 63) / 64];      /* keys held down */
+	uint64_t     pressed[(INPUT_KEYS + 63) / 64];   /* keys pressed (or repeated) on last poll */
+	uint64_t     repeating[(INPUT_KEYS + 63) / 64]; /* keys repeated by terminal since pressed */
+	double       seen[INPUT_KEYS];                  /* time key was last seen on terminal */
+} input_t;
 
 typedef struct color_s
 {
@@ -112,6 +270,43 @@ typedef struct print_style_s
 	ubyte_t decoration; /* decoration */
 } print_style_t;
 
+typedef struct cli_cell_s
+{
+	uint32_t      glyph; /* unicode code point */
+	print_style_t style; /* glyph style */
+} cli_cell_t;
+
+typedef struct console_s
+{
+	console_mode_t old_mode;        /* previous mode */
+	vertice_t      size;            /* console size (columns X rows) */
+	double         aspect_ratio;    /* aspect ratio from console size */
+	cli_cell_t*    cells;           /* cells to be shown (columns X rows) */
+	cli_cell_t*    shown;           /* cells on console since last present */
+	vertice_t      grid_size;       /* columns and rows of cell grids */
+	char*          output;          /* escape sequences and glyphs of present */
+	size_t         output_size;     /* bytes written to output */
+	size_t         output_capacity; /* bytes allocated for output */
+#ifndef __WINDOWS__
+	int            resize_pipe[2];  /* written by SIGWINCH handler, read by menu loop */
+	struct sigaction old_resize;    /* previous SIGWINCH action */
+#endif
+} console_t;
+
+typedef struct pixel_format_s
+{
+	const char* name;      /* layout name (e.g. XRGB8888) */
+	ubyte_t     size;      /* bytes per pixel */
+	ubyte_t     shift[4];  /* red, green, blue and alpha offsets */
+	ubyte_t     length[4]; /* red, green, blue and alpha bits */
+} pixel_format_t;
+
+typedef struct pixel_writer_s
+{
+	void (*put)(ubyte_t* address, const uint32_t value);              /* write one packed pixel */
+	void (*fill)(ubyte_t* row, size_t count, const uint32_t value);   /* write span of packed pixels */
+} pixel_writer_t;
+
 typedef struct framebuffer_s
 {
 #ifdef __WINDOWS__
@@ -122,15 +317,210 @@ typedef struct framebuffer_s
 	LONG_PTR  win_ext_style; /* current window extended style */
 	size_t    size;          /* size of screen */
 #else
+	backend_t                backend;       /* where pages live */
 	int                      fd;            /* file descriptor */
 	ubyte_t*                 address;       /* buffer address on memory */
 	size_t                   size;          /* buffer size on memory */
+	ubyte_t*                 buffer;        /* back buffer on system memory (drawing happens here) */
+	size_t                   buffer_size;   /* size of one frame */
+	size_t                   page;          /* page currently on screen */
+	present_t                present;       /* how back buffer is shown */
+	bool                     vsync;         /* wait for vertical sync before flipping */
+	pixel_format_t           format;        /* pixel layout from screen variable information */
+	const pixel_writer_t*    writer;        /* writers for pixel size (chosen at init) */
+	const char*              shm_name;      /* shared memory name of memory pages (anonymous if NULL) */
+	const char*              dump_path;     /* printf pattern of PPM files written on present (memory backend) */
+	size_t                   dump_count;    /* frames written to dump files */
+	region_list_t            dirty[DIRTY_FRAMES]; /* regions drawn this frame and on previous ones */
+	size_t                   cleared_bytes; /* bytes cleared on back buffer since init */
+	size_t                   shown_bytes;   /* bytes copied to screen since init */
 	struct fb_var_screeninfo orig_var_info; /* screen original variable information */
 	struct fb_var_screeninfo var_info;      /* screen current variable information */
 	struct fb_fix_screeninfo fix_info;      /* screen fixed information */
 #endif
 } framebuffer_t;
 
+typedef struct sprite_span_s
+{
+	uint16_t row;    /* sprite row */
+	uint16_t start;  /* first pixel of span */
+	uint16_t length; /* pixels of span */
+	bool     opaque; /* every pixel is opaque (copied instead of blended) */
+} sprite_span_t;
+
+typedef struct sprite_s
+{
+	vertice_t      size;       /* width and height in pixels */
+#ifdef __WINDOWS__
+	color_t*       colors;     /* premultiplied pixels */
+#else
+	ubyte_t*       pixels;     /* premultiplied pixels packed in screen format (alpha in unused byte of 32-bit layouts) */
+	ubyte_t*       alpha;      /* alpha of each pixel */
+#endif
+	sprite_span_t* spans;      /* runs of visible pixels, row by row (transparent pixels are skipped) */
+	uint32_t*      row_starts; /* first span of each row (and end of last one) */
+} sprite_t;
+
+typedef struct command_s
+{
+	command_type_t  type;        /* primitive drawn */
+	vertice_t       vertices[3]; /* primitive vertices */
+	color_t         color;       /* color */
+	const sprite_t* sprite;      /* sprite drawn (COMMAND_SPRITE only) */
+#ifndef __WINDOWS__
+	uint32_t        value;       /* packed color (set on execution) */
+	region_t        bounds;      /* pixels touched clipped to screen (set on execution) */
+#endif
+} command_t;
+
+typedef struct emitter_s
+{
+	float   velocity_x;  /* launch velocity added to that of emitting object (pixels per second) */
+	float   velocity_y;
+	float   spread;      /* radius of random launch velocity around it */
+	float   drag;        /* fraction of velocity lost per second */
+	float   life;        /* shortest life (seconds) */
+	float   life_spread; /* random life added to it */
+	color_t start;       /* color at birth */
+	color_t end;         /* color particles fade to */
+	ubyte_t size;        /* side of square drawn (1 for single pixels) */
+} emitter_t;
+
+typedef struct particles_s
+{
+	float*    coord_x;    /* particle positions */
+	float*    coord_y;
+	float*    velocity_x; /* particle axis velocities (pixels per second) */
+	float*    velocity_y;
+	float*    drag;       /* fraction of velocity lost per second */
+	float*    age;        /* fraction of life gone (removed at 1) */
+	float*    fade;       /* fraction of life gone per second */
+	ubyte_t*  emitters;   /* emitter of each particle (gives colors and size) */
+	size_t    count;      /* number of particles */
+	size_t    capacity;   /* maximum number of particles (multiple of 4) */
+	emitter_t configs[PARTICLE_EMITTERS];                 /* emitters particles come from */
+	size_t    configs_count;                              /* number of emitters */
+	uint32_t  shades[PARTICLE_EMITTERS][PARTICLE_SHADES]; /* packed colors of each emitter from birth to death */
+	long_t    margin;                                     /* pixels the largest particle reaches past its center */
+	uint32_t  random;                                     /* state of launch randomness (xorshift) */
+} particles_t;
+
+#ifndef __WINDOWS__
+typedef struct draw_worker_s
+{
+	struct command_buffer_s* cb;         /* command buffer the worker executes */
+	size_t                   generation; /* last execution done by the worker */
+	pthread_t                thread;     /* thread running the worker */
+} draw_worker_t;
+
+typedef struct particle_spot_s
+{
+	int16_t x;       /* left of square (may be left of screen) */
+	int16_t y;       /* top of square (may be above screen) */
+	ubyte_t emitter; /* emitter of particle (gives colors and size) */
+	ubyte_t shade;   /* color of particle age */
+} particle_spot_t;
+#endif
+
+typedef struct command_buffer_s
+{
+	command_t*         commands;                  /* commands recorded this frame */
+	size_t             count;                     /* number of commands */
+	size_t             capacity;                  /* commands that fit without growing */
+#ifndef __WINDOWS__
+	framebuffer_t*     fb;                        /* frame buffer commands are executed on */
+	size_t             bin_columns;               /* bins per row of screen */
+	size_t             bin_rows;                  /* rows of bins */
+	size_t*            bin_starts;                /* first entry of each bin (and end of last one) */
+	size_t*            bin_cursors;               /* next entry written to each bin */
+	uint32_t*          entries;                   /* command indices of every bin, in recording order */
+	size_t             entries_capacity;          /* entries that fit without growing */
+	particle_spot_t*   spots;                     /* particles of every chunk sorted by row of bins (draw_particles only) */
+	size_t*            spot_starts;               /* first spot of each row of bins of every chunk */
+	size_t*            spot_ends;                 /* end of spots of each row of bins of every chunk */
+	ubyte_t*           spot_cells;                /* cells touched by every chunk (PARTICLE_CELLS x PARTICLE_CELLS each) */
+	size_t             spots_capacity;            /* spots that fit without growing */
+	size_t             chunks_capacity;           /* chunks that fit without growing */
+	size_t             spot_chunks;               /* chunks of particles being drawn */
+	size_t             spot_rows;                 /* most rows of bins a spot touches */
+	unsigned           cell_shift_x;              /* cells are 1 << cell_shift_x pixels wide */
+	unsigned           cell_shift_y;              /* cells are 1 << cell_shift_y pixels high */
+	bool               threaded_particles;        /* particles are sorted and drawn by workers too (HARVEST_THREADED_PARTICLES) */
+	const particles_t* particles;                 /* particles being drawn */
+	float              lag;                       /* seconds back particles are drawn */
+	execution_t        execution;                 /* work of current execution */
+	draw_worker_t      workers[MAX_DRAW_THREADS]; /* threads helping calling thread */
+	size_t             workers_count;             /* number of helper threads */
+	pthread_mutex_t    lock;                      /* protects execution state below */
+	pthread_cond_t     work_signal;               /* new execution started */
+	pthread_cond_t     done_signal;               /* all workers finished execution */
+	size_t             generation;                /* execution counter */
+	size_t             pending;                   /* workers still executing */
+	size_t             next_bin;                  /* next bin to be taken */
+	bool               quit;                      /* workers must terminate */
+#endif
+} command_buffer_t;
+
+typedef struct font_s
+{
+	size_t         width;    /* glyph width in pixels */
+	size_t         height;   /* glyph height in pixels */
+	size_t         row_size; /* bytes per glyph row (most significant bit is leftmost pixel) */
+	size_t         first;    /* character of first glyph */
+	size_t         count;    /* number of glyphs */
+	const ubyte_t* bitmap;   /* rows of every glyph, one glyph after another */
+	ubyte_t*       data;     /* font file contents (NULL for built in font) */
+} font_t;
+
+#ifndef __WINDOWS__
+typedef struct glyph_span_s
+{
+	uint16_t row;    /* glyph row */
+	uint16_t start;  /* first pixel of span */
+	uint16_t length; /* pixels of span */
+} glyph_span_t;
+#endif
+
+typedef struct glyph_cache_s
+{
+	const font_t* font;   /* font glyphs come from */
+	color_t       color;  /* color of glyph pixels */
+#ifndef __WINDOWS__
+	ubyte_t*      pixels; /* glyph row of colored pixels packed in screen format (spans are copied from it) */
+	glyph_span_t* spans;  /* runs of set pixels of every glyph, row by row */
+	uint32_t*     starts; /* first span of each glyph (and end of last one) */
+#endif
+} glyph_cache_t;
+
+typedef struct hud_s
+{
+	bool          shown;                   /* HUD is drawn over frames */
+	font_t        font;                    /* font of HUD text */
+	glyph_cache_t text;                    /* HUD text glyphs */
+	double        frame_times[HUD_FRAMES]; /* time between last frames (seconds) */
+	size_t        frames;                  /* frames timed since init */
+	double        last_frame;              /* time last frame started (get_time) */
+} hud_t;
+
+typedef struct entities_s
+{
+	float*   coord_x;    /* entity positions (center of boundaries box) */
+	float*   coord_y;
+	float*   previous_x; /* entity positions before last update (drawing happens in between) */
+	float*   previous_y;
+	float*   velocity_x; /* entity axis velocities (pixels per second) */
+	float*   velocity_y;
+	float*   accel_x;    /* entity axis accelerations (pixels per second squared) */
+	float*   accel_y;
+	float*   box_x;      /* half sizes of boundaries boxes */
+	float*   box_y;
+	color_t* colors;     /* colors */
+	ubyte_t* kinds;      /* entity_kind_t of each entity */
+	ubyte_t* alive;      /* entities kept on next update */
+	size_t   count;      /* number of entities */
+	size_t   capacity;   /* maximum number of entities (multiple of 4) */
+} entities_t;
+
 typedef struct rect_s
 {
 	vertice_t start; /* rect start */
@@ -138,28 +528,128 @@ typedef struct rect_s
 	color_t   color; /* color */
 } rect_t;
 
+typedef struct collision_s
+{
+	uint32_t enemy;      /* index of enemy hit */
+	uint32_t projectile; /* index of projectile hitting it */
+} collision_t;
+
+typedef struct grid_entry_s
+{
+	rect_t   box;    /* boundaries box of entity (copied so each cell is read in order) */
+	uint32_t entity; /* index of entity */
+} grid_entry_t;
+
+typedef struct collision_grid_s
+{
+	size_t        columns;             /* cells per row of screen */
+	size_t        rows;                /* rows of cells */
+	uint32_t*     cell_starts;         /* first entry of each cell and kind, enemies then projectiles (and end of last one) */
+	uint32_t*     cell_cursors;        /* next entry written to each cell and kind */
+	grid_entry_t* entries;             /* entities of every cell */
+	size_t        entries_capacity;    /* entries that fit without growing */
+	rect_t*       boxes;               /* boundaries box of each entity on last build */
+	size_t        boxes_capacity;      /* boxes that fit without growing */
+	collision_t*  collisions;          /* enemies hit by projectiles on last search */
+	size_t        collisions_count;    /* number of collisions */
+	size_t        collisions_capacity; /* collisions that fit without growing */
+} collision_grid_t;
+
 typedef struct player_s
 {
-	vertice_t coord;     /* entity position */
+	float     coord_x;   /* left of boundaries box with sub-pixel precision (box is moved by whole pixels) */
 	vertice_t velocity;  /* entity axis velocity */
 	vertice_t accel;     /* entity axis acceleration */
 	color_t   color;     /* color */
 	rect_t    bound_box; /* boundaries box */
 } player_t;
 
+typedef struct capture_s
+{
+#ifndef __WINDOWS__
+	int             fd;                /* Y4M file frames are written to (-1 when not capturing) */
+	ubyte_t*        slots;             /* ring of CAPTURE_SLOTS back buffer copies */
+	size_t          slot_size;         /* bytes of one slot */
+	ubyte_t*        record;            /* FRAME header and YUV 4:2:0 planes of frame being written */
+	size_t          record_size;       /* bytes of record */
+	vertice_t       resolution;        /* width and height of frames */
+	size_t          line_length;       /* bytes per row of frames */
+	size_t          pixel_size;        /* bytes per pixel of frames */
+	ubyte_t         shifts[3];         /* red, green and blue offsets of at most 8 significant bits */
+	bool            direct;            /* channels are whole bytes of 32-bit pixels */
+	ubyte_t         widen[3][256];     /* red, green and blue widened to 8 bits */
+	pthread_mutex_t lock;              /* protects ring state below */
+	pthread_cond_t  signal;            /* frame added or capture stopped */
+	size_t          head;              /* frames added to ring */
+	size_t          tail;              /* frames taken from ring */
+	bool            quit;              /* writer must drain ring and stop */
+	pthread_t       thread;            /* writer thread */
+	bool            failed;            /* file can't be written anymore (frames are dropped) */
+#endif
+	size_t          captured;          /* frames written to file */
+	size_t          dropped;           /* frames lost because ring was full or file failed */
+} capture_t;
+
+typedef struct frame_stats_s
+{
+	size_t frames;       /* number of frames presented */
+	double render_time;  /* total time drawing into back buffer (seconds) */
+	double present_time; /* total time showing back buffer (seconds) */
+} frame_stats_t;
+
+typedef struct snapshot_s
+{
+	double      time;      /* time tick of snapshot was due (get_time) */
+	rect_t      player;    /* player boundaries box */
+	entities_t  entities;  /* enemies and projectiles */
+	particles_t particles; /* explosions and thruster exhaust */
+	size_t      score;     /* enemies destroyed */
+} snapshot_t;
+
 typedef struct scene_s
 {
-	console_t     cli;         /* console data */
-	framebuffer_t fb;          /* frame buffer data */
-	clock_t       frame_delta; /* time from last render */
-	bool          game_over;   /* finish game */
-	player_t      player;      /* game player */
+	console_t        cli;                  /* console data */
+	framebuffer_t    fb;                   /* frame buffer data */
+	bool             game_over;            /* finish game */
+	player_t         player;               /* game player */
+	frame_stats_t    stats;                /* frame timing */
+	command_buffer_t cb;                   /* draw commands of current frame */
+	input_t          input;                /* keys of current tick */
+	input_log_t      input_log;            /* keys recorded to HARVEST_RECORD or replayed from HARVEST_REPLAY */
+	entities_t*      entities;             /* enemies and projectiles (of written snapshot) */
+	particles_t*     particles;            /* explosions and thruster exhaust (of written snapshot) */
+	collision_grid_t grid;                 /* entities sorted by screen cells */
+	double           game_time;            /* simulated time (seconds) */
+	double           spawn_time;           /* simulated time next enemy is spawned */
+	size_t           score;                /* enemies destroyed */
+	hud_t            hud;                  /* frame rate and score overlay */
+	capture_t        capture;              /* frames recorded to HARVEST_CAPTURE */
+	snapshot_t       snapshots[SNAPSHOTS]; /* game states handed to drawing */
+	atomic_uint      free_snapshot;        /* snapshot owned by neither side (with SNAPSHOT_FRESH when not drawn yet) */
+	unsigned         written_snapshot;     /* snapshot owned by simulation */
+	unsigned         published_snapshot;   /* snapshot last published (stepped into written one) */
+	unsigned         drawn_snapshot;       /* snapshot owned by drawing */
+	double           frame_time;           /* time between frames (0 for as fast as presenting allows) */
+	atomic_bool      drawing;              /* render thread keeps drawing */
+#ifndef __WINDOWS__
+	pthread_t        render_thread;        /* thread drawing frames */
+#endif
 } scene_t;
 
 /* forward declarations */
 void draw_cli_menu(scene_t* scene);
+void advance_snapshot(scene_t* scene);
+void update_game(scene_t* scene);
+void publish_snapshot(scene_t* scene, const double time);
 void render_game(scene_t* scene);
 void handle_input(scene_t* scene);
+#if !defined(__WINDOWS__) && !defined(HARVEST_BENCH)
+static void* run_renderer(void* arg);
+#endif
+#ifndef __WINDOWS__
+static void sort_spots(command_buffer_t* cb, const size_t chunk);
+static void execute_spots(command_buffer_t* cb, const size_t row);
+#endif
 
 /* swap two long_t values */
 void swap(long_t* a, long_t* b)
@@ -171,6 +661,46 @@ void swap(long_t* a, long_t* b)
 	}
 }
 
+/* get time in seconds from an arbitrary point (only differences are meaningful) */
+double get_time()
+{
+#ifdef __WINDOWS__
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	return (double)counter.QuadPart / frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + (now.tv_nsec / 1e9);
+#endif
+}
+
+/* sleep until get_time() reaches @deadline */
+void sleep_until(const double deadline)
+{
+	double remaining = deadline - get_time();
+
+	if (remaining > 0.0) {
+#ifdef __WINDOWS__
+		Sleep((DWORD)(remaining * SECOND_MS));
+#else
+		struct timespec time;
+		double seconds = (double)(time_t)deadline;
+
+		/* absolute deadline can't be cut short by signals */
+		time.tv_sec = (time_t)seconds;
+		time.tv_nsec = (long)((deadline - seconds) * 1e9);
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, NULL) == EINTR);
+#endif
+	}
+}
+
 /* get char from stdin without blocking */
 int get_char()
 {
@@ -197,597 +727,5064 @@ int get_char()
 	return result;
 }
 
-/* convert color_t struct to ulong_t */
-ulong_t color_to_long(framebuffer_t* fb, const color_t color)
+/* set or clear bit of @key on @bits */
+static void set_key_bit(uint64_t* bits, const uint16_t key, const bool value)
 {
-	if (fb != NULL)
-		return (color.red << 24) | (color.green << 16) | (color.blue << 8) | color.alpha;
-
-	return 0;
+	if (value)
+		bits[key / 64] |= (uint64_t)1 << (key % 64);
+	else
+		bits[key / 64] &= ~((uint64_t)1 << (key % 64));
 }
 
+/* get bit of @key on @bits */
+static bool get_key_bit(const uint64_t* bits, const uint16_t key)
+{
+	return ((bits[key / 64] >> (key % 64)) & 1);
+}
 
-/* write decorated format string to stream */
-void fprintfdec(FILE* stream, const print_style_t style, const char* format, ...)
+/* check if @key is held down */
+bool is_key_down(const input_t* input, const uint16_t key)
 {
-	va_list args;
-	va_start(args, format);
+	return (input != NULL && key < INPUT_KEYS && get_key_bit(input->down, key));
+}
 
-	if (stream != NULL) {
-		/* alloc string to do formatting */
-		char* str = malloc(BUFSIZ);
+/* check if @key is held, terminal keys only once repeating (down is just a guess until then) */
+bool is_key_held(const input_t* input, const uint16_t key)
+{
+	return (is_key_down(input, key) && (!input->timed_release || get_key_bit(input->repeating, key)));
+}
 
-		if (str != NULL) {
-#ifdef __WINDOWS__
-			/* NOTE: old windows versions don't support colored output so don't show it */
-			int size = vsprintf(str, format, args);
+/* check if @key was pressed (or repeated) on last poll */
+bool was_key_pressed(const input_t* input, const uint16_t key)
+{
+	return (input != NULL && key < INPUT_KEYS && get_key_bit(input->pressed, key));
+}
 
-			DWORD written;
-			WriteConsoleA(GetStdHandle(STD_OUTPUT_HANDLE), str, size, &written, NULL);
-#else
-			/* add string styles */
-			sprintf(str, "\e[38;2;%d;%d;%dm\e[48;2;%d;%d;%dm\e[%dm", 
-				style.foreground.red, style.foreground.green, style.foreground.blue, 
-				style.background.red, style.background.green, style.background.blue,
-				style.decoration);
+/* read 32-bit little endian value */
+static uint32_t read_le32(const ubyte_t* bytes)
+{
+	return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
 
-			strcat(str, format);
-			strcat(str, "\e[0m");
+/* write 32-bit little endian value */
+static void write_le32(ubyte_t* bytes, const uint32_t value)
+{
+	bytes[0] = (ubyte_t)value;
+	bytes[1] = (ubyte_t)(value >> 8);
+	bytes[2] = (ubyte_t)(value >> 16);
+	bytes[3] = (ubyte_t)(value >> 24);
+}
 
-			/* final string */
-			vfprintf(stream, str, args);
-#endif
+/* read next logged event of replay (key 0 once log is over) */
+static void read_input_log(input_log_t* log)
+{
+	ubyte_t record[INPUT_LOG_RECORD];
 
-			free(str);
-		}
+	if (fread(record, 1, sizeof(record), log->file) == sizeof(record)) {
+		log->next_tick = read_le32(record);
+		log->next = (key_event_t){ (uint16_t)(record[4] | (record[5] << 8)), record[6] != 0 };
 	}
-
-	va_end(args);
+	else
+		log->next = (key_event_t){ 0, false };
 }
 
-/* put pixel into screen */
-void put_pixel(framebuffer_t* fb, const vertice_t position, const color_t color)
+/* write key event of @tick to log */
+static void write_input_log(input_log_t* log, const uint32_t tick, const key_event_t event)
 {
-	if (fb != NULL) {
-#ifdef __WINDOWS__
-		SetPixel(fb->device, position.x, position.y, RGB(color.red, color.green, color.blue));
-#else
-		void* address = fb->address + (position.y * fb->fix_info.line_length) + (position.x * (fb->var_info.bits_per_pixel / 8) + 4);
+	ubyte_t record[INPUT_LOG_RECORD];
 
-		/* TODO: Fix color not working on Linux */
-		if ((ulong_t)address <= (ulong_t)(fb->address + fb->size))
-			memset(address, color_to_long(fb, color), (fb->var_info.bits_per_pixel / 8));
-#endif
-	}
+	write_le32(record, tick);
+	record[4] = (ubyte_t)event.key;
+	record[5] = (ubyte_t)(event.key >> 8);
+	record[6] = event.pressed;
+
+	fwrite(record, 1, sizeof(record), log->file);
 }
 
-/* draw a line into screen */
-void draw_line(framebuffer_t* fb, vertice_t start, vertice_t end, const color_t color)
+/* update key states with key event (recorded to log if any) */
+static void push_key_event(input_t* input, const uint16_t key, const bool pressed, const double now)
 {
-	if (fb != NULL) {
-#ifdef __WINDOWS__
-		HGDIOBJ original = SelectObject(fb->device, GetStockObject(DC_PEN));
+	if (key == 0 || key >= INPUT_KEYS)
+		return;
 
-		if (original != NULL) {
-			/* switch pen */
-			SelectObject(fb->device, GetStockObject(DC_PEN));
-			SetDCPenColor(fb->device, RGB(color.red, color.green, color.blue));
+	if (pressed) {
+		/* terminals repeat held keys faster after first repeat */
+		if (get_key_bit(input->down, key))
+			set_key_bit(input->repeating, key, true);
 
-			/* draw line */
-			MoveToEx(fb->device, start.x, start.y, NULL);
-			LineTo(fb->device, end.x, end.y);
+		set_key_bit(input->down, key, true);
+		set_key_bit(input->pressed, key, true);
+		input->seen[key] = now;
+	}
+	else {
+		set_key_bit(input->down, key, false);
+		set_key_bit(input->repeating, key, false);
+	}
 
-			SelectObject(fb->device, original);
-		}
-#else
-		/* find delta and sign values */
-		vertice_t delta = { end.x - start.x, end.y - start.y };
-		int sign[4] = {
-			SGN(delta.x),
-			SGN(delta.y),
-			SGN(delta.x),
-			0
-		};
+	/* NOTE: every event is recorded, replay must go through same states */
+	if (input->log != NULL)
+		write_input_log(input->log, input->log->ticks, (key_event_t){ key, pressed });
+}
+
+/* decode key at start of @bytes into @key (0 if unknown), returns bytes used or 0 if escape sequence is incomplete */
+static size_t decode_key(const ubyte_t* bytes, const size_t count, uint16_t* key)
+{
+	*key = 0;
 
-		/* get longest and shortest delta */
-		size_t longest = ABS(delta.x);
-		size_t shortest = ABS(delta.y);
+	if (bytes[0] != '\e') {
+		*key = (bytes[0] >= 'A' && bytes[0] <= 'Z') ? bytes[0] - 'A' + 'a' : bytes[0];
+		return 1;
+	}
 
-		if (longest < shortest) {
-			longest = ABS(delta.y);
-			shortest = ABS(delta.x);
-			sign[3] = SGN(delta.y);
-			sign[2] = 0;
-		}
+	if (count == 1)
+		return 0;
 
-		int numerator = longest >> 1;
+	/* CSI (escape [) and SS3 (escape O) sequences end on a byte from @ to ~ */
+	if (bytes[1] == '[' || bytes[1] == 'O') {
+		for (size_t i = 2; i < count; i++) {
+			if (bytes[i] >= 0x40 && bytes[i] <= 0x7E) {
+				switch (bytes[i]) {
+					case 'A':
+						*key = INPUT_KEY_UP;
+						break;
 
-		/* calculate each pixel */
-		for (size_t i = 0; i <= longest; i++) {
-			put_pixel(fb, start, color);
+					case 'B':
+						*key = INPUT_KEY_DOWN;
+						break;
 
-			numerator += shortest;
+					case 'C':
+						*key = INPUT_KEY_RIGHT;
+						break;
 
-			if (numerator > longest) {
-				numerator -= longest;
+					case 'D':
+						*key = INPUT_KEY_LEFT;
+				}
 
-				start.x += sign[0];
-				start.y += sign[1];
-			}
-			else {
-				start.x += sign[2];
-				start.y += sign[3];
+				return i + 1;
 			}
 		}
-#endif
+
+		return 0;
 	}
+
+	/* escape followed by anything else is escape key itself */
+	*key = INPUT_KEY_ESCAPE;
+
+	return 1;
 }
 
-/* draw rectangle into screen */
-void draw_rect(framebuffer_t* fb, vertice_t start, vertice_t end, const color_t color)
+/* decode @count terminal bytes (starting with pending ones) into key events, incomplete escape sequence is kept for next poll */
+static void decode_terminal(input_t* input, const ubyte_t* bytes, const size_t count, const double now)
 {
-	if (fb != NULL) {
-		/* check if vertices are swapped */
-		if (start.x > end.x)
-			swap(&start.x, &end.x);
-		if (start.y > end.y)
-			swap(&start.y, &end.y);
+	size_t carried = input->pending_count;
 
-#ifdef __WINDOWS__
-		RECT screen = { start.x, start.y, end.x, end.y };
-		HBRUSH brush = CreateSolidBrush(RGB(color.red, color.green, color.blue));
+	input->pending_count = 0;
 
-		FillRect(fb->device, &screen, brush);
-		DeleteObject(brush);
-#else
-		vertice_t position = { start.x + 1, start.y };
-		vertice_t delta = { end.x - start.x, end.y - start.y };
-		size_t size = delta.x * delta.y;
+	for (size_t i = 0; i < count;) {
+		uint16_t key;
+		size_t used = decode_key(bytes + i, count - i, &key);
 
-		for (size_t i = 0; i < size; i++) {
-			put_pixel(fb, position, color);
+		if (used == 0) {
+			bool fresh = (i > 0 || carried == 0);
 
-			/* las pixel rendered */
-			if (position.x == end.x && position.y == end.y)
-				break;
+			/* wait for rest of sequence, unless escape key was pressed alone */
+			if (count - i < sizeof(input->pending) && (fresh || now - input->pending_time < ESCAPE_TIME)) {
+				if (fresh)
+					input->pending_time = now;
 
-			if (position.x == end.x) {
-				position.x = start.x;
-				position.y++;
+				memcpy(input->pending, bytes + i, count - i);
+				input->pending_count = count - i;
+				break;
 			}
 
-			position.x++;
+			key = INPUT_KEY_ESCAPE;
+			used = 1;
 		}
-#endif
+
+		push_key_event(input, key, true, now);
+		i += used;
 	}
 }
 
-/* NOTE: only used for drawing triangles on Linux */
 #ifndef __WINDOWS__
-/* bottom flat triangle */
-static void fill_bottom_flat_triangle(framebuffer_t* fb, vertice_t a, vertice_t b, vertice_t c, const color_t color)
+/* get key of input device @code (0 if not used) */
+static uint16_t map_device_key(const uint16_t code)
 {
-	if (fb != NULL) {
-		float rev_slope_left = (float)(b.x - a.x) / (b.y - a.y);
-		float rev_slope_right = (float)(c.x - a.x) / (c.y - a.y);
-		float curr_x_left = a.x;
-		float curr_x_right = a.x;
+	switch (code) {
+		case KEY_ESC:
+			return INPUT_KEY_ESCAPE;
 
-		for (long_t scanline = a.y; scanline <= b.y; scanline++) {
-			vertice_t line_start = { (long_t)curr_x_left, scanline };
-			vertice_t line_end = { (long_t)curr_x_right, scanline };
+		case KEY_SPACE:
+			return ' ';
 
-			draw_line(fb, line_start, line_end, color);
+		case KEY_ENTER:
+			return '\r';
 
-			curr_x_left += rev_slope_left;
-			curr_x_right += rev_slope_right;
-		}
+		case KEY_UP:
+			return INPUT_KEY_UP;
+
+		case KEY_DOWN:
+			return INPUT_KEY_DOWN;
+
+		case KEY_RIGHT:
+			return INPUT_KEY_RIGHT;
+
+		case KEY_LEFT:
+			return INPUT_KEY_LEFT;
 	}
+
+	/* letter rows of keyboard */
+	if (code >= KEY_Q && code <= KEY_P)
+		return "qwertyuiop"[code - KEY_Q];
+	if (code >= KEY_A && code <= KEY_L)
+		return "asdfghjkl"[code - KEY_A];
+	if (code >= KEY_Z && code <= KEY_M)
+		return "zxcvbnm"[code - KEY_Z];
+
+	return 0;
 }
+#endif
 
-/* top flat triangle */
-static void fill_top_flat_triangle(framebuffer_t* fb, vertice_t a, vertice_t b, vertice_t c, const color_t color)
+/* read every key available with a single call and update key states */
+void poll_input(input_t* input)
 {
-	if (fb != NULL) {
-		float rev_slope_left = (float)(c.x - a.x) / (c.y - a.y);
-		float rev_slope_right = (float)(c.x - b.x) / (c.y - b.y);
-		float curr_x_left = c.x;
-		float curr_x_right = c.x;
+	if (input == NULL)
+		return;
+
+	double now = get_time();
 
-		for (long_t scanline = c.y; scanline > a.y; scanline--) {
-			vertice_t line_start = { (long_t)curr_x_left, scanline };
-			vertice_t line_end = { (long_t)curr_x_right, scanline };
+	memset(input->pressed, 0, sizeof(input->pressed));
+
+#ifdef __WINDOWS__
+	ubyte_t bytes[sizeof(input->pending) + MAX_INPUT_BYTES];
+	size_t count = input->pending_count;
+
+	memcpy(bytes, input->pending, input->pending_count);
+
+	/* NOTE: console has no escape sequences, arrows come after a 0 or 224 prefix */
+	while (count < sizeof(bytes) && _kbhit()) {
+		int ch = _getch();
+
+		if (ch == 0 || ch == 224) {
+			switch (_getch()) {
+				case 72:
+					push_key_event(input, INPUT_KEY_UP, true, now);
+					break;
+
+				case 80:
+					push_key_event(input, INPUT_KEY_DOWN, true, now);
+					break;
 
-			draw_line(fb, line_start, line_end, color);
+				case 77:
+					push_key_event(input, INPUT_KEY_RIGHT, true, now);
+					break;
 
-			curr_x_left -= rev_slope_left;
-			curr_x_right -= rev_slope_right;
+				case 75:
+					push_key_event(input, INPUT_KEY_LEFT, true, now);
+			}
 		}
+		else
+			bytes[count++] = (ubyte_t)ch;
 	}
-}
-
-/* get intersection bewtween two lines */
-static bool line_intersection(vertice_t a, vertice_t b, vertice_t c, vertice_t d, vertice_t* output)
-{
-	/* represent lines as formulas */
-	float a1 = b.y - a.y;
-	float b1 = a.x - b.x;
-	float c1 = a1 * (a.x) + b1 * (a.y);
-	float a2 = d.y - c.y;
-	float b2 = c.x - d.x;
-	float c2 = a2 * (c.x) + b2 * (c.y);
 
-	/* calculate determinant */
-	float determinant = a1 * b2 - a2 * b1;
+	decode_terminal(input, bytes, count, now);
+#else
+	if (input->evdev) {
+		struct input_event events[MAX_INPUT_BYTES / sizeof(struct input_event)];
+		ssize_t size = read(input->fd, events, sizeof(events));
+
+		/* device sends press (1), repeat (2) and release (0) */
+		for (ssize_t i = 0; i < size / (ssize_t)sizeof(struct input_event); i++) {
+			if (events[i].type == EV_KEY)
+				push_key_event(input, map_device_key(events[i].code), events[i].value != 0, now);
+		}
+	}
+	else {
+		ubyte_t bytes[sizeof(input->pending) + MAX_INPUT_BYTES];
+		ssize_t size;
 
-	/* check lines aren't in pararell */
-	if (determinant != 0) {
-		output->x = (long_t)((b2 * c1 - b1 * c2) / determinant);
-		output->y = (long_t)((a1 * c2 - a2 * c1) / determinant);
+		memcpy(bytes, input->pending, input->pending_count);
+		size = read(input->fd, bytes + input->pending_count, MAX_INPUT_BYTES);
 
-		return true;
+		decode_terminal(input, bytes, input->pending_count + ((size > 0) ? (size_t)size : 0), now);
 	}
+#endif
 
-	return false;
+	/* terminal has no key releases, keys are let go once they stop repeating */
+	if (input->timed_release) {
+		for (uint16_t key = 0; key < INPUT_KEYS; key++) {
+			if (get_key_bit(input->down, key) && now - input->seen[key] > (get_key_bit(input->repeating, key) ? KEY_REPEAT_TIME : KEY_DELAY_TIME))
+				push_key_event(input, key, false, now);
+		}
+	}
 }
-#endif
 
-/* draw triangle into screen */
-void draw_triangle(framebuffer_t* fb, vertice_t a, vertice_t b, vertice_t c, const color_t color)
+/* terminate input and give stdin back */
+void terminate_input(input_t* input)
 {
-	if (fb != NULL) {
+	if (input != NULL) {
+#ifndef __WINDOWS__
+		if (input->evdev) {
+			close(input->fd);
+
+			/* drop keys typed on terminal meanwhile */
+			tcflush(STDIN_FILENO, TCIFLUSH);
+		}
+		else if (input->fd != -1)
+			fcntl(input->fd, F_SETFL, input->old_flags);
+
+		input->fd = -1;
+#endif
+		input->evdev = false;
+	}
+}
+
+/* initialize input from input device HARVEST_INPUT (e.g. /dev/input/event0) or non-blocking stdin */
+bool init_input(input_t* input)
+{
+	bool success = false;
+
+	if (input != NULL) {
+		memset(input, 0, sizeof(input_t));
+
+		input->timed_release = true;
+
 #ifdef __WINDOWS__
-		HGDIOBJ original = SelectObject(fb->device, GetStockObject(DC_PEN));
+		success = true;
+#else
+		const char* device = getenv("HARVEST_INPUT");
 
-		if (original != NULL) {
-			/* switch pen */
-			SelectObject(fb->device, GetStockObject(DC_PEN));
-			SetDCPenColor(fb->device, RGB(color.red, color.green, color.blue));
+		input->fd = -1;
 
-			/* convert vertices to points */
-			POINT points[3] = { { a.x, a.y }, { b.x, b.y }, { c.x, c.y} };
+		if (device != NULL && (input->fd = open(device, O_RDONLY | O_NONBLOCK)) != -1) {
+			input->evdev = true;
+			input->timed_release = false;
+		}
+		else if ((input->old_flags = fcntl(STDIN_FILENO, F_GETFL)) != -1 && fcntl(STDIN_FILENO, F_SETFL, input->old_flags | O_NONBLOCK) != -1)
+			input->fd = STDIN_FILENO;
 
-			/* draw triangle */
-			Polygon(fb->device, points, 3);
+		success = (input->fd != -1);
+#endif
+	}
 
-			SelectObject(fb->device, original);
+	return success;
+}
+
+/* close log, marking last tick of recording */
+void terminate_input_log(input_log_t* log)
+{
+	if (log != NULL && log->file != NULL) {
+		if (!log->replaying)
+			write_input_log(log, log->ticks, (key_event_t){ 0, false });
+
+		fclose(log->file);
+		log->file = NULL;
+	}
+}
+
+/* record keys of every tick to @record_path or replay them from @replay_path (both NULL for neither), log holds @seed and @resolution of game and how keys of @input are let go */
+bool init_input_log(input_log_t* log, input_t* input, const char* record_path, const char* replay_path, const uint32_t seed, const vertice_t resolution)
+{
+	bool success = false;
+
+	if (log != NULL && input != NULL) {
+		ubyte_t header[20];
+
+		memset(log, 0, sizeof(input_log_t));
+
+		if (replay_path != NULL) {
+			log->replaying = true;
+			log->file = fopen(replay_path, "rb");
+
+			/* simulation only repeats itself with same seed and screen size */
+			success = (log->file != NULL && fread(header, 1, sizeof(header), log->file) == sizeof(header) && !memcmp(header, INPUT_LOG_MAGIC, 4)
+				&& read_le32(header + 4) == seed && read_le32(header + 8) == (uint32_t)resolution.x && read_le32(header + 12) == (uint32_t)resolution.y);
+
+			/* keys move player as they did when recorded */
+			if (success) {
+				input->timed_release = (read_le32(header + 16) & 1) != 0;
+				read_input_log(log);
+			}
 		}
-#else
-		/* sort vertices by y-coordinate */
-		if (a.y > b.y) {
-			swap(&a.x, &b.x);
-			swap(&a.y, &b.y);
+		else if (record_path != NULL) {
+			log->file = fopen(record_path, "wb");
+
+			memcpy(header, INPUT_LOG_MAGIC, 4);
+			write_le32(header + 4, seed);
+			write_le32(header + 8, (uint32_t)resolution.x);
+			write_le32(header + 12, (uint32_t)resolution.y);
+			write_le32(header + 16, input->timed_release);
+
+			success = (log->file != NULL && fwrite(header, 1, sizeof(header), log->file) == sizeof(header));
 		}
-		if (b.y > c.y) {
-			swap(&b.x, &c.x);
-			swap(&b.y, &c.y);
+		else
+			success = true;
+
+		if (!success) {
+			if (log->file != NULL)
+				fclose(log->file);
+
+			memset(log, 0, sizeof(input_log_t));
 		}
-		if (a.y > c.y) {
-			swap(&a.x, &c.x);
-			swap(&a.y, &c.y);
+	}
+
+	return success;
+}
+
+/* get keys of current tick from keyboard (recording them) or from replayed log, return false once replay is over */
+bool poll_logged_input(input_log_t* log, input_t* input)
+{
+	bool more = true;
+
+	if (log == NULL || input == NULL)
+		return false;
+
+	if (log->replaying && log->file != NULL) {
+		memset(input->pressed, 0, sizeof(input->pressed));
+
+		/* events of this tick, replayed in recorded order */
+		while (log->next.key != 0 && log->next_tick == log->ticks) {
+			push_key_event(input, log->next.key, log->next.pressed, (double)log->ticks * TICK_TIME);
+			read_input_log(log);
 		}
 
-		/* check for general cases */
-		if (b.y == c.y)
-			fill_bottom_flat_triangle(fb, a, b, c, color);
-		else if (a.y == b.y)
-			fill_top_flat_triangle(fb, a, b, c, color);
-		else {
-			/* split triangle into bottom flat and top flat */
-			vertice_t d = { c.x + b.x, b.y };
+		more = (log->next.key != 0 || log->next_tick > log->ticks);
+	}
+	else {
+		/* events are recorded as they come */
+		input->log = (log->file != NULL) ? log : NULL;
+		poll_input(input);
+		input->log = NULL;
+	}
 
-			if (line_intersection(a, c, b, d, &d)) {
-				fill_bottom_flat_triangle(fb, a, b, d, color);
-				fill_top_flat_triangle(fb, b, d, c, color);
-			}
+	log->ticks++;
+
+	return more;
+}
+
+/* pack color_t struct into screen pixel format */
+ulong_t color_to_long(framebuffer_t* fb, const color_t color)
+{
+	ulong_t result = 0;
+
+	if (fb != NULL) {
+#ifdef __WINDOWS__
+		result = RGB(color.red, color.green, color.blue);
+#else
+		const ubyte_t channels[4] = { color.red, color.green, color.blue, color.alpha };
+
+		/* keep most significant bits of each channel */
+		for (size_t i = 0; i < 4; i++) {
+			ulong_t channel = (fb->format.length[i] <= 8) ? (ulong_t)(channels[i] >> (8 - fb->format.length[i])) : (ulong_t)channels[i] << (fb->format.length[i] - 8);
+
+			result |= channel << fb->format.shift[i];
 		}
 #endif
 	}
+
+	return result;
 }
 
-/* clear screen */
-void clear_screen(framebuffer_t* fb)
+
+/* write decorated format string to stream */
+void fprintfdec(FILE* stream, const print_style_t style, const char* format, ...)
 {
-	if (fb != NULL) {
+	va_list args;
+	va_start(args, format);
+
+	if (stream != NULL) {
+		/* alloc string to do formatting */
+		char* str = malloc(BUFSIZ);
+
+		if (str != NULL) {
 #ifdef __WINDOWS__
-		RECT screen = { 0, 0, fb->resolution.x, fb->resolution.y };
-		HBRUSH brush = CreateSolidBrush(RGB(0, 0, 0));
+			/* NOTE: old windows versions don't support colored output so don't show it */
+			int size = vsprintf(str, format, args);
 
-		FillRect(fb->device, &screen, brush);
-		DeleteObject(brush);
+			DWORD written;
+			WriteConsoleA(GetStdHandle(STD_OUTPUT_HANDLE), str, size, &written, NULL);
 #else
-		memset(fb->address, 0x0, fb->size);
+			/* add string styles */
+			sprintf(str, "\e[38;2;%d;%d;%dm\e[48;2;%d;%d;%dm\e[%dm", 
+				style.foreground.red, style.foreground.green, style.foreground.blue, 
+				style.background.red, style.background.green, style.background.blue,
+				style.decoration);
+
+			strcat(str, format);
+			strcat(str, "\e[0m");
+
+			/* final string */
+			vfprintf(stream, str, args);
 #endif
+
+			free(str);
+		}
 	}
+
+	va_end(args);
 }
 
 #ifndef __WINDOWS__
-/* get primary display output name */
-bool get_active_display_name(char* name, const size_t name_sz)
+/* get region covering whole screen */
+static region_t get_screen_region(const framebuffer_t* fb)
 {
-	bool success = false;
+	region_t screen = { { 0, 0 }, { fb->var_info.xres, fb->var_info.yres } };
 
-	/* get primary display name and output to tmp file */
-	system("xrandr | grep \" connected primary\" | awk '{ print $1 }' >/tmp/harvest_config");
+	return screen;
+}
 
-	char line[name_sz];
-	FILE* file = fopen("/tmp/harvest_config", "r");
+/* get number of pixels of @region */
+static int64_t get_region_area(const region_t region)
+{
+	return (int64_t)(region.end.x - region.start.x) * (region.end.y - region.start.y);
+}
 
-	if (file != NULL) {
-		/* get file stored string */
-		if ((fgets(line, name_sz, file)) != NULL) {
-			for (int i = 0; i < name_sz; i++) {
-				if (line[i] != '\n')
-					name[i] = line[i];
-				else {
-					name[i] = '\0';
-					break;
-				}
+/* get smallest region holding both @a and @b */
+static region_t merge_regions(const region_t a, const region_t b)
+{
+	region_t result = { { MIN(a.start.x, b.start.x), MIN(a.start.y, b.start.y) }, { MAX(a.end.x, b.end.x), MAX(a.end.y, b.end.y) } };
+
+	return result;
+}
+
+/* add @region to @list, merging regions that overlap or waste little area when joined (all of @screen once mostly covered) */
+static void add_region(region_list_t* list, region_t region, const region_t screen)
+{
+	bool merged = true;
+	int64_t area = 0;
+
+	/* nothing to add once whole screen is listed */
+	if (list->count == 1 && get_region_area(list->regions[0]) == get_region_area(screen))
+		return;
+
+	/* joined region may now overlap others */
+	while (merged) {
+		merged = false;
+
+		for (size_t i = 0; i < list->count; i++) {
+			region_t joined = merge_regions(list->regions[i], region);
+
+			if (get_region_area(joined) <= get_region_area(list->regions[i]) + get_region_area(region) + REGION_SLACK) {
+				region = joined;
+				list->regions[i] = list->regions[--list->count];
+				merged = true;
+				break;
 			}
+		}
+	}
 
-			success = true;
+	/* list is full, join with region that grows least */
+	if (list->count == MAX_REGIONS) {
+		size_t best = 0;
+		int64_t best_growth = INT64_MAX;
+
+		for (size_t i = 0; i < list->count; i++) {
+			int64_t growth = get_region_area(merge_regions(list->regions[i], region)) - get_region_area(list->regions[i]);
+
+			if (growth < best_growth) {
+				best = i;
+				best_growth = growth;
+			}
 		}
 
-		/* clean up */
-		fclose(file);
+		region = merge_regions(list->regions[best], region);
+		list->regions[best] = list->regions[--list->count];
+
+		add_region(list, region, screen);
 	}
+	else
+		list->regions[list->count++] = region;
 
-	/* remove temporary file */
-	remove("/tmp/harvest_config");
+	/* regions cover most of screen, handle it whole */
+	for (size_t i = 0; i < list->count; i++)
+		area += get_region_area(list->regions[i]);
 
-	return success;
+	if (area * 4 >= get_region_area(screen) * 3) {
+		list->regions[0] = screen;
+		list->count = 1;
+	}
 }
-#endif
 
-/* calculate box position and size due to scaling */
-rect_t get_scaled_box(framebuffer_t* fb, const long_t left, const long_t top, const long_t bottom, const long_t right, const color_t color)
+/* record area from @start to @end (inclusive) as drawn this frame */
+static void mark_dirty(framebuffer_t* fb, const vertice_t start, const vertice_t end)
 {
-	rect_t rect = { { left, top }, { right, bottom }, color };
+	/* clip to screen */
+	region_t region = {
+		{ MAX(MIN(start.x, end.x), 0), MAX(MIN(start.y, end.y), 0) },
+		{ MIN(MAX(start.x, end.x) + 1, (long_t)fb->var_info.xres), MIN(MAX(start.y, end.y) + 1, (long_t)fb->var_info.yres) }
+	};
+
+	if (region.start.x < region.end.x && region.start.y < region.end.y)
+		add_region(&fb->dirty[0], region, get_screen_region(fb));
+}
+
+/* mark whole screen as changed in every tracked frame */
+void invalidate_screen(framebuffer_t* fb)
+{
+	if (fb != NULL) {
+		region_t screen = get_screen_region(fb);
+
+		for (size_t i = 0; i < DIRTY_FRAMES; i++) {
+			fb->dirty[i].regions[0] = screen;
+			fb->dirty[i].count = 1;
+		}
+	}
+}
+#endif
 
+/* put pixel into screen */
+void put_pixel(framebuffer_t* fb, const vertice_t position, const color_t color)
+{
 	if (fb != NULL) {
 #ifdef __WINDOWS__
-		rect.start.y *= fb->resolution.y / BASE_RESOLUTION_HEIGHT;
-		rect.start.x *= fb->resolution.x / BASE_RESOLUTION_HEIGHT;
-		rect.end.y *= rect.start.y / top;
-		rect.end.x *= (rect.start.x / left) / ((fb->resolution.x / fb->resolution.y) / BASE_ASPECT_RATIO);
+		SetPixel(fb->device, position.x, position.y, RGB(color.red, color.green, color.blue));
 #else
-		rect.start.y *= fb->var_info.yres / BASE_RESOLUTION_HEIGHT;
-		rect.start.x *= fb->var_info.xres / BASE_RESOLUTION_HEIGHT;
-		rect.end.y *= rect.start.y / top;
-		rect.end.x *= (rect.start.x / left) / ((fb->var_info.xres / fb->var_info.yres) / BASE_ASPECT_RATIO);
+		if (position.x >= 0 && position.y >= 0 && position.x < (long_t)fb->var_info.xres && position.y < (long_t)fb->var_info.yres) {
+			fb->writer->put(fb->buffer + (position.y * fb->fix_info.line_length) + (position.x * fb->format.size), (uint32_t)color_to_long(fb, color));
+			mark_dirty(fb, position, position);
+		}
 #endif
 	}
+}
 
-	return rect;
+#ifndef __WINDOWS__
+/* divide rounding towards negative infinity (@divisor is positive) */
+static int64_t floor_div(const int64_t dividend, const int64_t divisor)
+{
+	return (dividend >= 0) ? dividend / divisor : -((-dividend + divisor - 1) / divisor);
 }
 
-/* terminate screen frame buffer for full screen */
-void terminate_screen_framebuffer(framebuffer_t* fb)
+/* clip steps @first to @last so that fixed point @base + step * @slope stays within 0 and @limit pixels (Liang-Barsky on the minor axis) */
+static void clip_line_steps(const int64_t base, const int64_t slope, const int64_t limit, int64_t* first, int64_t* last)
 {
-	if (fb != NULL) {
-#ifdef __WINDOWS__
-		if (fb->window != NULL) {
-			SetWindowLongPtr(fb->window, GWL_STYLE, WS_OVERLAPPEDWINDOW);
-			SetWindowLongPtr(fb->window, GWL_EXSTYLE, WS_EX_OVERLAPPEDWINDOW);
-			ShowWindow(fb->window, SW_SHOWDEFAULT);
-			MoveWindow(fb->window, 0, 0, 480, 360, true);
+	int64_t high = (limit + 1) * 65536;
 
-			if (fb->device != NULL) {
-				ReleaseDC(fb->window, fb->device);
-				DeleteDC(fb->device);
-			}
-		}
-#else
-		if (fb->fd)
-			fb->orig_var_info.activate |= FB_ACTIVATE_NOW | FB_ACTIVATE_FORCE;
-			ioctl(fb->fd, FBIOPUT_VSCREENINFO, &fb->orig_var_info);
-			close(fb->fd);
-		if (fb->address != NULL) {
-			munmap(fb->address, fb->size);
-			fb->address = NULL;
+	if (slope > 0) {
+		int64_t lowest = -floor_div(base, slope);
+		int64_t highest = -floor_div(base - high, slope) - 1;
+
+		*first = (lowest > *first) ? lowest : *first;
+		*last = (highest < *last) ? highest : *last;
+	}
+	else if (slope < 0) {
+		int64_t lowest = floor_div(base - high, -slope) + 1;
+		int64_t highest = floor_div(base, -slope);
+
+		*first = (lowest > *first) ? lowest : *first;
+		*last = (highest < *last) ? highest : *last;
+	}
+	else if (base < 0 || base >= high)
+		*last = *first - 1;
+}
+
+/* rasterize line with packed @value, clipped up front to @clip so pixels are written without checks */
+static void rasterize_line(framebuffer_t* fb, vertice_t start, vertice_t end, const uint32_t value, const region_t clip)
+{
+	size_t pitch = fb->fix_info.line_length;
+	size_t size = fb->format.size;
+
+	if (fb->buffer == NULL)
+		return;
+
+	/* horizontal span */
+	if (start.y == end.y) {
+		if (start.x > end.x)
+			swap(&start.x, &end.x);
+
+		int64_t first = (start.x < clip.start.x) ? clip.start.x : start.x;
+		int64_t last = (end.x >= clip.end.x) ? clip.end.x - 1 : end.x;
+
+		if (start.y >= clip.start.y && start.y < clip.end.y && first <= last)
+			fb->writer->fill(fb->buffer + (start.y * pitch) + (first * size), last - first + 1, value);
+
+		return;
+	}
+
+	/* vertical span */
+	if (start.x == end.x) {
+		if (start.y > end.y)
+			swap(&start.y, &end.y);
+
+		int64_t first = (start.y < clip.start.y) ? clip.start.y : start.y;
+		int64_t last = (end.y >= clip.end.y) ? clip.end.y - 1 : end.y;
+
+		if (start.x >= clip.start.x && start.x < clip.end.x) {
+			ubyte_t* address = fb->buffer + (first * pitch) + (start.x * size);
+
+			for (int64_t y = first; y <= last; y++, address += pitch)
+				fb->writer->put(address, value);
 		}
 
-		/* get current output display */
-		char display[MAX_DISPLAY_NAME];
+		return;
+	}
+
+	/* step one pixel along the longest axis, minor axis is kept in 16.16 fixed point */
+	long_t delta_x = end.x - start.x;
+	long_t delta_y = end.y - start.y;
+	bool x_major = (ABS(delta_x) >= ABS(delta_y));
 
-		if (get_active_display_name(display, MAX_DISPLAY_NAME)) {
-			char cmd[BUFSIZ];
+	if ((x_major && start.x > end.x) || (!x_major && start.y > end.y)) {
+		vertice_t swapped = start;
+		start = end;
+		end = swapped;
+	}
 
-			/* refresh display output */
-			sprintf(cmd, "xrandr --output %s --off && xrandr --output %s --auto", display, display);
-			system(cmd);
+	int64_t major = (x_major) ? start.x : start.y;
+	int64_t minor = (x_major) ? start.y : start.x;
+	int64_t steps = (x_major) ? end.x - start.x : end.y - start.y;
+	int64_t delta = (x_major) ? end.y - start.y : end.x - start.x;
+	int64_t major_low = (x_major) ? clip.start.x : clip.start.y;
+	int64_t major_high = ((x_major) ? clip.end.x : clip.end.y) - 1;
+	int64_t minor_low = (x_major) ? clip.start.y : clip.start.x;
+	int64_t minor_high = ((x_major) ? clip.end.y : clip.end.x) - 1;
+	int64_t slope = floor_div((delta * 65536) + (steps / 2), steps);
+	int64_t base = ((minor - minor_low) * 65536) + (1 << 15);
+	int64_t first = (major < major_low) ? major_low - major : 0;
+	int64_t last = (major + steps > major_high) ? major_high - major : steps;
+
+	/* minor axis is relative to clip start, pixels stay the same for any clip */
+	clip_line_steps(base, slope, minor_high - minor_low, &first, &last);
+
+	if (first > last)
+		return;
+
+	/* walk clipped steps through row pointer */
+	int64_t position = base + (first * slope);
+	int64_t previous = position >> 16;
+	ubyte_t* address = fb->buffer + (((x_major) ? minor_low + previous : major + first) * pitch) + (((x_major) ? major + first : minor_low + previous) * size);
+
+	if (x_major) {
+		for (int64_t i = first; i <= last; i++, address += size) {
+			int64_t current = position >> 16;
+
+			address += (current - previous) * (int64_t)pitch;
+			previous = current;
+			position += slope;
+
+			fb->writer->put(address, value);
+		}
+	}
+	else {
+		for (int64_t i = first; i <= last; i++, address += pitch) {
+			int64_t current = position >> 16;
+
+			address += (current - previous) * (int64_t)size;
+			previous = current;
+			position += slope;
+
+			fb->writer->put(address, value);
 		}
-#endif
 	}
 }
+#endif
 
-/* initialize screen frame buffer for full screen */
-bool init_screen_framebuffer(framebuffer_t* fb)
+/* draw a line into screen */
+void draw_line(framebuffer_t* fb, vertice_t start, vertice_t end, const color_t color)
 {
-	bool success = false;
-
 	if (fb != NULL) {
 #ifdef __WINDOWS__
-		/* get window and device */
-		if ((fb->window = GetConsoleWindow()) != NULL) {
-			/* modify styles */
-			fb->win_style = GetWindowLongPtr(fb->window, GWL_STYLE);
-			fb->win_style &= ~WS_BORDER;
-			fb->win_style &= ~WS_DLGFRAME;
-			fb->win_style &= ~WS_THICKFRAME;
+		HGDIOBJ original = SelectObject(fb->device, GetStockObject(DC_PEN));
 
-			fb->win_ext_style = GetWindowLongPtr(fb->window, GWL_EXSTYLE);
-			fb->win_ext_style &= ~WS_EX_WINDOWEDGE;
+		if (original != NULL) {
+			/* switch pen */
+			SelectObject(fb->device, GetStockObject(DC_PEN));
+			SetDCPenColor(fb->device, RGB(color.red, color.green, color.blue));
 
-			/* set new styles */
-			SetWindowLongPtr(fb->window, GWL_STYLE, fb->win_style | WS_POPUP);
+			/* draw line */
+			MoveToEx(fb->device, start.x, start.y, NULL);
+			LineTo(fb->device, end.x, end.y);
+
+			SelectObject(fb->device, original);
+		}
+#else
+		rasterize_line(fb, start, end, (uint32_t)color_to_long(fb, color), get_screen_region(fb));
+		mark_dirty(fb, start, end);
+#endif
+	}
+}
+
+#ifndef __WINDOWS__
+/* fill @count 32-bit pixels starting at @row */
+static void fill_span_32(ubyte_t* row, size_t count, const uint32_t value)
+{
+	uint32_t* pixel = (uint32_t*)row;
+
+#ifdef __SSE2_ARCH__
+	/* align to 16 bytes then store four pixels at once */
+	for (; count > 0 && (ulong_t)pixel % 16 != 0; count--)
+		*pixel++ = value;
+
+	__m128i wide = _mm_set1_epi32((int)value);
+
+	for (; count >= 16; count -= 16, pixel += 16) {
+		_mm_store_si128((__m128i*)pixel, wide);
+		_mm_store_si128((__m128i*)(pixel + 4), wide);
+		_mm_store_si128((__m128i*)(pixel + 8), wide);
+		_mm_store_si128((__m128i*)(pixel + 12), wide);
+	}
+
+	for (; count >= 4; count -= 4, pixel += 4)
+		_mm_store_si128((__m128i*)pixel, wide);
+#endif
+
+	for (; count > 0; count--)
+		*pixel++ = value;
+}
+
+/* fill @count 24-bit pixels starting at @row */
+static void fill_span_24(ubyte_t* row, size_t count, const uint32_t value)
+{
+	ubyte_t pixel[3] = { value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF };
+
+#ifdef __SSE2_ARCH__
+	/* three registers hold sixteen pixels (only worth building for long spans) */
+	if (count >= 16) {
+		ubyte_t pattern[48];
+
+		for (size_t i = 0; i < sizeof(pattern); i++)
+			pattern[i] = pixel[i % 3];
+
+		__m128i a = _mm_loadu_si128((const __m128i*)pattern);
+		__m128i b = _mm_loadu_si128((const __m128i*)(pattern + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*)(pattern + 32));
+
+		for (; count >= 16; count -= 16, row += 48) {
+			_mm_storeu_si128((__m128i*)row, a);
+			_mm_storeu_si128((__m128i*)(row + 16), b);
+			_mm_storeu_si128((__m128i*)(row + 32), c);
+		}
+	}
+#endif
+
+	for (; count > 0; count--, row += 3) {
+		row[0] = pixel[0];
+		row[1] = pixel[1];
+		row[2] = pixel[2];
+	}
+}
+
+/* fill @count 16-bit pixels starting at @row */
+static void fill_span_16(ubyte_t* row, size_t count, const uint32_t value)
+{
+	uint16_t* pixel = (uint16_t*)row;
+
+#ifdef __SSE2_ARCH__
+	/* align to 16 bytes then store eight pixels at once */
+	for (; count > 0 && (ulong_t)pixel % 16 != 0; count--)
+		*pixel++ = (uint16_t)value;
+
+	__m128i wide = _mm_set1_epi16((short)value);
+
+	for (; count >= 32; count -= 32, pixel += 32) {
+		_mm_store_si128((__m128i*)pixel, wide);
+		_mm_store_si128((__m128i*)(pixel + 8), wide);
+		_mm_store_si128((__m128i*)(pixel + 16), wide);
+		_mm_store_si128((__m128i*)(pixel + 24), wide);
+	}
+
+	for (; count >= 8; count -= 8, pixel += 8)
+		_mm_store_si128((__m128i*)pixel, wide);
+#endif
+
+	for (; count > 0; count--)
+		*pixel++ = (uint16_t)value;
+}
+
+/* fill @count 8-bit pixels starting at @row */
+static void fill_span_8(ubyte_t* row, size_t count, const uint32_t value)
+{
+	memset(row, value & 0xFF, count);
+}
+
+/* write one pixel of each size */
+static void put_pixel_8(ubyte_t* address, const uint32_t value)
+{
+	*address = (ubyte_t)value;
+}
+
+static void put_pixel_16(ubyte_t* address, const uint32_t value)
+{
+	*(uint16_t*)address = (uint16_t)value;
+}
+
+static void put_pixel_24(ubyte_t* address, const uint32_t value)
+{
+	address[0] = value & 0xFF;
+	address[1] = (value >> 8) & 0xFF;
+	address[2] = (value >> 16) & 0xFF;
+}
+
+static void put_pixel_32(ubyte_t* address, const uint32_t value)
+{
+	*(uint32_t*)address = value;
+}
+
+/* writers by bytes per pixel, packed values already match the layout */
+static const pixel_writer_t pixel_writers[] = {
+	{ NULL, NULL },
+	{ &put_pixel_8, &fill_span_8 },
+	{ &put_pixel_16, &fill_span_16 },
+	{ &put_pixel_24, &fill_span_24 },
+	{ &put_pixel_32, &fill_span_32 }
+};
+
+/* common layouts (byte order is little endian) */
+static const pixel_format_t known_formats[] = {
+	{ "XRGB8888", 4, { 16, 8, 0, 0 }, { 8, 8, 8, 0 } },
+	{ "ARGB8888", 4, { 16, 8, 0, 24 }, { 8, 8, 8, 8 } },
+	{ "XBGR8888", 4, { 0, 8, 16, 0 }, { 8, 8, 8, 0 } },
+	{ "ABGR8888", 4, { 0, 8, 16, 24 }, { 8, 8, 8, 8 } },
+	{ "RGB888", 3, { 16, 8, 0, 0 }, { 8, 8, 8, 0 } },
+	{ "BGR888", 3, { 0, 8, 16, 0 }, { 8, 8, 8, 0 } },
+	{ "RGB565", 2, { 11, 5, 0, 0 }, { 5, 6, 5, 0 } },
+	{ "BGR565", 2, { 0, 5, 11, 0 }, { 5, 6, 5, 0 } },
+	{ "XRGB1555", 2, { 10, 5, 0, 0 }, { 5, 5, 5, 0 } }
+};
+
+/* find pixel layout from screen bitfields */
+static bool find_pixel_format(const struct fb_var_screeninfo* info, pixel_format_t* format)
+{
+	const struct fb_bitfield* fields[4] = { &info->red, &info->green, &info->blue, &info->transp };
+
+	format->name = "custom";
+	format->size = (ubyte_t)((info->bits_per_pixel + 7) / 8);
+
+	for (size_t i = 0; i < 4; i++) {
+		format->shift[i] = (ubyte_t)fields[i]->offset;
+		format->length[i] = (ubyte_t)fields[i]->length;
+	}
+
+	/* name it if known */
+	for (size_t i = 0; i < sizeof(known_formats) / sizeof(pixel_format_t); i++) {
+		if (known_formats[i].size == format->size && !memcmp(known_formats[i].shift, format->shift, 4) && !memcmp(known_formats[i].length, format->length, 4))
+			format->name = known_formats[i].name;
+	}
+
+	return (format->size > 0 && format->size < sizeof(pixel_writers) / sizeof(pixel_writer_t));
+}
+
+/* set screen bitfields of a known layout named @name */
+static bool set_pixel_format(struct fb_var_screeninfo* info, const char* name)
+{
+	for (size_t i = 0; i < sizeof(known_formats) / sizeof(pixel_format_t); i++) {
+		if (!strcmp(known_formats[i].name, name)) {
+			struct fb_bitfield* fields[4] = { &info->red, &info->green, &info->blue, &info->transp };
+
+			info->bits_per_pixel = known_formats[i].size * 8;
+
+			for (size_t j = 0; j < 4; j++) {
+				fields[j]->offset = known_formats[i].shift[j];
+				fields[j]->length = known_formats[i].length[j];
+				fields[j]->msb_right = 0;
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* fill rectangle from @start to @end (exclusive) with packed @value, clipped to @clip */
+static void fill_rect(framebuffer_t* fb, vertice_t start, vertice_t end, const uint32_t value, const region_t clip)
+{
+	/* clip once for the whole rectangle */
+	start.x = (start.x < clip.start.x) ? clip.start.x : start.x;
+	start.y = (start.y < clip.start.y) ? clip.start.y : start.y;
+	end.x = (end.x > clip.end.x) ? clip.end.x : end.x;
+	end.y = (end.y > clip.end.y) ? clip.end.y : end.y;
+
+	if (fb->buffer != NULL && start.x < end.x && start.y < end.y) {
+		ubyte_t* row = fb->buffer + (start.y * fb->fix_info.line_length) + (start.x * fb->format.size);
+
+		for (long_t y = start.y; y < end.y; y++, row += fb->fix_info.line_length)
+			fb->writer->fill(row, end.x - start.x, value);
+	}
+}
+#endif
+
+/* draw rectangle into screen */
+void draw_rect(framebuffer_t* fb, vertice_t start, vertice_t end, const color_t color)
+{
+	if (fb != NULL) {
+		/* check if vertices are swapped */
+		if (start.x > end.x)
+			swap(&start.x, &end.x);
+		if (start.y > end.y)
+			swap(&start.y, &end.y);
+
+#ifdef __WINDOWS__
+		RECT screen = { start.x, start.y, end.x, end.y };
+		HBRUSH brush = CreateSolidBrush(RGB(color.red, color.green, color.blue));
+
+		FillRect(fb->device, &screen, brush);
+		DeleteObject(brush);
+#else
+		fill_rect(fb, start, end, (uint32_t)color_to_long(fb, color), get_screen_region(fb));
+
+		/* rectangle end is exclusive */
+		if (start.x < end.x && start.y < end.y)
+			mark_dirty(fb, start, (vertice_t){ end.x - 1, end.y - 1 });
+#endif
+	}
+}
+
+/* NOTE: only used for drawing triangles on Linux */
+#ifndef __WINDOWS__
+/* set up edge from @a to @b, sampled at pixel centers in fixed point */
+static edge_t setup_edge(const vertice_t a, const vertice_t b, const long_t left, const long_t top)
+{
+	edge_t edge;
+	int64_t ax = (int64_t)a.x * (1 << SUBPIXEL_BITS);
+	int64_t ay = (int64_t)a.y * (1 << SUBPIXEL_BITS);
+	int64_t bx = (int64_t)b.x * (1 << SUBPIXEL_BITS);
+	int64_t by = (int64_t)b.y * (1 << SUBPIXEL_BITS);
+	int64_t px = ((int64_t)left * (1 << SUBPIXEL_BITS)) + (1 << (SUBPIXEL_BITS - 1));
+	int64_t py = ((int64_t)top * (1 << SUBPIXEL_BITS)) + (1 << (SUBPIXEL_BITS - 1));
+
+	/* value changes per pixel */
+	edge.step_x = (int32_t)((ay - by) * (1 << SUBPIXEL_BITS));
+	edge.step_y = (int32_t)((bx - ax) * (1 << SUBPIXEL_BITS));
+
+	/* top-left rule: pixels exactly on other edges belong to the neighbour triangle */
+	bool top_left = (ay == by && bx > ax) || (by < ay);
+
+	edge.origin = ((bx - ax) * (py - ay)) - ((by - ay) * (px - ax)) - (top_left ? 0 : 1);
+
+	return edge;
+}
+
+/* find which pixels of a tile row are inside all edges (bit per pixel), @offsets holds each edge change along the row */
+static unsigned find_tile_row_mask(const int32_t* row_values, int32_t offsets[3][TILE_SIZE])
+{
+	unsigned outside = 0;
+
+#ifdef __SSE2_ARCH__
+	__m128i low = _mm_setzero_si128();
+	__m128i high = _mm_setzero_si128();
+
+	/* negative value of any edge means outside (sign bits are gathered) */
+	for (size_t i = 0; i < 3; i++) {
+		__m128i value = _mm_set1_epi32(row_values[i]);
+
+		low = _mm_or_si128(low, _mm_add_epi32(value, _mm_loadu_si128((const __m128i*)offsets[i])));
+		high = _mm_or_si128(high, _mm_add_epi32(value, _mm_loadu_si128((const __m128i*)(offsets[i] + 4))));
+	}
+
+	outside = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(low)) | ((unsigned)_mm_movemask_ps(_mm_castsi128_ps(high)) << 4);
+#else
+	for (size_t i = 0; i < 3; i++) {
+		for (size_t j = 0; j < TILE_SIZE; j++) {
+			if (row_values[i] + offsets[i][j] < 0)
+				outside |= 1u << j;
+		}
+	}
+#endif
+
+	return ~outside & ((1u << TILE_SIZE) - 1);
+}
+
+/* fill triangle with packed @value using edge functions over tiles of TILE_SIZE pixels, clipped to @clip (starting on a tile) */
+static void fill_triangle(framebuffer_t* fb, vertice_t a, vertice_t b, vertice_t c, const uint32_t value, const region_t clip)
+{
+	/* only clockwise (on screen) triangles have positive edge values inside */
+	int64_t area = ((int64_t)(b.x - a.x) * (c.y - a.y)) - ((int64_t)(b.y - a.y) * (c.x - a.x));
+
+	if (area == 0 || fb->buffer == NULL)
+		return;
+
+	if (area < 0) {
+		vertice_t d = b;
+		b = c;
+		c = d;
+	}
+
+	/* bounding box clipped and aligned to tiles */
+	long_t left = MAX(MIN(MIN(a.x, b.x), c.x), clip.start.x) & ~(long_t)(TILE_SIZE - 1);
+	long_t top = MAX(MIN(MIN(a.y, b.y), c.y), clip.start.y) & ~(long_t)(TILE_SIZE - 1);
+	long_t right = MIN(MAX(MAX(a.x, b.x), c.x), clip.end.x - 1);
+	long_t bottom = MIN(MAX(MAX(a.y, b.y), c.y), clip.end.y - 1);
+
+	if (left > right || top > bottom)
+		return;
+
+	edge_t edges[3] = { setup_edge(a, b, left, top), setup_edge(b, c, left, top), setup_edge(c, a, left, top) };
+
+	for (long_t tile_y = top; tile_y <= bottom; tile_y += TILE_SIZE) {
+		long_t rows = (bottom - tile_y + 1 < TILE_SIZE) ? bottom - tile_y + 1 : TILE_SIZE;
+
+		for (long_t tile_x = left; tile_x <= right; tile_x += TILE_SIZE) {
+			long_t columns = (right - tile_x + 1 < TILE_SIZE) ? right - tile_x + 1 : TILE_SIZE;
+			int32_t row_values[3];
+			int32_t row_steps[3];
+			int32_t offsets[3][TILE_SIZE];
+			bool rejected = false;
+			bool accepted = true;
+
+			/* classify tile against each edge from its extreme corners */
+			for (size_t i = 0; i < 3 && !rejected; i++) {
+				int64_t corner = edges[i].origin + ((int64_t)(tile_x - left) * edges[i].step_x) + ((int64_t)(tile_y - top) * edges[i].step_y);
+				int64_t span_x = (int64_t)(TILE_SIZE - 1) * edges[i].step_x;
+				int64_t span_y = (int64_t)(TILE_SIZE - 1) * edges[i].step_y;
+				int64_t lowest = corner + ((span_x < 0) ? span_x : 0) + ((span_y < 0) ? span_y : 0);
+				int64_t highest = corner + ((span_x > 0) ? span_x : 0) + ((span_y > 0) ? span_y : 0);
+
+				if (highest < 0)
+					rejected = true;
+				else if (lowest >= 0) {
+					/* edge doesn't cross tile, skip its test */
+					row_values[i] = 0;
+					row_steps[i] = 0;
+					memset(offsets[i], 0, sizeof(offsets[i]));
+				}
+				else {
+					/* values near the edge always fit 32 bits */
+					row_values[i] = (int32_t)corner;
+					row_steps[i] = edges[i].step_y;
+					accepted = false;
+
+					for (size_t j = 0; j < TILE_SIZE; j++)
+						offsets[i][j] = (int32_t)j * edges[i].step_x;
+				}
+			}
+
+			if (rejected)
+				continue;
+
+			ubyte_t* row = fb->buffer + (tile_y * fb->fix_info.line_length) + (tile_x * fb->format.size);
+
+			for (long_t y = 0; y < rows; y++, row += fb->fix_info.line_length) {
+				if (accepted)
+					fb->writer->fill(row, columns, value);
+				else {
+					unsigned mask = find_tile_row_mask(row_values, offsets) & ((1u << columns) - 1);
+
+					/* write runs of covered pixels */
+					for (long_t x = 0; mask != 0;) {
+						long_t length = 0;
+
+						for (; mask & 1; mask >>= 1)
+							length++;
+
+						if (length > 0) {
+							fb->writer->fill(row + (x * fb->format.size), length, value);
+							x += length;
+						}
+						else {
+							x++;
+							mask >>= 1;
+						}
+					}
+
+					for (size_t i = 0; i < 3; i++)
+						row_values[i] += row_steps[i];
+				}
+			}
+		}
+	}
+}
+#endif
+
+/* draw triangle into screen */
+void draw_triangle(framebuffer_t* fb, vertice_t a, vertice_t b, vertice_t c, const color_t color)
+{
+	if (fb != NULL) {
+#ifdef __WINDOWS__
+		HGDIOBJ original = SelectObject(fb->device, GetStockObject(DC_PEN));
+
+		if (original != NULL) {
+			/* switch pen */
+			SelectObject(fb->device, GetStockObject(DC_PEN));
+			SetDCPenColor(fb->device, RGB(color.red, color.green, color.blue));
+
+			/* convert vertices to points */
+			POINT points[3] = { { a.x, a.y }, { b.x, b.y }, { c.x, c.y} };
+
+			/* draw triangle */
+			Polygon(fb->device, points, 3);
+
+			SelectObject(fb->device, original);
+		}
+#else
+		/* NOTE: triangles reaching outside guard band are not drawn (edge values must fit 32 bits near edges) */
+		if (ABS(a.x) < GUARD_BAND && ABS(a.y) < GUARD_BAND && ABS(b.x) < GUARD_BAND && ABS(b.y) < GUARD_BAND && ABS(c.x) < GUARD_BAND && ABS(c.y) < GUARD_BAND) {
+			fill_triangle(fb, a, b, c, (uint32_t)color_to_long(fb, color), get_screen_region(fb));
+
+			/* bounding box of vertices */
+			mark_dirty(fb, (vertice_t){ MIN(MIN(a.x, b.x), c.x), MIN(MIN(a.y, b.y), c.y) }, (vertice_t){ MAX(MAX(a.x, b.x), c.x), MAX(MAX(a.y, b.y), c.y) });
+		}
+#endif
+	}
+}
+
+/* built in font, printable ASCII characters in 8x8 cells */
+static const ubyte_t builtin_font[] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* ' ' */
+	0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x10, 0x00, /* '!' */
+	0x28, 0x28, 0x28, 0x00, 0x00, 0x00, 0x00, 0x00, /* '"' */
+	0x28, 0x28, 0x7C, 0x28, 0x7C, 0x28, 0x28, 0x00, /* '#' */
+	0x10, 0x3C, 0x50, 0x38, 0x14, 0x78, 0x10, 0x00, /* '$' */
+	0x60, 0x64, 0x08, 0x10, 0x20, 0x4C, 0x0C, 0x00, /* '%' */
+	0x30, 0x48, 0x50, 0x20, 0x54, 0x48, 0x34, 0x00, /* '&' */
+	0x30, 0x10, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, /* '\'' */
+	0x08, 0x10, 0x20, 0x20, 0x20, 0x10, 0x08, 0x00, /* '(' */
+	0x20, 0x10, 0x08, 0x08, 0x08, 0x10, 0x20, 0x00, /* ')' */
+	0x00, 0x10, 0x54, 0x38, 0x54, 0x10, 0x00, 0x00, /* '*' */
+	0x00, 0x10, 0x10, 0x7C, 0x10, 0x10, 0x00, 0x00, /* '+' */
+	0x00, 0x00, 0x00, 0x00, 0x30, 0x10, 0x20, 0x00, /* ',' */
+	0x00, 0x00, 0x00, 0x7C, 0x00, 0x00, 0x00, 0x00, /* '-' */
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x30, 0x00, /* '.' */
+	0x00, 0x04, 0x08, 0x10, 0x20, 0x40, 0x00, 0x00, /* '/' */
+	0x38, 0x44, 0x4C, 0x54, 0x64, 0x44, 0x38, 0x00, /* '0' */
+	0x10, 0x30, 0x10, 0x10, 0x10, 0x10, 0x38, 0x00, /* '1' */
+	0x38, 0x44, 0x04, 0x08, 0x10, 0x20, 0x7C, 0x00, /* '2' */
+	0x7C, 0x08, 0x10, 0x08, 0x04, 0x44, 0x38, 0x00, /* '3' */
+	0x08, 0x18, 0x28, 0x48, 0x7C, 0x08, 0x08, 0x00, /* '4' */
+	0x7C, 0x40, 0x78, 0x04, 0x04, 0x44, 0x38, 0x00, /* '5' */
+	0x18, 0x20, 0x40, 0x78, 0x44, 0x44, 0x38, 0x00, /* '6' */
+	0x7C, 0x04, 0x08, 0x10, 0x20, 0x20, 0x20, 0x00, /* '7' */
+	0x38, 0x44, 0x44, 0x38, 0x44, 0x44, 0x38, 0x00, /* '8' */
+	0x38, 0x44, 0x44, 0x3C, 0x04, 0x08, 0x30, 0x00, /* '9' */
+	0x00, 0x30, 0x30, 0x00, 0x30, 0x30, 0x00, 0x00, /* ':' */
+	0x00, 0x30, 0x30, 0x00, 0x30, 0x10, 0x20, 0x00, /* ';' */
+	0x08, 0x10, 0x20, 0x40, 0x20, 0x10, 0x08, 0x00, /* '<' */
+	0x00, 0x00, 0x7C, 0x00, 0x7C, 0x00, 0x00, 0x00, /* '=' */
+	0x20, 0x10, 0x08, 0x04, 0x08, 0x10, 0x20, 0x00, /* '>' */
+	0x38, 0x44, 0x04, 0x08, 0x10, 0x00, 0x10, 0x00, /* '?' */
+	0x38, 0x44, 0x04, 0x34, 0x54, 0x54, 0x38, 0x00, /* '@' */
+	0x38, 0x44, 0x44, 0x7C, 0x44, 0x44, 0x44, 0x00, /* 'A' */
+	0x78, 0x44, 0x44, 0x78, 0x44, 0x44, 0x78, 0x00, /* 'B' */
+	0x38, 0x44, 0x40, 0x40, 0x40, 0x44, 0x38, 0x00, /* 'C' */
+	0x70, 0x48, 0x44, 0x44, 0x44, 0x48, 0x70, 0x00, /* 'D' */
+	0x7C, 0x40, 0x40, 0x78, 0x40, 0x40, 0x7C, 0x00, /* 'E' */
+	0x7C, 0x40, 0x40, 0x78, 0x40, 0x40, 0x40, 0x00, /* 'F' */
+	0x38, 0x44, 0x40, 0x5C, 0x44, 0x44, 0x3C, 0x00, /* 'G' */
+	0x44, 0x44, 0x44, 0x7C, 0x44, 0x44, 0x44, 0x00, /* 'H' */
+	0x38, 0x10, 0x10, 0x10, 0x10, 0x10, 0x38, 0x00, /* 'I' */
+	0x1C, 0x08, 0x08, 0x08, 0x08, 0x48, 0x30, 0x00, /* 'J' */
+	0x44, 0x48, 0x50, 0x60, 0x50, 0x48, 0x44, 0x00, /* 'K' */
+	0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x7C, 0x00, /* 'L' */
+	0x44, 0x6C, 0x54, 0x54, 0x44, 0x44, 0x44, 0x00, /* 'M' */
+	0x44, 0x44, 0x64, 0x54, 0x4C, 0x44, 0x44, 0x00, /* 'N' */
+	0x38, 0x44, 0x44, 0x44, 0x44, 0x44, 0x38, 0x00, /* 'O' */
+	0x78, 0x44, 0x44, 0x78, 0x40, 0x40, 0x40, 0x00, /* 'P' */
+	0x38, 0x44, 0x44, 0x44, 0x54, 0x48, 0x34, 0x00, /* 'Q' */
+	0x78, 0x44, 0x44, 0x78, 0x50, 0x48, 0x44, 0x00, /* 'R' */
+	0x3C, 0x40, 0x40, 0x38, 0x04, 0x04, 0x78, 0x00, /* 'S' */
+	0x7C, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, /* 'T' */
+	0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x38, 0x00, /* 'U' */
+	0x44, 0x44, 0x44, 0x44, 0x44, 0x28, 0x10, 0x00, /* 'V' */
+	0x44, 0x44, 0x44, 0x54, 0x54, 0x54, 0x28, 0x00, /* 'W' */
+	0x44, 0x44, 0x28, 0x10, 0x28, 0x44, 0x44, 0x00, /* 'X' */
+	0x44, 0x44, 0x44, 0x28, 0x10, 0x10, 0x10, 0x00, /* 'Y' */
+	0x7C, 0x04, 0x08, 0x10, 0x20, 0x40, 0x7C, 0x00, /* 'Z' */
+	0x38, 0x20, 0x20, 0x20, 0x20, 0x20, 0x38, 0x00, /* '[' */
+	0x00, 0x40, 0x20, 0x10, 0x08, 0x04, 0x00, 0x00, /* '\\' */
+	0x38, 0x08, 0x08, 0x08, 0x08, 0x08, 0x38, 0x00, /* ']' */
+	0x10, 0x28, 0x44, 0x00, 0x00, 0x00, 0x00, 0x00, /* '^' */
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7C, 0x00, /* '_' */
+	0x20, 0x10, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, /* '`' */
+	0x00, 0x00, 0x38, 0x04, 0x3C, 0x44, 0x3C, 0x00, /* 'a' */
+	0x40, 0x40, 0x58, 0x64, 0x44, 0x44, 0x78, 0x00, /* 'b' */
+	0x00, 0x00, 0x38, 0x40, 0x40, 0x44, 0x38, 0x00, /* 'c' */
+	0x04, 0x04, 0x34, 0x4C, 0x44, 0x44, 0x3C, 0x00, /* 'd' */
+	0x00, 0x00, 0x38, 0x44, 0x7C, 0x40, 0x38, 0x00, /* 'e' */
+	0x18, 0x24, 0x20, 0x70, 0x20, 0x20, 0x20, 0x00, /* 'f' */
+	0x00, 0x3C, 0x44, 0x44, 0x3C, 0x04, 0x38, 0x00, /* 'g' */
+	0x40, 0x40, 0x58, 0x64, 0x44, 0x44, 0x44, 0x00, /* 'h' */
+	0x10, 0x00, 0x30, 0x10, 0x10, 0x10, 0x38, 0x00, /* 'i' */
+	0x08, 0x00, 0x18, 0x08, 0x08, 0x48, 0x30, 0x00, /* 'j' */
+	0x40, 0x40, 0x48, 0x50, 0x60, 0x50, 0x48, 0x00, /* 'k' */
+	0x30, 0x10, 0x10, 0x10, 0x10, 0x10, 0x38, 0x00, /* 'l' */
+	0x00, 0x00, 0x68, 0x54, 0x54, 0x44, 0x44, 0x00, /* 'm' */
+	0x00, 0x00, 0x58, 0x64, 0x44, 0x44, 0x44, 0x00, /* 'n' */
+	0x00, 0x00, 0x38, 0x44, 0x44, 0x44, 0x38, 0x00, /* 'o' */
+	0x00, 0x00, 0x78, 0x44, 0x78, 0x40, 0x40, 0x00, /* 'p' */
+	0x00, 0x00, 0x34, 0x4C, 0x3C, 0x04, 0x04, 0x00, /* 'q' */
+	0x00, 0x00, 0x58, 0x64, 0x40, 0x40, 0x40, 0x00, /* 'r' */
+	0x00, 0x00, 0x38, 0x40, 0x38, 0x04, 0x78, 0x00, /* 's' */
+	0x20, 0x20, 0x70, 0x20, 0x20, 0x24, 0x18, 0x00, /* 't' */
+	0x00, 0x00, 0x44, 0x44, 0x44, 0x4C, 0x34, 0x00, /* 'u' */
+	0x00, 0x00, 0x44, 0x44, 0x44, 0x28, 0x10, 0x00, /* 'v' */
+	0x00, 0x00, 0x44, 0x44, 0x54, 0x54, 0x28, 0x00, /* 'w' */
+	0x00, 0x00, 0x44, 0x28, 0x10, 0x28, 0x44, 0x00, /* 'x' */
+	0x00, 0x00, 0x44, 0x44, 0x3C, 0x04, 0x38, 0x00, /* 'y' */
+	0x00, 0x00, 0x7C, 0x08, 0x10, 0x20, 0x7C, 0x00, /* 'z' */
+	0x08, 0x10, 0x10, 0x20, 0x10, 0x10, 0x08, 0x00, /* '{' */
+	0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, /* '|' */
+	0x20, 0x10, 0x10, 0x08, 0x10, 0x10, 0x20, 0x00, /* '}' */
+	0x00, 0x00, 0x20, 0x54, 0x08, 0x00, 0x00, 0x00, /* '~' */
+};
+
+/* free font loaded from file */
+void terminate_font(font_t* font)
+{
+	if (font != NULL) {
+		free(font->data);
+		memset(font, 0, sizeof(font_t));
+	}
+}
+
+/* load PSF (version 1 or 2) font from @path, or built in font if NULL */
+bool init_font(font_t* font, const char* path)
+{
+	bool success = false;
+
+	if (font != NULL) {
+		memset(font, 0, sizeof(font_t));
+
+		if (path == NULL) {
+			*font = (font_t){ 8, 8, 1, ' ', sizeof(builtin_font) / 8, builtin_font, NULL };
+			return true;
+		}
+
+		FILE* file = fopen(path, "rb");
+
+		if (file != NULL) {
+			long size = (fseek(file, 0, SEEK_END) == 0) ? ftell(file) : -1;
+
+			if (size > 0 && fseek(file, 0, SEEK_SET) == 0 && (font->data = malloc((size_t)size)) != NULL && fread(font->data, 1, (size_t)size, file) == (size_t)size) {
+				const ubyte_t* data = font->data;
+				size_t header = 0;
+				size_t glyph_size = 0;
+
+				/* NOTE: unicode tables are ignored, glyphs are indexed by character code */
+				if (size >= 4 && data[0] == 0x36 && data[1] == 0x04) {
+					header = 4;
+					glyph_size = data[3];
+					*font = (font_t){ 8, data[3], 1, 0, (data[2] & 0x01) ? 512 : 256, data + header, font->data };
+				}
+				else if (size >= 32 && data[0] == 0x72 && data[1] == 0xB5 && data[2] == 0x4A && data[3] == 0x86) {
+					header = read_le32(data + 8);
+					glyph_size = read_le32(data + 20);
+					*font = (font_t){ read_le32(data + 28), read_le32(data + 24), (read_le32(data + 28) + 7) / 8, 0, read_le32(data + 16), data + header, font->data };
+				}
+
+				/* glyphs must fit file and spans */
+				success = (font->width > 0 && font->width <= UINT16_MAX && font->height > 0 && font->height <= UINT16_MAX && glyph_size == font->row_size * font->height
+					&& header + (font->count * glyph_size) <= (size_t)size);
+			}
+
+			fclose(file);
+		}
+
+		if (!success)
+			terminate_font(font);
+	}
+
+	return success;
+}
+
+/* free glyph cache */
+void terminate_glyph_cache(glyph_cache_t* cache)
+{
+	if (cache != NULL) {
+#ifndef __WINDOWS__
+		free(cache->pixels);
+		free(cache->spans);
+		free(cache->starts);
+#endif
+		memset(cache, 0, sizeof(glyph_cache_t));
+	}
+}
+
+/* expand glyphs of @font into spans of @color pixels packed for screen of @fb */
+bool init_glyph_cache(glyph_cache_t* cache, framebuffer_t* fb, const font_t* font, const color_t color)
+{
+	bool success = false;
+
+	if (cache != NULL && fb != NULL && font != NULL) {
+		memset(cache, 0, sizeof(glyph_cache_t));
+
+		cache->font = font;
+		cache->color = color;
+
+#ifdef __WINDOWS__
+		/* NOTE: windows draws text with GDI, nothing to expand */
+		success = true;
+#else
+		size_t spans = 0;
+
+		/* count spans first (a span starts at each set pixel after a clear one) */
+		for (size_t i = 0; i < font->count * font->height; i++) {
+			const ubyte_t* row = font->bitmap + (i * font->row_size);
+			bool previous = false;
+
+			for (size_t x = 0; x < font->width; x++) {
+				bool set = (row[x / 8] >> (7 - (x % 8))) & 1;
+
+				spans += (set && !previous);
+				previous = set;
+			}
+		}
+
+		cache->pixels = malloc(font->width * fb->format.size);
+		cache->spans = malloc(sizeof(glyph_span_t) * (spans + 1));
+		cache->starts = malloc(sizeof(uint32_t) * (font->count + 1));
+
+		if (cache->pixels != NULL && cache->spans != NULL && cache->starts != NULL) {
+			uint32_t value = (uint32_t)color_to_long(fb, color);
+			size_t count = 0;
+
+			for (size_t x = 0; x < font->width; x++)
+				fb->writer->put(cache->pixels + (x * fb->format.size), value);
+
+			for (size_t glyph = 0; glyph < font->count; glyph++) {
+				cache->starts[glyph] = (uint32_t)count;
+
+				for (size_t y = 0; y < font->height; y++) {
+					const ubyte_t* row = font->bitmap + (((glyph * font->height) + y) * font->row_size);
+
+					for (size_t x = 0; x < font->width; x++) {
+						if ((row[x / 8] >> (7 - (x % 8))) & 1) {
+							if (x == 0 || !((row[(x - 1) / 8] >> (7 - ((x - 1) % 8))) & 1))
+								cache->spans[count++] = (glyph_span_t){ (uint16_t)y, (uint16_t)x, 0 };
+
+							cache->spans[count - 1].length++;
+						}
+					}
+				}
+			}
+
+			cache->starts[font->count] = (uint32_t)count;
+			success = true;
+		}
+#endif
+
+		if (!success)
+			terminate_glyph_cache(cache);
+	}
+
+	return success;
+}
+
+/* draw @text (lines split by '\n') with top left corner at @origin, characters without glyph are left blank */
+void draw_text(framebuffer_t* fb, const glyph_cache_t* cache, const vertice_t origin, const char* text)
+{
+	if (fb == NULL || cache == NULL || cache->font == NULL || text == NULL)
+		return;
+
+	const font_t* font = cache->font;
+
+#ifdef __WINDOWS__
+	/* NOTE: GDI draws text with its own font */
+	SetTextColor(fb->device, RGB(cache->color.red, cache->color.green, cache->color.blue));
+	SetBkMode(fb->device, TRANSPARENT);
+
+	for (long_t y = origin.y; *text != '\0'; y += font->height) {
+		size_t length = strcspn(text, "\n");
+
+		TextOutA(fb->device, origin.x, y, text, (int)length);
+		text += length + (text[length] == '\n');
+	}
+#else
+	region_t clip = get_screen_region(fb);
+	vertice_t cursor = origin;
+	long_t right = origin.x;
+
+	for (; *text != '\0'; text++) {
+		size_t glyph = (ubyte_t)*text - font->first;
+
+		if (*text == '\n') {
+			cursor.x = origin.x;
+			cursor.y += font->height;
+			continue;
+		}
+
+		/* glyph rows are spans of pixels already in screen format */
+		if (glyph < font->count) {
+			for (uint32_t i = cache->starts[glyph]; i < cache->starts[glyph + 1]; i++) {
+				const glyph_span_t* span = &cache->spans[i];
+				long_t y = cursor.y + span->row;
+				long_t start = MAX(cursor.x + span->start, clip.start.x);
+				long_t end = MIN(cursor.x + span->start + span->length, clip.end.x);
+
+				if (y >= clip.start.y && y < clip.end.y && start < end)
+					memcpy(fb->buffer + (y * fb->fix_info.line_length) + (start * fb->format.size), cache->pixels, (end - start) * fb->format.size);
+			}
+		}
+
+		cursor.x += font->width;
+		right = MAX(right, cursor.x);
+	}
+
+	if (right > origin.x)
+		mark_dirty(fb, origin, (vertice_t){ right - 1, cursor.y + font->height - 1 });
+#endif
+}
+
+/* free HUD font and glyphs */
+void terminate_hud(hud_t* hud)
+{
+	if (hud != NULL) {
+		terminate_glyph_cache(&hud->text);
+		terminate_font(&hud->font);
+	}
+}
+
+/* initialize HUD shown unless HARVEST_HUD is 0, with PSF font HARVEST_FONT (built in font by default) */
+bool init_hud(hud_t* hud, framebuffer_t* fb)
+{
+	bool success = false;
+
+	if (hud != NULL) {
+		const char* shown = getenv("HARVEST_HUD");
+		const char* path = getenv("HARVEST_FONT");
+
+		memset(hud, 0, sizeof(hud_t));
+
+		hud->shown = (shown == NULL || strcmp(shown, "0") != 0);
+
+		/* fall back to built in font if file can't be used */
+		success = !hud->shown || ((init_font(&hud->font, path) || init_font(&hud->font, NULL)) && init_glyph_cache(&hud->text, fb, &hud->font, (color_t){ 255, 255, 255, 255 }));
+
+		if (!success)
+			terminate_hud(hud);
+	}
+
+	return success;
+}
+
+/* draw frame rate, frame time graph and @score of frame starting at @now */
+void draw_hud(framebuffer_t* fb, hud_t* hud, const size_t score, const double now)
+{
+	if (fb == NULL || hud == NULL || !hud->shown)
+		return;
+
+	/* time between starts of frames */
+	if (hud->last_frame > 0.0)
+		hud->frame_times[hud->frames++ % HUD_FRAMES] = now - hud->last_frame;
+
+	hud->last_frame = now;
+
+	size_t count = MIN(hud->frames, HUD_FRAMES);
+	double total = 0.0;
+	double worst = 0.0;
+
+	for (size_t i = 0; i < count; i++) {
+		total += hud->frame_times[i];
+		worst = MAX(worst, hud->frame_times[i]);
+	}
+
+	char text[64];
+
+	snprintf(text, sizeof(text), "%3.0f fps %5.2f ms (%5.2f max)\nscore %lu", (total > 0.0) ? count / total : 0.0, (count > 0) ? (total * SECOND_MS) / count : 0.0,
+		worst * SECOND_MS, (unsigned long)score);
+
+	draw_text(fb, &hud->text, (vertice_t){ HUD_MARGIN, HUD_MARGIN }, text);
+
+	/* graph of frame times, oldest on the left, full height is twice the target frame time */
+	long_t top = HUD_MARGIN + (long_t)(hud->text.font->height * 2) + 4;
+	long_t bottom = top + HUD_GRAPH_HEIGHT;
+	double target = 1.0 / FRAME_RATE;
+
+	for (size_t i = 0; i < count; i++) {
+		double time = hud->frame_times[(hud->frames - count + i) % HUD_FRAMES];
+		long_t height = (long_t)(MIN(time / (target * 2.0), 1.0) * HUD_GRAPH_HEIGHT);
+		long_t x = HUD_MARGIN + (long_t)i;
+
+		draw_rect(fb, (vertice_t){ x, bottom - MAX(height, 1) }, (vertice_t){ x + 1, bottom }, (time > target * 1.05) ? (color_t){ 220, 60, 40, 255 } : (color_t){ 60, 200, 80, 255 });
+	}
+
+	/* target frame time */
+	draw_rect(fb, (vertice_t){ HUD_MARGIN, bottom - (HUD_GRAPH_HEIGHT / 2) }, (vertice_t){ HUD_MARGIN + HUD_FRAMES, bottom - (HUD_GRAPH_HEIGHT / 2) + 1 }, (color_t){ 255, 255, 255, 255 });
+}
+
+/* free sprite pixels and spans */
+void terminate_sprite(sprite_t* sprite)
+{
+	if (sprite != NULL) {
+#ifdef __WINDOWS__
+		free(sprite->colors);
+#else
+		free(sprite->pixels);
+		free(sprite->alpha);
+#endif
+		free(sprite->spans);
+		free(sprite->row_starts);
+		memset(sprite, 0, sizeof(sprite_t));
+	}
+}
+
+#ifndef __WINDOWS__
+/* whether @format is 32-bit with 8-bit color channels, leaving most significant byte free for alpha */
+static bool is_blend_format(const pixel_format_t* format)
+{
+	return format->size == 4 && format->length[0] == 8 && format->length[1] == 8 && format->length[2] == 8 && format->shift[0] + format->shift[1] + format->shift[2] == 24
+		&& format->shift[0] % 8 == 0 && format->shift[1] % 8 == 0 && format->shift[2] % 8 == 0 && MAX(MAX(format->shift[0], format->shift[1]), format->shift[2]) == 16;
+}
+
+/* unpack screen pixel @value and widen each channel to 8 bits */
+static color_t long_to_color(const framebuffer_t* fb, const uint32_t value)
+{
+	ubyte_t channels[4] = { 0, 0, 0, 255 };
+
+	for (size_t i = 0; i < 4; i++) {
+		uint32_t max = (1u << fb->format.length[i]) - 1;
+
+		if (fb->format.length[i] > 0)
+			channels[i] = (ubyte_t)((((value >> fb->format.shift[i]) & max) * 255) / max);
+	}
+
+	return (color_t){ channels[0], channels[1], channels[2], channels[3] };
+}
+#endif
+
+/* convert @colors (straight alpha, row by row) to premultiplied sprite of @size for screen of @fb */
+bool init_sprite(sprite_t* sprite, framebuffer_t* fb, const color_t* colors, const vertice_t size)
+{
+	bool success = false;
+
+	if (sprite != NULL && fb != NULL && colors != NULL && size.x > 0 && size.y > 0 && size.x <= UINT16_MAX && size.y <= UINT16_MAX) {
+		size_t count = (size_t)size.x * size.y;
+		size_t spans = 0;
+
+		memset(sprite, 0, sizeof(sprite_t));
+		sprite->size = size;
+
+		/* count spans first (a span starts wherever visibility or opacity changes) */
+		for (size_t i = 0; i < count; i++) {
+			bool first = (i % size.x == 0);
+
+			if (colors[i].alpha > 0 && (first || colors[i - 1].alpha == 0 || (colors[i].alpha == 255) != (colors[i - 1].alpha == 255)))
+				spans++;
+		}
+
+		sprite->spans = malloc(sizeof(sprite_span_t) * (spans + 1));
+		sprite->row_starts = malloc(sizeof(uint32_t) * (size.y + 1));
+#ifdef __WINDOWS__
+		sprite->colors = malloc(sizeof(color_t) * count);
+
+		if (sprite->spans != NULL && sprite->row_starts != NULL && sprite->colors != NULL) {
+#else
+		sprite->pixels = malloc(count * fb->format.size);
+		sprite->alpha = malloc(count);
+
+		if (sprite->spans != NULL && sprite->row_starts != NULL && sprite->pixels != NULL && sprite->alpha != NULL) {
+			bool blend = is_blend_format(&fb->format);
+#endif
+			spans = 0;
+
+			for (size_t i = 0; i < count; i++) {
+				color_t color = colors[i];
+				uint16_t x = (uint16_t)(i % size.x);
+
+				/* premultiply, rounding to nearest */
+				color.red = (ubyte_t)((color.red * color.alpha + 127) / 255);
+				color.green = (ubyte_t)((color.green * color.alpha + 127) / 255);
+				color.blue = (ubyte_t)((color.blue * color.alpha + 127) / 255);
+
+#ifdef __WINDOWS__
+				sprite->colors[i] = color;
+#else
+				uint32_t value = (uint32_t)color_to_long(fb, color);
+
+				/* blending reads alpha next to color channels */
+				if (blend)
+					value |= (uint32_t)color.alpha << 24;
+
+				fb->writer->put(sprite->pixels + (i * fb->format.size), value);
+				sprite->alpha[i] = color.alpha;
+#endif
+
+				if (x == 0)
+					sprite->row_starts[i / size.x] = (uint32_t)spans;
+
+				if (color.alpha > 0) {
+					if (x == 0 || colors[i - 1].alpha == 0 || (color.alpha == 255) != (colors[i - 1].alpha == 255))
+						sprite->spans[spans++] = (sprite_span_t){ (uint16_t)(i / size.x), x, 0, color.alpha == 255 };
+
+					sprite->spans[spans - 1].length++;
+				}
+			}
+
+			sprite->row_starts[size.y] = (uint32_t)spans;
+			success = true;
+		}
+
+		if (!success)
+			terminate_sprite(sprite);
+	}
+
+	return success;
+}
+
+/* read next number of PPM header (skipping comments) */
+static bool read_header_number(FILE* file, size_t* number)
+{
+	int c = fgetc(file);
+
+	while (c == '#' || (c != EOF && strchr(" \t\r\n", c) != NULL)) {
+		if (c == '#') {
+			while (c != EOF && c != '\n')
+				c = fgetc(file);
+		}
+
+		c = fgetc(file);
+	}
+
+	for (*number = 0; c >= '0' && c <= '9'; c = fgetc(file))
+		*number = (*number * 10) + (size_t)(c - '0');
+
+	/* single whitespace ends number */
+	return (c != EOF && strchr(" \t\r\n", c) != NULL);
+}
+
+/* load sprite from 8-bit PPM (opaque) or PAM (RGB or RGB_ALPHA) file at @path */
+bool load_sprite(sprite_t* sprite, framebuffer_t* fb, const char* path)
+{
+	bool success = false;
+	FILE* file = (path != NULL) ? fopen(path, "rb") : NULL;
+
+	if (file != NULL) {
+		char magic[3] = { 0, 0, 0 };
+		size_t width = 0;
+		size_t height = 0;
+		size_t depth = 3;
+		size_t max = 0;
+
+		if (fread(magic, 1, 2, file) == 2 && !strcmp(magic, "P6"))
+			success = read_header_number(file, &width) && read_header_number(file, &height) && read_header_number(file, &max);
+		else if (!strcmp(magic, "P7")) {
+			char line[128];
+
+			/* one field per line until ENDHDR */
+			while (fgets(line, sizeof(line), file) != NULL && strncmp(line, "ENDHDR", 6) != 0) {
+				unsigned long value = 0;
+
+				if (sscanf(line, "WIDTH %lu", &value) == 1)
+					width = value;
+				else if (sscanf(line, "HEIGHT %lu", &value) == 1)
+					height = value;
+				else if (sscanf(line, "DEPTH %lu", &value) == 1)
+					depth = value;
+				else if (sscanf(line, "MAXVAL %lu", &value) == 1)
+					max = value;
+			}
+
+			success = !feof(file);
+		}
+
+		/* NOTE: only 8-bit channels are supported */
+		success = success && width > 0 && height > 0 && width <= UINT16_MAX && height <= UINT16_MAX && (depth == 3 || depth == 4) && max == 255;
+
+		color_t* colors = success ? malloc(sizeof(color_t) * width * height) : NULL;
+		ubyte_t* line = success ? malloc(width * depth) : NULL;
+
+		success = (colors != NULL && line != NULL);
+
+		for (size_t y = 0; y < height && success; y++) {
+			success = (fread(line, depth, width, file) == width);
+
+			for (size_t x = 0; x < width && success; x++) {
+				const ubyte_t* pixel = line + (x * depth);
+
+				colors[(y * width) + x] = (color_t){ pixel[0], pixel[1], pixel[2], (depth == 4) ? pixel[3] : 255 };
+			}
+		}
+
+		success = success && init_sprite(sprite, fb, colors, (vertice_t){ (long_t)width, (long_t)height });
+
+		free(colors);
+		free(line);
+		fclose(file);
+	}
+
+	return success;
+}
+
+#ifndef __WINDOWS__
+/* composite @count premultiplied 32-bit pixels from @source over @destination (alpha in most significant byte) */
+static void blend_span_32(ubyte_t* destination, const ubyte_t* source, size_t count)
+{
+#ifdef __SSE2_ARCH__
+	__m128i zero = _mm_setzero_si128();
+	__m128i bias = _mm_set1_epi16(128);
+	__m128i ones = _mm_set1_epi8((char)0xFF);
+
+	/* four pixels at once, channels widened to 16 bits */
+	for (; count >= 4; count -= 4, destination += 16, source += 16) {
+		__m128i src = _mm_loadu_si128((const __m128i*)source);
+		__m128i dst = _mm_loadu_si128((const __m128i*)destination);
+
+		/* spread alpha over every byte of its pixel, then invert it */
+		__m128i alpha = _mm_srli_epi32(src, 24);
+
+		alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 8));
+		alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+		alpha = _mm_xor_si128(alpha, ones);
+
+		/* destination * (255 - alpha) / 255, rounded */
+		__m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), _mm_unpacklo_epi8(alpha, zero)), bias);
+		__m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), _mm_unpackhi_epi8(alpha, zero)), bias);
+
+		low = _mm_srli_epi16(_mm_add_epi16(low, _mm_srli_epi16(low, 8)), 8);
+		high = _mm_srli_epi16(_mm_add_epi16(high, _mm_srli_epi16(high, 8)), 8);
+
+		_mm_storeu_si128((__m128i*)destination, _mm_adds_epu8(src, _mm_packus_epi16(low, high)));
+	}
+#endif
+
+	for (; count > 0; count--, destination += 4, source += 4) {
+		uint32_t inverse = 255 - source[3];
+
+		for (size_t i = 0; i < 4; i++) {
+			uint32_t product = (destination[i] * inverse) + 128;
+
+			destination[i] = (ubyte_t)MIN(source[i] + ((product + (product >> 8)) >> 8), 255);
+		}
+	}
+}
+
+/* composite @count premultiplied pixels of @alpha from @source over @destination (any layout) */
+static void blend_span(framebuffer_t* fb, ubyte_t* destination, const ubyte_t* source, const ubyte_t* alpha, size_t count)
+{
+	for (; count > 0; count--, destination += fb->format.size, source += fb->format.size, alpha++) {
+		uint32_t values[2] = { 0, 0 };
+
+		for (size_t i = 0; i < fb->format.size; i++) {
+			values[0] |= (uint32_t)source[i] << (i * 8);
+			values[1] |= (uint32_t)destination[i] << (i * 8);
+		}
+
+		color_t src = long_to_color(fb, values[0]);
+		color_t dst = long_to_color(fb, values[1]);
+		uint32_t inverse = 255 - *alpha;
+
+		dst.red = (ubyte_t)MIN(src.red + ((dst.red * inverse + 127) / 255), 255);
+		dst.green = (ubyte_t)MIN(src.green + ((dst.green * inverse + 127) / 255), 255);
+		dst.blue = (ubyte_t)MIN(src.blue + ((dst.blue * inverse + 127) / 255), 255);
+
+		fb->writer->put(destination, (uint32_t)color_to_long(fb, dst));
+	}
+}
+
+/* draw @sprite with top left corner at @position, clipped to @clip */
+static void blit_sprite(framebuffer_t* fb, const sprite_t* sprite, const vertice_t position, const region_t clip)
+{
+	long_t first = MAX(clip.start.y - position.y, 0);
+	long_t last = MIN(clip.end.y - position.y, sprite->size.y);
+	bool blend = is_blend_format(&fb->format);
+	size_t size = fb->format.size;
+
+	if (fb->buffer == NULL)
+		return;
+
+	for (long_t row = first; row < last; row++) {
+		ubyte_t* line = fb->buffer + ((position.y + row) * fb->fix_info.line_length);
+		size_t offset = (size_t)row * sprite->size.x;
+
+		for (uint32_t i = sprite->row_starts[row]; i < sprite->row_starts[row + 1]; i++) {
+			const sprite_span_t* span = &sprite->spans[i];
+			long_t start = MAX(position.x + span->start, clip.start.x);
+			long_t end = MIN(position.x + span->start + span->length, clip.end.x);
+			size_t pixel = offset + (size_t)(start - position.x);
+
+			if (start >= end)
+				continue;
+
+			/* opaque spans are copied, others composited */
+			if (span->opaque)
+				memcpy(line + (start * size), sprite->pixels + (pixel * size), (end - start) * size);
+			else if (blend)
+				blend_span_32(line + (start * size), sprite->pixels + (pixel * size), end - start);
+			else
+				blend_span(fb, line + (start * size), sprite->pixels + (pixel * size), sprite->alpha + pixel, end - start);
+		}
+	}
+}
+#endif
+
+/* draw @sprite into screen with top left corner at @position */
+void draw_sprite(framebuffer_t* fb, const sprite_t* sprite, const vertice_t position)
+{
+	if (fb != NULL && sprite != NULL) {
+#ifdef __WINDOWS__
+		/* NOTE: GDI has no alpha here, pixels are composited one by one */
+		for (long_t row = 0; row < sprite->size.y; row++) {
+			for (uint32_t i = sprite->row_starts[row]; i < sprite->row_starts[row + 1]; i++) {
+				const sprite_span_t* span = &sprite->spans[i];
+
+				for (long_t x = span->start; x < span->start + span->length; x++) {
+					color_t color = sprite->colors[(row * sprite->size.x) + x];
+					COLORREF under = GetPixel(fb->device, position.x + x, position.y + row);
+					uint32_t inverse = 255 - color.alpha;
+
+					if (!span->opaque && under != CLR_INVALID) {
+						color.red = (ubyte_t)MIN(color.red + ((GetRValue(under) * inverse + 127) / 255), 255);
+						color.green = (ubyte_t)MIN(color.green + ((GetGValue(under) * inverse + 127) / 255), 255);
+						color.blue = (ubyte_t)MIN(color.blue + ((GetBValue(under) * inverse + 127) / 255), 255);
+					}
+
+					SetPixel(fb->device, position.x + x, position.y + row, RGB(color.red, color.green, color.blue));
+				}
+			}
+		}
+#else
+		blit_sprite(fb, sprite, position, get_screen_region(fb));
+
+		mark_dirty(fb, position, (vertice_t){ position.x + sprite->size.x - 1, position.y + sprite->size.y - 1 });
+#endif
+	}
+}
+
+/* add command to @cb, growing it when full */
+static bool record_command(command_buffer_t* cb, const command_type_t type, const vertice_t a, const vertice_t b, const vertice_t c, const color_t color)
+{
+	if (cb == NULL)
+		return false;
+
+	if (cb->count == cb->capacity) {
+		size_t capacity = (cb->capacity > 0) ? cb->capacity * 2 : 256;
+
+		/* NOTE: bins hold 32-bit command indices, checked before commands can move */
+		if (capacity > UINT32_MAX || capacity > SIZE_MAX / sizeof(command_t))
+			return false;
+
+		command_t* commands = realloc(cb->commands, sizeof(command_t) * capacity);
+
+		if (commands == NULL)
+			return false;
+
+		cb->commands = commands;
+		cb->capacity = capacity;
+	}
+
+	command_t* command = &cb->commands[cb->count++];
+
+	command->type = type;
+	command->vertices[0] = a;
+	command->vertices[1] = b;
+	command->vertices[2] = c;
+	command->color = color;
+
+	return true;
+}
+
+/* record rectangle to be drawn on next execution */
+bool record_rect(command_buffer_t* cb, const vertice_t start, const vertice_t end, const color_t color)
+{
+	return record_command(cb, COMMAND_RECT, start, end, end, color);
+}
+
+/* record triangle to be drawn on next execution */
+bool record_triangle(command_buffer_t* cb, const vertice_t a, const vertice_t b, const vertice_t c, const color_t color)
+{
+	return record_command(cb, COMMAND_TRIANGLE, a, b, c, color);
+}
+
+/* record line to be drawn on next execution */
+bool record_line(command_buffer_t* cb, const vertice_t start, const vertice_t end, const color_t color)
+{
+	return record_command(cb, COMMAND_LINE, start, end, end, color);
+}
+
+/* record @sprite to be drawn with top left corner at @position on next execution (sprite must outlive it) */
+bool record_sprite(command_buffer_t* cb, const sprite_t* sprite, const vertice_t position)
+{
+	if (sprite == NULL || !record_command(cb, COMMAND_SPRITE, position, position, position, (color_t){ 0, 0, 0, 0 }))
+		return false;
+
+	cb->commands[cb->count - 1].sprite = sprite;
+
+	return true;
+}
+
+#ifndef __WINDOWS__
+/* find pixels touched by @command clipped to screen and pack its color, false if nothing is drawn */
+static bool prepare_command(framebuffer_t* fb, command_t* command)
+{
+	vertice_t* v = command->vertices;
+	region_t bounds;
+
+	switch (command->type) {
+		case COMMAND_RECT:
+			if (v[0].x > v[1].x)
+				swap(&v[0].x, &v[1].x);
+			if (v[0].y > v[1].y)
+				swap(&v[0].y, &v[1].y);
+
+			bounds = (region_t){ v[0], v[1] };
+			break;
+
+		case COMMAND_TRIANGLE:
+			/* NOTE: triangles reaching outside guard band are not drawn (same as draw_triangle) */
+			for (size_t i = 0; i < 3; i++) {
+				if (v[i].x <= -GUARD_BAND || v[i].x >= GUARD_BAND || v[i].y <= -GUARD_BAND || v[i].y >= GUARD_BAND)
+					return false;
+			}
+
+			bounds = (region_t){ { MIN(MIN(v[0].x, v[1].x), v[2].x), MIN(MIN(v[0].y, v[1].y), v[2].y) }, { MAX(MAX(v[0].x, v[1].x), v[2].x) + 1, MAX(MAX(v[0].y, v[1].y), v[2].y) + 1 } };
+			break;
+
+		case COMMAND_SPRITE:
+			bounds = (region_t){ v[0], { v[0].x + command->sprite->size.x, v[0].y + command->sprite->size.y } };
+			break;
+
+		default:
+			bounds = (region_t){ { MIN(v[0].x, v[1].x), MIN(v[0].y, v[1].y) }, { MAX(v[0].x, v[1].x) + 1, MAX(v[0].y, v[1].y) + 1 } };
+	}
+
+	command->bounds.start.x = MAX(bounds.start.x, 0);
+	command->bounds.start.y = MAX(bounds.start.y, 0);
+	command->bounds.end.x = MIN(bounds.end.x, (long_t)fb->var_info.xres);
+	command->bounds.end.y = MIN(bounds.end.y, (long_t)fb->var_info.yres);
+	command->value = (uint32_t)color_to_long(fb, command->color);
+
+	return (command->bounds.start.x < command->bounds.end.x && command->bounds.start.y < command->bounds.end.y);
+}
+
+/* draw commands sorted into @bin, clipped to it so each bin is written by a single thread */
+static void execute_bin(command_buffer_t* cb, const size_t bin)
+{
+	framebuffer_t* fb = cb->fb;
+	region_t clip;
+
+	clip.start.x = (long_t)((bin % cb->bin_columns) * BIN_SIZE);
+	clip.start.y = (long_t)((bin / cb->bin_columns) * BIN_SIZE);
+	clip.end.x = MIN(clip.start.x + BIN_SIZE, (long_t)fb->var_info.xres);
+	clip.end.y = MIN(clip.start.y + BIN_SIZE, (long_t)fb->var_info.yres);
+
+	for (size_t i = cb->bin_starts[bin]; i < cb->bin_starts[bin + 1]; i++) {
+		const command_t* command = &cb->commands[cb->entries[i]];
+		const vertice_t* v = command->vertices;
+
+		switch (command->type) {
+			case COMMAND_RECT:
+				fill_rect(fb, v[0], v[1], command->value, clip);
+				break;
+
+			case COMMAND_TRIANGLE:
+				fill_triangle(fb, v[0], v[1], v[2], command->value, clip);
+				break;
+
+			case COMMAND_SPRITE:
+				blit_sprite(fb, command->sprite, v[0], clip);
+				break;
+
+			default:
+				rasterize_line(fb, v[0], v[1], command->value, clip);
+		}
+	}
+}
+
+/* take bins (chunks or rows of bins for particles) until every one of them was executed */
+static void execute_bins(command_buffer_t* cb)
+{
+	size_t bins = (cb->execution == EXECUTION_SORT_SPOTS) ? cb->spot_chunks : (cb->execution == EXECUTION_DRAW_SPOTS) ? cb->bin_rows : cb->bin_columns * cb->bin_rows;
+
+	while (true) {
+		pthread_mutex_lock(&cb->lock);
+		size_t bin = cb->next_bin++;
+		pthread_mutex_unlock(&cb->lock);
+
+		if (bin >= bins)
+			break;
+
+		switch (cb->execution) {
+			case EXECUTION_SORT_SPOTS:
+				sort_spots(cb, bin);
+				break;
+
+			case EXECUTION_DRAW_SPOTS:
+				execute_spots(cb, bin);
+				break;
+
+			default:
+				execute_bin(cb, bin);
+		}
+	}
+}
+
+/* wait for executions and help with their bins (thread entry) */
+static void* run_draw_worker(void* arg)
+{
+	draw_worker_t* worker = arg;
+	command_buffer_t* cb = worker->cb;
+
+	while (true) {
+		pthread_mutex_lock(&cb->lock);
+
+		while (worker->generation == cb->generation && !cb->quit)
+			pthread_cond_wait(&cb->work_signal, &cb->lock);
+
+		worker->generation = cb->generation;
+
+		pthread_mutex_unlock(&cb->lock);
+
+		if (cb->quit)
+			break;
+
+		execute_bins(cb);
+
+		/* last worker to finish wakes up calling thread */
+		pthread_mutex_lock(&cb->lock);
+
+		if (--cb->pending == 0)
+			pthread_cond_signal(&cb->done_signal);
+
+		pthread_mutex_unlock(&cb->lock);
+	}
+
+	return NULL;
+}
+
+/* execute every bin of @execution from first one, along with workers when @threaded */
+static void run_execution(command_buffer_t* cb, const execution_t execution, const bool threaded)
+{
+	cb->execution = execution;
+	cb->next_bin = 0;
+
+	if (threaded) {
+		pthread_mutex_lock(&cb->lock);
+		cb->pending = cb->workers_count;
+		cb->generation++;
+		pthread_cond_broadcast(&cb->work_signal);
+		pthread_mutex_unlock(&cb->lock);
+
+		execute_bins(cb);
+
+		pthread_mutex_lock(&cb->lock);
+
+		while (cb->pending > 0)
+			pthread_cond_wait(&cb->done_signal, &cb->lock);
+
+		pthread_mutex_unlock(&cb->lock);
+	}
+	else
+		execute_bins(cb);
+}
+
+/* sort prepared commands into bins they touch, keeping recording order inside each bin */
+static bool bin_commands(command_buffer_t* cb)
+{
+	size_t bins = cb->bin_columns * cb->bin_rows;
+	size_t total = 0;
+
+	memset(cb->bin_starts, 0, sizeof(size_t) * (bins + 1));
+
+	/* count entries of each bin */
+	for (size_t i = 0; i < cb->count; i++) {
+		region_t bounds = cb->commands[i].bounds;
+
+		if (bounds.start.x >= bounds.end.x)
+			continue;
+
+		for (long_t row = bounds.start.y / BIN_SIZE; row <= (bounds.end.y - 1) / BIN_SIZE; row++) {
+			for (long_t column = bounds.start.x / BIN_SIZE; column <= (bounds.end.x - 1) / BIN_SIZE; column++)
+				cb->bin_starts[(row * cb->bin_columns) + column + 1]++;
+		}
+	}
+
+	for (size_t i = 1; i <= bins; i++) {
+		total += cb->bin_starts[i];
+		cb->bin_starts[i] = total;
+	}
+
+	if (total > cb->entries_capacity) {
+		uint32_t* entries = realloc(cb->entries, sizeof(uint32_t) * total);
+
+		if (entries == NULL)
+			return false;
+
+		cb->entries = entries;
+		cb->entries_capacity = total;
+	}
+
+	memcpy(cb->bin_cursors, cb->bin_starts, sizeof(size_t) * bins);
+
+	for (size_t i = 0; i < cb->count; i++) {
+		region_t bounds = cb->commands[i].bounds;
+
+		if (bounds.start.x >= bounds.end.x)
+			continue;
+
+		for (long_t row = bounds.start.y / BIN_SIZE; row <= (bounds.end.y - 1) / BIN_SIZE; row++) {
+			for (long_t column = bounds.start.x / BIN_SIZE; column <= (bounds.end.x - 1) / BIN_SIZE; column++)
+				cb->entries[cb->bin_cursors[(row * cb->bin_columns) + column]++] = (uint32_t)i;
+		}
+	}
+
+	return true;
+}
+#endif
+
+/* draw recorded commands in recording order and start recording a new batch (on Linux, bins of screen are drawn in parallel) */
+void execute_commands(framebuffer_t* fb, command_buffer_t* cb)
+{
+	if (fb != NULL && cb != NULL) {
+#ifdef __WINDOWS__
+		for (size_t i = 0; i < cb->count; i++) {
+			const command_t* command = &cb->commands[i];
+			const vertice_t* v = command->vertices;
+
+			switch (command->type) {
+				case COMMAND_RECT:
+					draw_rect(fb, v[0], v[1], command->color);
+					break;
+
+				case COMMAND_TRIANGLE:
+					draw_triangle(fb, v[0], v[1], v[2], command->color);
+					break;
+
+				case COMMAND_SPRITE:
+					draw_sprite(fb, command->sprite, v[0]);
+					break;
+
+				default:
+					draw_line(fb, v[0], v[1], command->color);
+			}
+		}
+#else
+		if (fb == cb->fb && fb->buffer != NULL) {
+			for (size_t i = 0; i < cb->count; i++) {
+				command_t* command = &cb->commands[i];
+
+				if (prepare_command(fb, command))
+					mark_dirty(fb, command->bounds.start, (vertice_t){ command->bounds.end.x - 1, command->bounds.end.y - 1 });
+				else
+					command->bounds.end.x = command->bounds.start.x;
+			}
+
+			/* waking up workers costs more than drawing a few commands */
+			if (bin_commands(cb))
+				run_execution(cb, EXECUTION_COMMANDS, cb->workers_count > 0 && cb->count >= MIN_THREADED_COMMANDS);
+		}
+#endif
+
+		cb->count = 0;
+	}
+}
+
+/* terminate command buffer and its threads */
+void terminate_command_buffer(command_buffer_t* cb)
+{
+	if (cb != NULL) {
+#ifndef __WINDOWS__
+		if (cb->workers_count > 0) {
+			pthread_mutex_lock(&cb->lock);
+			cb->quit = true;
+			pthread_cond_broadcast(&cb->work_signal);
+			pthread_mutex_unlock(&cb->lock);
+
+			for (size_t i = 0; i < cb->workers_count; i++)
+				pthread_join(cb->workers[i].thread, NULL);
+
+			cb->workers_count = 0;
+		}
+
+		if (cb->fb != NULL) {
+			pthread_mutex_destroy(&cb->lock);
+			pthread_cond_destroy(&cb->work_signal);
+			pthread_cond_destroy(&cb->done_signal);
+			cb->fb = NULL;
+		}
+
+		free(cb->bin_starts);
+		free(cb->bin_cursors);
+		free(cb->entries);
+		free(cb->spots);
+		free(cb->spot_starts);
+		free(cb->spot_ends);
+		free(cb->spot_cells);
+		cb->bin_starts = NULL;
+		cb->bin_cursors = NULL;
+		cb->entries = NULL;
+		cb->entries_capacity = 0;
+		cb->spots = NULL;
+		cb->spot_starts = NULL;
+		cb->spot_ends = NULL;
+		cb->spot_cells = NULL;
+		cb->spots_capacity = 0;
+		cb->chunks_capacity = 0;
+#endif
+
+		free(cb->commands);
+		cb->commands = NULL;
+		cb->count = 0;
+		cb->capacity = 0;
+	}
+}
+
+/* initialize command buffer for @fb with @threads drawing bins (0 for one per processor) */
+bool init_command_buffer(command_buffer_t* cb, framebuffer_t* fb, size_t threads)
+{
+	bool success = false;
+
+	if (cb != NULL && fb != NULL) {
+		memset(cb, 0, sizeof(command_buffer_t));
+
+#ifdef __WINDOWS__
+		/* NOTE: windows draws commands in order through GDI */
+		success = true;
+#else
+		cb->bin_columns = (fb->var_info.xres + BIN_SIZE - 1) / BIN_SIZE;
+		cb->bin_rows = (fb->var_info.yres + BIN_SIZE - 1) / BIN_SIZE;
+		cb->bin_starts = malloc(sizeof(size_t) * ((cb->bin_columns * cb->bin_rows) + 1));
+		cb->bin_cursors = malloc(sizeof(size_t) * cb->bin_columns * cb->bin_rows);
+
+		if (cb->bin_starts != NULL && cb->bin_cursors != NULL) {
+			const char* particles = getenv("HARVEST_THREADED_PARTICLES");
+
+			cb->fb = fb;
+
+			/* NOTE: sorting particles by rows of bins was only measured slower than drawing them straight, it's opt-in until it pays off */
+			cb->threaded_particles = (particles != NULL && strcmp(particles, "0") != 0);
+
+			pthread_mutex_init(&cb->lock, NULL);
+			pthread_cond_init(&cb->work_signal, NULL);
+			pthread_cond_init(&cb->done_signal, NULL);
+
+			if (threads == 0)
+				threads = (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+
+			threads = (threads < 1) ? 1 : (threads > MAX_DRAW_THREADS) ? MAX_DRAW_THREADS : threads;
+
+			/* calling thread takes bins too */
+			for (size_t i = 0; i + 1 < threads; i++) {
+				draw_worker_t* worker = &cb->workers[i];
+
+				worker->cb = cb;
+				worker->generation = cb->generation;
+
+				/* keep workers already running */
+				if (pthread_create(&worker->thread, NULL, &run_draw_worker, worker) != 0)
+					break;
+
+				cb->workers_count++;
+			}
+
+			success = true;
+		}
+#endif
+	}
+
+	/* clean up if not successful */
+	if (!success)
+		terminate_command_buffer(cb);
+
+	return success;
+}
+
+/* terminate entity store */
+void terminate_entities(entities_t* entities)
+{
+	if (entities != NULL) {
+		/* every array lives in one block starting at coord_x */
+		free(entities->coord_x);
+		memset(entities, 0, sizeof(entities_t));
+	}
+}
+
+/* initialize entity store holding up to @capacity entities, each field in its own array */
+bool init_entities(entities_t* entities, size_t capacity)
+{
+	bool success = false;
+
+	if (entities != NULL) {
+		memset(entities, 0, sizeof(entities_t));
+
+		/* whole groups of 4 are updated at once */
+		capacity = (capacity + 3) & ~(size_t)3;
+
+		size_t size = capacity * ((sizeof(float) * 10) + sizeof(color_t) + (sizeof(ubyte_t) * 2));
+		ubyte_t* block = calloc(1, size);
+
+		if (block != NULL) {
+			entities->coord_x = (float*)block;
+			entities->coord_y = entities->coord_x + capacity;
+			entities->previous_x = entities->coord_y + capacity;
+			entities->previous_y = entities->previous_x + capacity;
+			entities->velocity_x = entities->previous_y + capacity;
+			entities->velocity_y = entities->velocity_x + capacity;
+			entities->accel_x = entities->velocity_y + capacity;
+			entities->accel_y = entities->accel_x + capacity;
+			entities->box_x = entities->accel_y + capacity;
+			entities->box_y = entities->box_x + capacity;
+			entities->colors = (color_t*)(entities->box_y + capacity);
+			entities->kinds = (ubyte_t*)(entities->colors + capacity);
+			entities->alive = entities->kinds + capacity;
+			entities->capacity = capacity;
+
+			success = true;
+		}
+	}
+
+	return success;
+}
+
+/* add entity centered at @coord with half sizes @box, false if store is full */
+bool spawn_entity(entities_t* entities, const entity_kind_t kind, const vertice_t coord, const vertice_t velocity, const vertice_t accel, const vertice_t box, const color_t color)
+{
+	if (entities == NULL || entities->count == entities->capacity)
+		return false;
+
+	size_t i = entities->count++;
+
+	entities->coord_x[i] = entities->previous_x[i] = (float)coord.x;
+	entities->coord_y[i] = entities->previous_y[i] = (float)coord.y;
+	entities->velocity_x[i] = (float)velocity.x;
+	entities->velocity_y[i] = (float)velocity.y;
+	entities->accel_x[i] = (float)accel.x;
+	entities->accel_y[i] = (float)accel.y;
+	entities->box_x[i] = (float)box.x;
+	entities->box_y[i] = (float)box.y;
+	entities->colors[i] = color;
+	entities->kinds[i] = (ubyte_t)kind;
+	entities->alive[i] = 1;
+
+	return true;
+}
+
+/* remove entity @i on next update */
+void kill_entity(entities_t* entities, const size_t i)
+{
+	if (entities != NULL && i < entities->count)
+		entities->alive[i] = 0;
+}
+
+/* move dead entities out, keeping order of the others */
+static void compact_entities(entities_t* entities)
+{
+	size_t kept = 0;
+
+	for (size_t i = 0; i < entities->count; i++) {
+		if (!entities->alive[i])
+			continue;
+
+		if (kept != i) {
+			entities->coord_x[kept] = entities->coord_x[i];
+			entities->coord_y[kept] = entities->coord_y[i];
+			entities->previous_x[kept] = entities->previous_x[i];
+			entities->previous_y[kept] = entities->previous_y[i];
+			entities->velocity_x[kept] = entities->velocity_x[i];
+			entities->velocity_y[kept] = entities->velocity_y[i];
+			entities->accel_x[kept] = entities->accel_x[i];
+			entities->accel_y[kept] = entities->accel_y[i];
+			entities->box_x[kept] = entities->box_x[i];
+			entities->box_y[kept] = entities->box_y[i];
+			entities->colors[kept] = entities->colors[i];
+			entities->kinds[kept] = entities->kinds[i];
+			entities->alive[kept] = 1;
+		}
+
+		kept++;
+	}
+
+	entities->count = kept;
+}
+
+/* step every entity of @previous (may be @entities itself) over @step seconds into @entities (holding as many), removing those leaving @bounds and dead ones */
+/* NOTE: stepping writes every field, state is handed between snapshots without copying it first */
+void update_entities(entities_t* entities, const entities_t* previous, const float step, const region_t bounds)
+{
+	if (entities == NULL || previous == NULL || entities->capacity < previous->count)
+		return;
+
+	/* NOTE: last group may run past count, spare entities are never read */
+	size_t count = (previous->count + 3) & ~(size_t)3;
+	bool moved = (entities != previous);
+	float left = (float)bounds.start.x;
+	float top = (float)bounds.start.y;
+	float right = (float)bounds.end.x;
+	float bottom = (float)bounds.end.y;
+
+#ifdef __SSE2_ARCH__
+	__m128 steps = _mm_set1_ps(step);
+	__m128 lefts = _mm_set1_ps(left);
+	__m128 tops = _mm_set1_ps(top);
+	__m128 rights = _mm_set1_ps(right);
+	__m128 bottoms = _mm_set1_ps(bottom);
+
+	for (size_t i = 0; i < count; i += 4) {
+		__m128 accel_x = _mm_loadu_ps(previous->accel_x + i);
+		__m128 accel_y = _mm_loadu_ps(previous->accel_y + i);
+		__m128 velocity_x = _mm_add_ps(_mm_loadu_ps(previous->velocity_x + i), _mm_mul_ps(accel_x, steps));
+		__m128 velocity_y = _mm_add_ps(_mm_loadu_ps(previous->velocity_y + i), _mm_mul_ps(accel_y, steps));
+		__m128 previous_x = _mm_loadu_ps(previous->coord_x + i);
+		__m128 previous_y = _mm_loadu_ps(previous->coord_y + i);
+		__m128 x = _mm_add_ps(previous_x, _mm_mul_ps(velocity_x, steps));
+		__m128 y = _mm_add_ps(previous_y, _mm_mul_ps(velocity_y, steps));
+		__m128 box_x = _mm_loadu_ps(previous->box_x + i);
+		__m128 box_y = _mm_loadu_ps(previous->box_y + i);
+
+		_mm_storeu_ps(entities->previous_x + i, previous_x);
+		_mm_storeu_ps(entities->previous_y + i, previous_y);
+		_mm_storeu_ps(entities->velocity_x + i, velocity_x);
+		_mm_storeu_ps(entities->velocity_y + i, velocity_y);
+		_mm_storeu_ps(entities->coord_x + i, x);
+		_mm_storeu_ps(entities->coord_y + i, y);
+
+		/* fields stepping doesn't change */
+		if (moved) {
+			_mm_storeu_ps(entities->accel_x + i, accel_x);
+			_mm_storeu_ps(entities->accel_y + i, accel_y);
+			_mm_storeu_ps(entities->box_x + i, box_x);
+			_mm_storeu_ps(entities->box_y + i, box_y);
+			_mm_storeu_si128((__m128i*)(entities->colors + i), _mm_loadu_si128((const __m128i*)(previous->colors + i)));
+			memcpy(entities->kinds + i, previous->kinds + i, 4);
+		}
+
+		/* boxes still touching bounds */
+		__m128 inside = _mm_and_ps(_mm_cmpgt_ps(_mm_add_ps(x, box_x), lefts), _mm_cmplt_ps(_mm_sub_ps(x, box_x), rights));
+		inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpgt_ps(_mm_add_ps(y, box_y), tops), _mm_cmplt_ps(_mm_sub_ps(y, box_y), bottoms)));
+
+		int mask = _mm_movemask_ps(inside);
+
+		for (size_t j = 0; j < 4; j++)
+			entities->alive[i + j] = previous->alive[i + j] & (ubyte_t)((mask >> j) & 1);
+	}
+#else
+	for (size_t i = 0; i < count; i++) {
+		entities->previous_x[i] = previous->coord_x[i];
+		entities->previous_y[i] = previous->coord_y[i];
+		entities->velocity_x[i] = previous->velocity_x[i] + (previous->accel_x[i] * step);
+		entities->velocity_y[i] = previous->velocity_y[i] + (previous->accel_y[i] * step);
+		entities->coord_x[i] = previous->coord_x[i] + (entities->velocity_x[i] * step);
+		entities->coord_y[i] = previous->coord_y[i] + (entities->velocity_y[i] * step);
+
+		/* fields stepping doesn't change */
+		if (moved) {
+			entities->accel_x[i] = previous->accel_x[i];
+			entities->accel_y[i] = previous->accel_y[i];
+			entities->box_x[i] = previous->box_x[i];
+			entities->box_y[i] = previous->box_y[i];
+			entities->colors[i] = previous->colors[i];
+			entities->kinds[i] = previous->kinds[i];
+		}
+
+		/* boxes still touching bounds */
+		entities->alive[i] = previous->alive[i];
+
+		if (entities->coord_x[i] + entities->box_x[i] <= left || entities->coord_x[i] - entities->box_x[i] >= right ||
+			entities->coord_y[i] + entities->box_y[i] <= top || entities->coord_y[i] - entities->box_y[i] >= bottom)
+			entities->alive[i] = 0;
+	}
+#endif
+
+	entities->count = previous->count;
+
+	compact_entities(entities);
+}
+
+/* record every entity into @cb @blend of the way from previous to current position (enemies as triangles pointing down, projectiles as rectangles) */
+void draw_entities(command_buffer_t* cb, const entities_t* entities, const float blend)
+{
+	if (cb != NULL && entities != NULL) {
+		for (size_t i = 0; i < entities->count; i++) {
+			/* killed since last update */
+			if (!entities->alive[i])
+				continue;
+
+			long_t x = (long_t)(entities->previous_x[i] + ((entities->coord_x[i] - entities->previous_x[i]) * blend));
+			long_t y = (long_t)(entities->previous_y[i] + ((entities->coord_y[i] - entities->previous_y[i]) * blend));
+			long_t box_x = (long_t)entities->box_x[i];
+			long_t box_y = (long_t)entities->box_y[i];
+
+			if (entities->kinds[i] == ENTITY_ENEMY)
+				record_triangle(cb, (vertice_t){ x - box_x, y - box_y }, (vertice_t){ x + box_x, y - box_y }, (vertice_t){ x, y + box_y }, entities->colors[i]);
+			else
+				record_rect(cb, (vertice_t){ x - box_x, y - box_y }, (vertice_t){ x + box_x, y + box_y }, entities->colors[i]);
+		}
+	}
+}
+
+/* terminate particle pool */
+void terminate_particles(particles_t* particles)
+{
+	if (particles != NULL) {
+		/* every array lives in one block starting at coord_x */
+		free(particles->coord_x);
+		memset(particles, 0, sizeof(particles_t));
+	}
+}
+
+/* initialize pool of up to @capacity particles launched by @count @emitters (colors packed for @fb) */
+bool init_particles(particles_t* particles, framebuffer_t* fb, const emitter_t* emitters, const size_t count, size_t capacity)
+{
+	bool success = false;
+
+	if (particles != NULL && fb != NULL && emitters != NULL && count <= PARTICLE_EMITTERS) {
+		memset(particles, 0, sizeof(particles_t));
+
+		/* whole groups of 4 are updated at once */
+		capacity = (capacity + 3) & ~(size_t)3;
+
+		ubyte_t* block = calloc(1, capacity * ((sizeof(float) * 7) + sizeof(ubyte_t)));
+
+		if (block != NULL) {
+			particles->coord_x = (float*)block;
+			particles->coord_y = particles->coord_x + capacity;
+			particles->velocity_x = particles->coord_y + capacity;
+			particles->velocity_y = particles->velocity_x + capacity;
+			particles->drag = particles->velocity_y + capacity;
+			particles->age = particles->drag + capacity;
+			particles->fade = particles->age + capacity;
+			particles->emitters = (ubyte_t*)(particles->fade + capacity);
+			particles->capacity = capacity;
+			particles->configs_count = count;
+			particles->random = GAME_SEED;
+
+			memcpy(particles->configs, emitters, sizeof(emitter_t) * count);
+
+			/* colors are looked up by age when drawing */
+			for (size_t i = 0; i < count; i++) {
+				const emitter_t* emitter = &emitters[i];
+
+				for (long_t j = 0; j < PARTICLE_SHADES; j++) {
+					color_t color = {
+						(ubyte_t)(emitter->start.red + (((emitter->end.red - emitter->start.red) * j) / (PARTICLE_SHADES - 1))),
+						(ubyte_t)(emitter->start.green + (((emitter->end.green - emitter->start.green) * j) / (PARTICLE_SHADES - 1))),
+						(ubyte_t)(emitter->start.blue + (((emitter->end.blue - emitter->start.blue) * j) / (PARTICLE_SHADES - 1))),
+						255
+					};
+
+					particles->shades[i][j] = (uint32_t)color_to_long(fb, color);
+				}
+
+				particles->margin = MAX(particles->margin, (long_t)(emitter->size / 2) + 1);
+			}
+
+			success = true;
+		}
+	}
+
+	return success;
+}
+
+/* get next random number of @state (xorshift, independent of rand() so effects don't change spawns) */
+static uint32_t next_random(uint32_t* state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	return *state = x;
+}
+
+/* get random number in [0, 1) from @state */
+static float random_unit(uint32_t* state)
+{
+	return (float)(next_random(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+/* launch @count particles of @emitter from @coord moving along with @velocity, false if pool filled up first */
+bool emit_particles(particles_t* particles, const size_t emitter, const vertice_t coord, const vertice_t velocity, const size_t count)
+{
+	if (particles == NULL || emitter >= particles->configs_count)
+		return false;
+
+	const emitter_t* config = &particles->configs[emitter];
+
+	for (size_t n = 0; n < count; n++) {
+		if (particles->count == particles->capacity)
+			return false;
+
+		size_t i = particles->count++;
+		float x;
+		float y;
+
+		/* uniform point of unit disc (no trigonometry) */
+		do {
+			x = (random_unit(&particles->random) * 2.0f) - 1.0f;
+			y = (random_unit(&particles->random) * 2.0f) - 1.0f;
+		} while ((x * x) + (y * y) > 1.0f);
+
+		particles->coord_x[i] = (float)coord.x;
+		particles->coord_y[i] = (float)coord.y;
+		particles->velocity_x[i] = (float)velocity.x + config->velocity_x + (x * config->spread);
+		particles->velocity_y[i] = (float)velocity.y + config->velocity_y + (y * config->spread);
+		particles->drag[i] = config->drag;
+		particles->age[i] = 0.0f;
+		particles->fade[i] = 1.0f / (config->life + (random_unit(&particles->random) * config->life_spread));
+		particles->emitters[i] = (ubyte_t)emitter;
+	}
+
+	return true;
+}
+
+/* move last particle into @i (already updated, particles are updated from last to first) */
+static void remove_particle(particles_t* particles, const size_t i)
+{
+	size_t last = --particles->count;
+
+	if (i != last) {
+		particles->coord_x[i] = particles->coord_x[last];
+		particles->coord_y[i] = particles->coord_y[last];
+		particles->velocity_x[i] = particles->velocity_x[last];
+		particles->velocity_y[i] = particles->velocity_y[last];
+		particles->drag[i] = particles->drag[last];
+		particles->age[i] = particles->age[last];
+		particles->fade[i] = particles->fade[last];
+		particles->emitters[i] = particles->emitters[last];
+	}
+}
+
+/* step every particle of @previous (may be @particles itself, initialized with same emitters) over @step seconds into @particles (holding as many) and remove those reaching end of life */
+void update_particles(particles_t* particles, const particles_t* previous, const float step)
+{
+	if (particles == NULL || previous == NULL || particles->capacity < previous->count)
+		return;
+
+	bool moved = (particles != previous);
+
+	/* launches go on from where previous left */
+	particles->count = previous->count;
+	particles->random = previous->random;
+
+#ifdef __SSE2_ARCH__
+	/* NOTE: last group may run past count, spare particles are never read */
+	__m128 steps = _mm_set1_ps(step);
+	__m128 ones = _mm_set1_ps(1.0f);
+	__m128 zeros = _mm_setzero_ps();
+
+	for (size_t i = (previous->count + 3) & ~(size_t)3; i > 0;) {
+		i -= 4;
+
+		/* drag can't turn particles back */
+		__m128 drag = _mm_loadu_ps(previous->drag + i);
+		__m128 fade = _mm_loadu_ps(previous->fade + i);
+		__m128 damping = _mm_max_ps(_mm_sub_ps(ones, _mm_mul_ps(drag, steps)), zeros);
+		__m128 velocity_x = _mm_mul_ps(_mm_loadu_ps(previous->velocity_x + i), damping);
+		__m128 velocity_y = _mm_mul_ps(_mm_loadu_ps(previous->velocity_y + i), damping);
+		__m128 age = _mm_add_ps(_mm_loadu_ps(previous->age + i), _mm_mul_ps(fade, steps));
+
+		_mm_storeu_ps(particles->velocity_x + i, velocity_x);
+		_mm_storeu_ps(particles->velocity_y + i, velocity_y);
+		_mm_storeu_ps(particles->coord_x + i, _mm_add_ps(_mm_loadu_ps(previous->coord_x + i), _mm_mul_ps(velocity_x, steps)));
+		_mm_storeu_ps(particles->coord_y + i, _mm_add_ps(_mm_loadu_ps(previous->coord_y + i), _mm_mul_ps(velocity_y, steps)));
+		_mm_storeu_ps(particles->age + i, age);
+
+		/* fields stepping doesn't change */
+		if (moved) {
+			_mm_storeu_ps(particles->drag + i, drag);
+			_mm_storeu_ps(particles->fade + i, fade);
+			memcpy(particles->emitters + i, previous->emitters + i, 4);
+		}
+
+		int mask = _mm_movemask_ps(_mm_cmplt_ps(age, ones));
+
+		/* last lanes first, so every particle moved in is one already updated */
+		if (mask != 0xF) {
+			for (size_t j = 4; j-- > 0;) {
+				if (!((mask >> j) & 1) && i + j < particles->count)
+					remove_particle(particles, i + j);
+			}
+		}
+	}
+#else
+	for (size_t i = previous->count; i-- > 0;) {
+		float damping = 1.0f - (previous->drag[i] * step);
+
+		damping = (damping > 0.0f) ? damping : 0.0f;
+		particles->velocity_x[i] = previous->velocity_x[i] * damping;
+		particles->velocity_y[i] = previous->velocity_y[i] * damping;
+		particles->coord_x[i] = previous->coord_x[i] + (particles->velocity_x[i] * step);
+		particles->coord_y[i] = previous->coord_y[i] + (particles->velocity_y[i] * step);
+		particles->age[i] = previous->age[i] + (previous->fade[i] * step);
+
+		/* fields stepping doesn't change */
+		if (moved) {
+			particles->drag[i] = previous->drag[i];
+			particles->fade[i] = previous->fade[i];
+			particles->emitters[i] = previous->emitters[i];
+		}
+
+		if (particles->age[i] >= 1.0f)
+			remove_particle(particles, i);
+	}
+#endif
+}
+
+#ifndef __WINDOWS__
+/* get pixel of @count particles from @first where they were @lag seconds ago (clamped from @low to @high_x and @high_y) and their shade */
+/* NOTE: positions of a whole batch are found before any pixel is written, pixel writes may alias particle arrays */
+static void place_particles(const particles_t* particles, const size_t first, const size_t count, const float lag, const float low, const float high_x, const float high_y,
+	int32_t* xs, int32_t* ys, int32_t* ages)
+{
+#ifdef __SSE2_ARCH__
+	/* NOTE: last group may run past count, capacity is a multiple of 4 and spare results are never read */
+	__m128 lags = _mm_set1_ps(lag);
+	__m128 lows = _mm_set1_ps(low);
+	__m128 highs_x = _mm_set1_ps(high_x);
+	__m128 highs_y = _mm_set1_ps(high_y);
+	__m128 shades = _mm_set1_ps((float)PARTICLE_SHADES);
+
+	for (size_t i = 0; i < count; i += 4) {
+		__m128 x = _mm_sub_ps(_mm_loadu_ps(particles->coord_x + first + i), _mm_mul_ps(_mm_loadu_ps(particles->velocity_x + first + i), lags));
+		__m128 y = _mm_sub_ps(_mm_loadu_ps(particles->coord_y + first + i), _mm_mul_ps(_mm_loadu_ps(particles->velocity_y + first + i), lags));
+
+		_mm_storeu_si128((__m128i*)(xs + i), _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(x, lows), highs_x)));
+		_mm_storeu_si128((__m128i*)(ys + i), _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(y, lows), highs_y)));
+		_mm_storeu_si128((__m128i*)(ages + i), _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(particles->age + first + i), shades)));
+	}
+#else
+	for (size_t i = 0; i < count; i++) {
+		float x = particles->coord_x[first + i] - (particles->velocity_x[first + i] * lag);
+		float y = particles->coord_y[first + i] - (particles->velocity_y[first + i] * lag);
+
+		xs[i] = (int32_t)((x < low) ? low : (x > high_x) ? high_x : x);
+		ys[i] = (int32_t)((y < low) ? low : (y > high_y) ? high_y : y);
+		ages[i] = (int32_t)(particles->age[first + i] * PARTICLE_SHADES);
+	}
+#endif
+}
+#endif
+
+#ifndef __WINDOWS__
+/* get rows of bins a @side square from @x and @y touches on @screen, false if it's off screen */
+static bool get_spot_rows(const long_t x, const long_t y, const long_t side, const region_t screen, size_t* first, size_t* last)
+{
+	long_t top = MAX(y, 0);
+	long_t bottom = MIN(y + side, screen.end.y);
+
+	if (MAX(x, 0) >= MIN(x + side, screen.end.x) || top >= bottom)
+		return false;
+
+	*first = (size_t)(top / BIN_SIZE);
+	*last = (size_t)((bottom - 1) / BIN_SIZE);
+
+	return true;
+}
+
+/* place particles of @chunk and sort them into its rows of bins, keeping particle order inside each row, and note cells they touch */
+static void sort_spots(command_buffer_t* cb, const size_t chunk)
+{
+	const particles_t* particles = cb->particles;
+	region_t screen = get_screen_region(cb->fb);
+	size_t* starts = cb->spot_starts + (chunk * cb->bin_rows);
+	size_t* ends = cb->spot_ends + (chunk * cb->bin_rows);
+	particle_spot_t* spots = cb->spots;
+	ubyte_t touched[PARTICLE_CELLS * PARTICLE_CELLS];
+	long_t sides[PARTICLE_EMITTERS];
+	int32_t xs[PARTICLE_CHUNK];
+	int32_t ys[PARTICLE_CHUNK];
+	int32_t ages[PARTICLE_CHUNK];
+	uint16_t firsts[PARTICLE_CHUNK];
+	ubyte_t rows[PARTICLE_CHUNK];
+	long_t margin = particles->margin;
+	size_t from = chunk * PARTICLE_CHUNK;
+	size_t to = MIN(from + PARTICLE_CHUNK, particles->count);
+	size_t total = from * cb->spot_rows;
+	size_t first;
+	size_t last;
+
+	memset(ends, 0, sizeof(size_t) * cb->bin_rows);
+	memset(touched, 0, sizeof(touched));
+
+	/* single pixels are squares of side 1 */
+	for (size_t i = 0; i < particles->configs_count; i++)
+		sides[i] = MAX((long_t)particles->configs[i].size, 1);
+
+	place_particles(particles, from, to - from, cb->lag, (float)(-margin - 1), (float)(screen.end.x + margin), (float)(screen.end.y + margin), xs, ys, ages);
+
+	/* count spots of each row of bins (none for particles off screen) */
+	for (size_t i = 0; i < to - from; i++) {
+		long_t side = sides[particles->emitters[from + i]];
+
+		firsts[i] = 0;
+		rows[i] = 0;
+
+		if (!get_spot_rows(xs[i] - (side / 2), ys[i] - (side / 2), side, screen, &first, &last))
+			continue;
+
+		firsts[i] = (uint16_t)first;
+		rows[i] = (ubyte_t)(last - first + 1);
+
+		for (size_t row = first; row <= last; row++)
+			ends[row]++;
+
+		/* cell of center, squares reaching past it are covered by margin */
+		long_t x = MIN(MAX((long_t)xs[i], 0), screen.end.x - 1);
+		long_t y = MIN(MAX((long_t)ys[i], 0), screen.end.y - 1);
+
+		touched[((y >> cb->cell_shift_y) * PARTICLE_CELLS) + (x >> cb->cell_shift_x)] = 1;
+	}
+
+	/* NOTE: cells are marked on stack, stores into command buffer would make compiler reload particles after each one */
+	memcpy(cb->spot_cells + (chunk * sizeof(touched)), touched, sizeof(touched));
+
+	/* rows follow each other in part of spots of chunk */
+	for (size_t row = 0; row < cb->bin_rows; row++) {
+		starts[row] = total;
+		total += ends[row];
+		ends[row] = starts[row];
+	}
+
+	/* NOTE: positions are clamped to margin, so every spot fits in 16 bits */
+	for (size_t i = 0; i < to - from; i++) {
+		ubyte_t emitter = particles->emitters[from + i];
+		long_t half = sides[emitter] / 2;
+		particle_spot_t spot = { (int16_t)(xs[i] - half), (int16_t)(ys[i] - half), emitter, (ubyte_t)ages[i] };
+
+		for (size_t row = firsts[i]; row < (size_t)firsts[i] + rows[i]; row++)
+			spots[ends[row]++] = spot;
+	}
+}
+
+/* draw @spot of @particles on @fb, clipped from line @clip_top to @clip_bottom */
+/* NOTE: single pixels are only drawn when on screen */
+static inline void draw_spot(framebuffer_t* fb, const particles_t* particles, const particle_spot_t spot, const long_t clip_top, const long_t clip_bottom)
+{
+	long_t side = particles->configs[spot.emitter].size;
+	uint32_t value = particles->shades[spot.emitter][spot.shade];
+	size_t line_length = fb->fix_info.line_length;
+	size_t size = fb->format.size;
+
+	if (side <= 1) {
+		ubyte_t* address = fb->buffer + (spot.y * line_length) + (spot.x * size);
+
+		if (size == 4)
+			*(uint32_t*)address = value;
+		else
+			fb->writer->put(address, value);
+	}
+	else {
+		long_t left = MAX((long_t)spot.x, 0);
+		long_t top = MAX((long_t)spot.y, clip_top);
+		long_t right = MIN((long_t)spot.x + side, (long_t)fb->var_info.xres);
+		long_t bottom = MIN((long_t)spot.y + side, clip_bottom);
+
+		for (long_t line = top; line < bottom; line++)
+			fb->writer->fill(fb->buffer + (line * line_length) + (left * size), (size_t)(right - left), value);
+	}
+}
+
+/* draw spots sorted into row of bins @row by every chunk, clipped to it so each row is written by a single thread */
+static void execute_spots(command_buffer_t* cb, const size_t row)
+{
+	long_t clip_top = (long_t)(row * BIN_SIZE);
+	long_t clip_bottom = MIN(clip_top + BIN_SIZE, (long_t)cb->fb->var_info.yres);
+
+	/* chunks in order, so particles are drawn in same order as on one thread */
+	for (size_t chunk = 0; chunk < cb->spot_chunks; chunk++) {
+		size_t end = cb->spot_ends[(chunk * cb->bin_rows) + row];
+
+		for (size_t i = cb->spot_starts[(chunk * cb->bin_rows) + row]; i < end; i++)
+			draw_spot(cb->fb, cb->particles, cb->spots[i], clip_top, clip_bottom);
+	}
+}
+
+/* place particles of @chunk and draw them straight in particle order, noting cells they touch (calling thread only) */
+static void draw_chunk(command_buffer_t* cb, const size_t chunk)
+{
+	framebuffer_t* fb = cb->fb;
+	const particles_t* particles = cb->particles;
+	region_t screen = get_screen_region(fb);
+	ubyte_t touched[PARTICLE_CELLS * PARTICLE_CELLS];
+	ubyte_t sides[PARTICLE_EMITTERS];
+	int32_t xs[PARTICLE_BATCH];
+	int32_t ys[PARTICLE_BATCH];
+	int32_t ages[PARTICLE_BATCH];
+	long_t margin = particles->margin;
+	size_t line_length = fb->fix_info.line_length;
+	size_t size = fb->format.size;
+	ubyte_t* buffer = fb->buffer;
+	unsigned shift_x = cb->cell_shift_x;
+	unsigned shift_y = cb->cell_shift_y;
+	size_t from = chunk * PARTICLE_CHUNK;
+	size_t to = MIN(from + PARTICLE_CHUNK, particles->count);
+
+	memset(touched, 0, sizeof(touched));
+
+	for (size_t i = 0; i < particles->configs_count; i++)
+		sides[i] = particles->configs[i].size;
+
+	/* NOTE: positions of a whole batch are found before any pixel is written, pixel writes may alias particle arrays */
+	for (size_t first = from; first < to; first += PARTICLE_BATCH) {
+		size_t batch = MIN(to - first, PARTICLE_BATCH);
+
+		place_particles(particles, first, batch, cb->lag, (float)(-margin - 1), (float)(screen.end.x + margin), (float)(screen.end.y + margin), xs, ys, ages);
+
+		for (size_t j = 0; j < batch; j++) {
+			long_t x = xs[j];
+			long_t y = ys[j];
+
+			/* far outside screen */
+			if (x < -margin || y < -margin || x >= screen.end.x + margin || y >= screen.end.y + margin)
+				continue;
+
+			ubyte_t emitter = particles->emitters[first + j];
+			long_t side = sides[emitter];
+			uint32_t value = particles->shades[emitter][ages[j]];
+
+			if (side <= 1) {
+				if (x < 0 || y < 0 || x >= screen.end.x || y >= screen.end.y)
+					continue;
+
+				ubyte_t* address = buffer + (y * line_length) + (x * size);
+
+				if (size == 4)
+					*(uint32_t*)address = value;
+				else
+					fb->writer->put(address, value);
+			}
+			else {
+				long_t left = MAX(x - (side / 2), 0);
+				long_t top = MAX(y - (side / 2), 0);
+				long_t right = MIN(x - (side / 2) + side, screen.end.x);
+				long_t bottom = MIN(y - (side / 2) + side, screen.end.y);
+
+				for (long_t row = top; row < bottom && left < right; row++)
+					fb->writer->fill(buffer + (row * line_length) + (left * size), (size_t)(right - left), value);
+			}
+
+			/* cell of center, squares reaching past it are covered by margin */
+			x = MIN(MAX(x, 0), screen.end.x - 1);
+			y = MIN(MAX(y, 0), screen.end.y - 1);
+			touched[((y >> shift_y) * PARTICLE_CELLS) + (x >> shift_x)] = 1;
+		}
+	}
+
+	memcpy(cb->spot_cells + (chunk * sizeof(touched)), touched, sizeof(touched));
+}
+#endif
+
+/* draw every particle straight into back buffer where it was @lag seconds ago (single pixels or squares colored by age) */
+/* NOTE: on Linux with workers in @cb and threaded particles, chunks of particles are sorted into rows of bins in parallel, then rows are drawn in parallel in particle order */
+void draw_particles(framebuffer_t* fb, command_buffer_t* cb, const particles_t* particles, const float lag)
+{
+	if (fb == NULL || cb == NULL || particles == NULL)
+		return;
+
+#ifdef __WINDOWS__
+	for (size_t i = 0; i < particles->count; i++) {
+		const emitter_t* emitter = &particles->configs[particles->emitters[i]];
+		long_t x = (long_t)(particles->coord_x[i] - (particles->velocity_x[i] * lag)) - (emitter->size / 2);
+		long_t y = (long_t)(particles->coord_y[i] - (particles->velocity_y[i] * lag)) - (emitter->size / 2);
+		COLORREF color = particles->shades[particles->emitters[i]][(long_t)(particles->age[i] * PARTICLE_SHADES)];
+
+		for (long_t row = 0; row < emitter->size; row++) {
+			for (long_t column = 0; column < emitter->size; column++)
+				SetPixel(fb->device, x + column, y + row, color);
+		}
+	}
+#else
+	region_t screen = get_screen_region(fb);
+	ubyte_t touched[PARTICLE_CELLS * PARTICLE_CELLS];
+	size_t chunks = (particles->count + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK;
+	long_t margin = particles->margin;
+	long_t side = 1;
+
+	if (fb != cb->fb || fb->buffer == NULL || chunks == 0)
+		return;
+
+	/* cells are powers of two wide and high, as few as make at most PARTICLE_CELLS per row and column */
+	cb->cell_shift_x = 0;
+	cb->cell_shift_y = 0;
+
+	while (((screen.end.x - 1) >> cb->cell_shift_x) >= PARTICLE_CELLS)
+		cb->cell_shift_x++;
+
+	while (((screen.end.y - 1) >> cb->cell_shift_y) >= PARTICLE_CELLS)
+		cb->cell_shift_y++;
+
+	/* every chunk gets room for all its particles touching as many rows as largest one can */
+	for (size_t i = 0; i < particles->configs_count; i++)
+		side = MAX(side, (long_t)particles->configs[i].size);
+
+	cb->spot_rows = (size_t)((side + BIN_SIZE - 2) / BIN_SIZE) + 1;
+
+	/* waking up workers costs more than drawing a few particles */
+	bool threaded = cb->threaded_particles && cb->workers_count > 0 && particles->count >= MIN_THREADED_PARTICLES;
+
+	if (threaded && particles->count * cb->spot_rows > cb->spots_capacity) {
+		particle_spot_t* spots = realloc(cb->spots, sizeof(particle_spot_t) * particles->count * cb->spot_rows);
+
+		if (spots == NULL)
+			return;
+
+		cb->spots = spots;
+		cb->spots_capacity = particles->count * cb->spot_rows;
+	}
+
+	if (chunks > cb->chunks_capacity) {
+		size_t* starts = realloc(cb->spot_starts, sizeof(size_t) * chunks * cb->bin_rows);
+
+		if (starts != NULL)
+			cb->spot_starts = starts;
+
+		size_t* ends = realloc(cb->spot_ends, sizeof(size_t) * chunks * cb->bin_rows);
+
+		if (ends != NULL)
+			cb->spot_ends = ends;
+
+		ubyte_t* cells = realloc(cb->spot_cells, chunks * PARTICLE_CELLS * PARTICLE_CELLS);
+
+		if (cells != NULL)
+			cb->spot_cells = cells;
+
+		if (starts == NULL || ends == NULL || cells == NULL)
+			return;
+
+		cb->chunks_capacity = chunks;
+	}
+
+	cb->particles = particles;
+	cb->lag = lag;
+	cb->spot_chunks = chunks;
+
+	/* sorting only pays off when rows are drawn in parallel */
+	if (threaded) {
+		run_execution(cb, EXECUTION_SORT_SPOTS, true);
+		run_execution(cb, EXECUTION_DRAW_SPOTS, true);
+	}
+	else {
+		for (size_t chunk = 0; chunk < chunks; chunk++)
+			draw_chunk(cb, chunk);
+	}
+
+	cb->particles = NULL;
+
+	/* cells touched by any chunk */
+	memcpy(touched, cb->spot_cells, sizeof(touched));
+
+	for (size_t chunk = 1; chunk < chunks; chunk++) {
+		for (size_t i = 0; i < PARTICLE_CELLS * PARTICLE_CELLS; i++)
+			touched[i] |= cb->spot_cells[(chunk * PARTICLE_CELLS * PARTICLE_CELLS) + i];
+	}
+
+	/* each run of touched cells of a row is one dirty region */
+	for (long_t row = 0; row < PARTICLE_CELLS; row++) {
+		for (long_t column = 0; column < PARTICLE_CELLS; column++) {
+			if (!touched[(row * PARTICLE_CELLS) + column])
+				continue;
+
+			long_t first = column;
+
+			while (column + 1 < PARTICLE_CELLS && touched[(row * PARTICLE_CELLS) + column + 1])
+				column++;
+
+			mark_dirty(fb, (vertice_t){ (first << cb->cell_shift_x) - margin, (row << cb->cell_shift_y) - margin },
+				(vertice_t){ ((column + 1) << cb->cell_shift_x) + margin, ((row + 1) << cb->cell_shift_y) + margin });
+		}
+	}
+#endif
+}
+
+/* terminate collision grid */
+void terminate_collision_grid(collision_grid_t* grid)
+{
+	if (grid != NULL) {
+		free(grid->cell_starts);
+		free(grid->cell_cursors);
+		free(grid->entries);
+		free(grid->boxes);
+		free(grid->collisions);
+		memset(grid, 0, sizeof(collision_grid_t));
+	}
+}
+
+/* initialize collision grid covering @resolution (entities outside are kept in border cells) */
+bool init_collision_grid(collision_grid_t* grid, const vertice_t resolution)
+{
+	bool success = false;
+
+	if (grid != NULL) {
+		memset(grid, 0, sizeof(collision_grid_t));
+
+		grid->columns = (size_t)MAX((resolution.x + GRID_CELL_SIZE - 1) / GRID_CELL_SIZE, 1);
+		grid->rows = (size_t)MAX((resolution.y + GRID_CELL_SIZE - 1) / GRID_CELL_SIZE, 1);
+		grid->cell_starts = malloc(sizeof(uint32_t) * ((grid->columns * grid->rows * 2) + 1));
+		grid->cell_cursors = malloc(sizeof(uint32_t) * grid->columns * grid->rows * 2);
+
+		success = (grid->cell_starts != NULL && grid->cell_cursors != NULL);
+
+		/* no entities until first build */
+		if (success)
+			memset(grid->cell_starts, 0, sizeof(uint32_t) * ((grid->columns * grid->rows * 2) + 1));
+	}
+
+	/* clean up if not successful */
+	if (!success)
+		terminate_collision_grid(grid);
+
+	return success;
+}
+
+/* check if boxes @a and @b (ends are exclusive) share any pixel */
+static bool rects_overlap(const rect_t* a, const rect_t* b)
+{
+	/* shared range on each axis must not be empty (empty boxes share nothing) */
+	return (MAX(a->start.x, b->start.x) < MIN(a->end.x, b->end.x) && MAX(a->start.y, b->start.y) < MIN(a->end.y, b->end.y));
+}
+
+/* find first and last cells touched by @box, clamped to grid */
+static void get_cell_range(const collision_grid_t* grid, const rect_t* box, vertice_t* first, vertice_t* last)
+{
+	first->x = MIN(MAX(box->start.x, 0) / GRID_CELL_SIZE, (long_t)grid->columns - 1);
+	first->y = MIN(MAX(box->start.y, 0) / GRID_CELL_SIZE, (long_t)grid->rows - 1);
+	last->x = MIN(MAX(box->end.x - 1, 0) / GRID_CELL_SIZE, (long_t)grid->columns - 1);
+	last->y = MIN(MAX(box->end.y - 1, 0) / GRID_CELL_SIZE, (long_t)grid->rows - 1);
+}
+
+/* get cell holding first pixel shared by @a and @b, pairs are only reported there even when both span many cells */
+static size_t get_overlap_cell(const collision_grid_t* grid, const rect_t* a, const rect_t* b)
+{
+	rect_t overlap = { { MAX(a->start.x, b->start.x), MAX(a->start.y, b->start.y) }, { 0, 0 }, a->color };
+	vertice_t first;
+	vertice_t last;
+
+	overlap.end = (vertice_t){ overlap.start.x + 1, overlap.start.y + 1 };
+	get_cell_range(grid, &overlap, &first, &last);
+
+	return (first.y * grid->columns) + first.x;
+}
+
+/* sort entities by cells their boxes touch and kind with a counting sort (entities are listed once per cell) */
+bool build_collision_grid(collision_grid_t* grid, const entities_t* entities)
+{
+	if (grid == NULL || entities == NULL || grid->cell_starts == NULL)
+		return false;
+
+	size_t buckets = grid->columns * grid->rows * 2;
+	size_t total = 0;
+
+	if (entities->count > grid->boxes_capacity) {
+		rect_t* boxes = realloc(grid->boxes, sizeof(rect_t) * entities->capacity);
+
+		if (boxes == NULL)
+			return false;
+
+		grid->boxes = boxes;
+		grid->boxes_capacity = entities->capacity;
+	}
+
+	memset(grid->cell_starts, 0, sizeof(uint32_t) * (buckets + 1));
+
+	/* count entries of each cell */
+	for (size_t i = 0; i < entities->count; i++) {
+		rect_t* box = &grid->boxes[i];
+		vertice_t first;
+		vertice_t last;
+
+		box->start = (vertice_t){ (long_t)(entities->coord_x[i] - entities->box_x[i]), (long_t)(entities->coord_y[i] - entities->box_y[i]) };
+		box->end = (vertice_t){ (long_t)(entities->coord_x[i] + entities->box_x[i]), (long_t)(entities->coord_y[i] + entities->box_y[i]) };
+		box->color = entities->colors[i];
+
+		get_cell_range(grid, box, &first, &last);
+
+		for (long_t row = first.y; row <= last.y; row++) {
+			for (long_t column = first.x; column <= last.x; column++)
+				grid->cell_starts[(((row * grid->columns) + column) * 2) + entities->kinds[i] + 1]++;
+		}
+	}
+
+	for (size_t i = 1; i <= buckets; i++) {
+		total += grid->cell_starts[i];
+		grid->cell_starts[i] = (uint32_t)total;
+	}
+
+	if (total > grid->entries_capacity) {
+		grid_entry_t* entries = realloc(grid->entries, sizeof(grid_entry_t) * total);
+
+		if (entries == NULL)
+			return false;
+
+		grid->entries = entries;
+		grid->entries_capacity = total;
+	}
+
+	memcpy(grid->cell_cursors, grid->cell_starts, sizeof(uint32_t) * buckets);
+
+	for (size_t i = 0; i < entities->count; i++) {
+		vertice_t first;
+		vertice_t last;
+
+		get_cell_range(grid, &grid->boxes[i], &first, &last);
+
+		for (long_t row = first.y; row <= last.y; row++) {
+			for (long_t column = first.x; column <= last.x; column++)
+				grid->entries[grid->cell_cursors[(((row * grid->columns) + column) * 2) + entities->kinds[i]]++] = (grid_entry_t){ grid->boxes[i], (uint32_t)i };
+		}
+	}
+
+	return true;
+}
+
+/* find every enemy overlapping a projectile on last build, stored on @grid->collisions */
+size_t find_collisions(collision_grid_t* grid, const entities_t* entities)
+{
+	if (grid == NULL || entities == NULL)
+		return 0;
+
+	grid->collisions_count = 0;
+
+	for (size_t cell = 0; cell < grid->columns * grid->rows; cell++) {
+		const uint32_t* bucket = grid->cell_starts + (cell * 2);
+
+		/* only enemies against projectiles of same cell */
+		for (uint32_t i = bucket[ENTITY_ENEMY]; i < bucket[ENTITY_ENEMY + 1]; i++) {
+			const grid_entry_t* enemy = &grid->entries[i];
+
+			for (uint32_t j = bucket[ENTITY_PROJECTILE]; j < bucket[ENTITY_PROJECTILE + 1]; j++) {
+				const grid_entry_t* projectile = &grid->entries[j];
+
+				if (!rects_overlap(&enemy->box, &projectile->box) || get_overlap_cell(grid, &enemy->box, &projectile->box) != cell)
+					continue;
+
+				if (grid->collisions_count == grid->collisions_capacity) {
+					size_t capacity = (grid->collisions_capacity > 0) ? grid->collisions_capacity * 2 : 64;
+					collision_t* collisions = realloc(grid->collisions, sizeof(collision_t) * capacity);
+
+					if (collisions == NULL)
+						return grid->collisions_count;
+
+					grid->collisions = collisions;
+					grid->collisions_capacity = capacity;
+				}
+
+				grid->collisions[grid->collisions_count++] = (collision_t){ enemy->entity, projectile->entity };
+			}
+		}
+	}
+
+	return grid->collisions_count;
+}
+
+/* find up to @max entities of @kind overlapping @box on last build, their indices are written to @found */
+size_t find_box_collisions(const collision_grid_t* grid, const entities_t* entities, const rect_t* box, const entity_kind_t kind, uint32_t* found, const size_t max)
+{
+	size_t count = 0;
+	vertice_t first;
+	vertice_t last;
+
+	if (grid == NULL || entities == NULL || box == NULL)
+		return 0;
+
+	get_cell_range(grid, box, &first, &last);
+
+	for (long_t row = first.y; row <= last.y; row++) {
+		for (long_t column = first.x; column <= last.x; column++) {
+			size_t cell = (row * grid->columns) + column;
+			size_t bucket = (cell * 2) + kind;
+
+			for (uint32_t i = grid->cell_starts[bucket]; i < grid->cell_starts[bucket + 1] && count < max; i++) {
+				const grid_entry_t* entry = &grid->entries[i];
+
+				if (rects_overlap(&entry->box, box) && get_overlap_cell(grid, &entry->box, box) == cell)
+					found[count++] = entry->entity;
+			}
+		}
+	}
+
+	return count;
+}
+
+/* clear screen (on Linux, starts a new frame and only clears what was drawn on last one) */
+void clear_screen(framebuffer_t* fb)
+{
+	if (fb != NULL) {
+#ifdef __WINDOWS__
+		RECT screen = { 0, 0, fb->resolution.x, fb->resolution.y };
+		HBRUSH brush = CreateSolidBrush(RGB(0, 0, 0));
+
+		FillRect(fb->device, &screen, brush);
+		DeleteObject(brush);
+#else
+		/* current frame becomes previous one */
+		for (size_t i = DIRTY_FRAMES - 1; i > 0; i--)
+			fb->dirty[i] = fb->dirty[i - 1];
+
+		fb->dirty[0].count = 0;
+
+		/* everything else on back buffer is already clear */
+		for (size_t i = 0; i < fb->dirty[1].count; i++) {
+			region_t region = fb->dirty[1].regions[i];
+			size_t length = (region.end.x - region.start.x) * fb->format.size;
+			ubyte_t* row = fb->buffer + (region.start.y * fb->fix_info.line_length) + (region.start.x * fb->format.size);
+
+			for (long_t y = region.start.y; y < region.end.y; y++, row += fb->fix_info.line_length)
+				memset(row, 0x0, length);
+
+			fb->cleared_bytes += length * (region.end.y - region.start.y);
+		}
+#endif
+	}
+}
+
+#ifndef __WINDOWS__
+/* copy @size bytes to device memory without polluting cache */
+static void stream_copy(ubyte_t* destination, const ubyte_t* source, size_t size)
+{
+#ifdef __SSE2_ARCH__
+	/* both buffers are page aligned, so only the tail can be unaligned */
+	if (((ulong_t)destination | (ulong_t)source) % 16 == 0) {
+		for (; size >= 64; size -= 64, destination += 64, source += 64) {
+			__m128i a = _mm_load_si128((const __m128i*)source);
+			__m128i b = _mm_load_si128((const __m128i*)(source + 16));
+			__m128i c = _mm_load_si128((const __m128i*)(source + 32));
+			__m128i d = _mm_load_si128((const __m128i*)(source + 48));
+
+			_mm_stream_si128((__m128i*)destination, a);
+			_mm_stream_si128((__m128i*)(destination + 16), b);
+			_mm_stream_si128((__m128i*)(destination + 32), c);
+			_mm_stream_si128((__m128i*)(destination + 48), d);
+		}
+
+		/* make streamed stores visible before panning */
+		_mm_sfence();
+	}
+#endif
+
+	memcpy(destination, source, size);
+}
+
+/* check @pattern has exactly one conversion of an unsigned long (e.g. %04lu) and no other (but %%) */
+static bool is_dump_pattern(const char* pattern)
+{
+	size_t conversions = 0;
+
+	for (const char* c = strchr(pattern, '%'); c != NULL; c = strchr(c, '%')) {
+		c++;
+
+		if (*c == '%') {
+			c++;
+			continue;
+		}
+
+		/* flags and width only, precision and other lengths are refused */
+		c += strspn(c, "-+ #0123456789");
+
+		if (c[0] != 'l' || c[1] == '\0' || strchr("uxXo", c[1]) == NULL)
+			return false;
+
+		c += 2;
+		conversions++;
+	}
+
+	return conversions == 1;
+}
+
+/* write page on screen as binary PPM to @path */
+static bool dump_screen(framebuffer_t* fb, const char* path)
+{
+	bool success = false;
+	FILE* file = fopen(path, "wb");
+	ubyte_t* line = malloc(fb->var_info.xres * 3);
+
+	if (file != NULL && line != NULL) {
+		const ubyte_t* page = fb->address + (fb->page * fb->buffer_size);
+
+		success = (fprintf(file, "P6\n%u %u\n255\n", fb->var_info.xres, fb->var_info.yres) > 0);
+
+		for (size_t y = 0; y < fb->var_info.yres && success; y++) {
+			const ubyte_t* pixel = page + (y * fb->fix_info.line_length);
+
+			for (size_t x = 0; x < fb->var_info.xres; x++, pixel += fb->format.size) {
+				uint32_t value = 0;
+
+				for (size_t i = 0; i < fb->format.size; i++)
+					value |= (uint32_t)pixel[i] << (i * 8);
+
+				/* unpack and widen each channel to 8 bits */
+				for (size_t i = 0; i < 3; i++) {
+					uint32_t channel = (value >> fb->format.shift[i]) & ((1u << fb->format.length[i]) - 1);
+
+					line[(x * 3) + i] = (fb->format.length[i] > 0) ? (ubyte_t)((channel * 255) / ((1u << fb->format.length[i]) - 1)) : 0;
+				}
+			}
+
+			success = (fwrite(line, 3, fb->var_info.xres, file) == fb->var_info.xres);
+		}
+	}
+
+	if (file != NULL)
+		fclose(file);
+
+	free(line);
+
+	return success;
+}
+#endif
+
+#ifndef __WINDOWS__
+/* copy to @page what changed since it was last shown (@age frames ago) */
+static void show_regions(framebuffer_t* fb, const size_t page, const size_t age)
+{
+	region_list_t changed = fb->dirty[0];
+
+	/* page still has what was drawn back then, and current frame covers the rest */
+	for (size_t i = 0; i < fb->dirty[age].count; i++)
+		add_region(&changed, fb->dirty[age].regions[i], get_screen_region(fb));
+
+	for (size_t i = 0; i < changed.count; i++) {
+		region_t region = changed.regions[i];
+		size_t offset = (region.start.y * fb->fix_info.line_length) + (region.start.x * fb->format.size);
+		size_t length = (region.end.x - region.start.x) * fb->format.size;
+
+		/* whole lines are copied at once */
+		if (length == fb->var_info.xres * fb->format.size && length == fb->fix_info.line_length)
+			stream_copy(fb->address + (page * fb->buffer_size) + offset, fb->buffer + offset, length * (region.end.y - region.start.y));
+		else {
+			for (long_t y = region.start.y; y < region.end.y; y++, offset += fb->fix_info.line_length)
+				stream_copy(fb->address + (page * fb->buffer_size) + offset, fb->buffer + offset, length);
+		}
+
+		fb->shown_bytes += length * (region.end.y - region.start.y);
+	}
+}
+#endif
+
+/* show back buffer on screen */
+void present_screen(framebuffer_t* fb)
+{
+	if (fb != NULL) {
+#ifndef __WINDOWS__
+		/* NOTE: windows draws straight into the window device */
+		if (fb->buffer != NULL) {
+			if (fb->present == PRESENT_FLIP) {
+				size_t page = (fb->page + 1) % 2;
+
+				/* fill hidden page then make it visible */
+				show_regions(fb, page, 2);
+
+				if (fb->vsync && fb->backend == BACKEND_DEVICE) {
+					__u32 crtc = 0;
+					ioctl(fb->fd, FBIO_WAITFORVSYNC, &crtc);
+				}
+
+				fb->var_info.xoffset = 0;
+				fb->var_info.yoffset = page * fb->var_info.yres;
+
+				/* memory pages are "shown" by just switching page */
+				if (fb->backend == BACKEND_MEMORY || !ioctl(fb->fd, FBIOPAN_DISPLAY, &fb->var_info))
+					fb->page = page;
+				else {
+					/* driver can't pan, keep copying to visible page */
+					fb->present = PRESENT_COPY;
+				}
+			}
+			else
+				show_regions(fb, fb->page, 1);
+
+			/* keep frames of memory screen as images */
+			if (fb->backend == BACKEND_MEMORY && fb->dump_path != NULL) {
+				char path[BUFSIZ];
+
+				snprintf(path, sizeof(path), fb->dump_path, (unsigned long)fb->dump_count++);
+				dump_screen(fb, path);
+			}
+		}
+#endif
+	}
+}
+
+#ifndef __WINDOWS__
+/* write all @size bytes of @data to @fd */
+static bool write_all(const int fd, const ubyte_t* data, size_t size)
+{
+	while (size > 0) {
+		ssize_t written = write(fd, data, size);
+
+		if (written == -1 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+
+		data += written;
+		size -= (size_t)written;
+	}
+
+	return true;
+}
+
+#ifdef __SSE2_ARCH__
+/* add pairs of 32-bit sums of @a and @b (madd results of two pixels each) */
+static inline __m128i add_capture_pairs(const __m128i a, const __m128i b)
+{
+	__m128 even = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0));
+	__m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1));
+
+	return _mm_add_epi32(_mm_castps_si128(even), _mm_castps_si128(odd));
+}
+
+/* convert 2x4 pixel blocks of 32-bit rows @top and @bottom, return first column left (same results as scalar path) */
+static size_t convert_capture_blocks(const capture_t* capture, const ubyte_t* top, const ubyte_t* bottom, ubyte_t* luma, ubyte_t* blue, ubyte_t* red)
+{
+	const int16_t weights[3][3] = { { 66, 129, 25 }, { -38, -74, 112 }, { 112, -94, -18 } };
+	int16_t coefficients[3][8];
+	size_t width = (size_t)capture->resolution.x;
+
+	/* weights placed on bytes of each channel, for two pixels */
+	memset(coefficients, 0, sizeof(coefficients));
+
+	for (size_t i = 0; i < 3; i++) {
+		for (size_t j = 0; j < 3; j++) {
+			coefficients[i][capture->shifts[j] / 8] = weights[i][j];
+			coefficients[i][4 + (capture->shifts[j] / 8)] = weights[i][j];
+		}
+	}
+
+	__m128i zero = _mm_setzero_si128();
+	__m128i luma_weights = _mm_loadu_si128((const __m128i*)coefficients[0]);
+	__m128i blue_weights = _mm_loadu_si128((const __m128i*)coefficients[1]);
+	__m128i red_weights = _mm_loadu_si128((const __m128i*)coefficients[2]);
+	__m128i luma_bias = _mm_set1_epi32(128 + (16 << 8));
+	__m128i chroma_bias = _mm_set1_epi32((128 << 10) + 512);
+
+	size_t x = 0;
+
+	for (; x + 4 <= width; x += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(top + (x * 4)));
+		__m128i b = _mm_loadu_si128((const __m128i*)(bottom + (x * 4)));
+		__m128i a_low = _mm_unpacklo_epi8(a, zero);
+		__m128i a_high = _mm_unpackhi_epi8(a, zero);
+		__m128i b_low = _mm_unpacklo_epi8(b, zero);
+		__m128i b_high = _mm_unpackhi_epi8(b, zero);
+
+		/* four luma values of each row */
+		__m128i top_luma = add_capture_pairs(_mm_madd_epi16(a_low, luma_weights), _mm_madd_epi16(a_high, luma_weights));
+		__m128i bottom_luma = add_capture_pairs(_mm_madd_epi16(b_low, luma_weights), _mm_madd_epi16(b_high, luma_weights));
+		__m128i lumas = _mm_packus_epi16(_mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(top_luma, luma_bias), 8), _mm_srai_epi32(_mm_add_epi32(bottom_luma, luma_bias), 8)), zero);
+		int32_t values[2] = { _mm_cvtsi128_si32(lumas), _mm_cvtsi128_si32(_mm_srli_si128(lumas, 4)) };
+
+		memcpy(luma + x, &values[0], 4);
+		memcpy(luma + width + x, &values[1], 4);
+
+		/* channel sums of two 2x2 blocks */
+		__m128i low = _mm_add_epi16(a_low, b_low);
+		__m128i high = _mm_add_epi16(a_high, b_high);
+		__m128i blocks = _mm_unpacklo_epi64(_mm_add_epi16(low, _mm_srli_si128(low, 8)), _mm_add_epi16(high, _mm_srli_si128(high, 8)));
+
+		/* blue difference of both blocks, then red difference */
+		__m128i chroma = add_capture_pairs(_mm_madd_epi16(blocks, blue_weights), _mm_madd_epi16(blocks, red_weights));
+
+		chroma = _mm_packus_epi16(_mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(chroma, chroma_bias), 10), zero), zero);
+
+		int32_t chromas = _mm_cvtsi128_si32(chroma);
+
+		blue[x / 2] = (ubyte_t)chromas;
+		blue[(x / 2) + 1] = (ubyte_t)(chromas >> 8);
+		red[x / 2] = (ubyte_t)(chromas >> 16);
+		red[(x / 2) + 1] = (ubyte_t)(chromas >> 24);
+	}
+
+	return x;
+}
+#endif
+
+/* convert captured @frame to FRAME record (BT.601 studio range, chroma averaged over 2x2 pixels) */
+static void convert_capture_frame(capture_t* capture, const ubyte_t* frame)
+{
+	/* NOTE: layout is copied to locals, stores to planes could alias it */
+	const size_t width = (size_t)capture->resolution.x;
+	const size_t height = (size_t)capture->resolution.y;
+	const size_t line_length = capture->line_length;
+	const size_t pixel_size = capture->pixel_size;
+	const size_t offsets[3] = { capture->shifts[0] / 8, capture->shifts[1] / 8, capture->shifts[2] / 8 };
+	const bool direct = capture->direct;
+	const size_t chroma_width = (width + 1) / 2;
+	ubyte_t* luma = capture->record + 6;
+	ubyte_t* blue = luma + (width * height);
+	ubyte_t* red = blue + (chroma_width * ((height + 1) / 2));
+
+	/* last row and column are repeated on odd sizes */
+	for (size_t y = 0; y < height; y += 2) {
+		size_t rows[2] = { y, MIN(y + 1, height - 1) };
+		size_t x = 0;
+
+#ifdef __SSE2_ARCH__
+		if (direct && rows[1] != rows[0])
+			x = convert_capture_blocks(capture, frame + (y * line_length), frame + ((y + 1) * line_length), luma + (y * width), blue + ((y / 2) * chroma_width), red + ((y / 2) * chroma_width));
+#endif
+
+		for (; x < width; x += 2) {
+			size_t columns[2] = { x, MIN(x + 1, width - 1) };
+			int32_t sums[3] = { 0, 0, 0 };
+
+			for (size_t i = 0; i < 4; i++) {
+				const ubyte_t* pixel = frame + (rows[i / 2] * line_length) + (columns[i % 2] * pixel_size);
+				int32_t rgb[3];
+
+				/* 8-bit channels are read straight from their bytes */
+				if (direct) {
+					rgb[0] = pixel[offsets[0]];
+					rgb[1] = pixel[offsets[1]];
+					rgb[2] = pixel[offsets[2]];
+				}
+				else {
+					uint32_t value = 0;
+
+					for (size_t j = 0; j < pixel_size; j++)
+						value |= (uint32_t)pixel[j] << (j * 8);
+
+					for (size_t j = 0; j < 3; j++)
+						rgb[j] = capture->widen[j][(value >> capture->shifts[j]) & 0xFF];
+				}
+
+				luma[(rows[i / 2] * width) + columns[i % 2]] = (ubyte_t)((((66 * rgb[0]) + (129 * rgb[1]) + (25 * rgb[2]) + 128) >> 8) + 16);
+				sums[0] += rgb[0];
+				sums[1] += rgb[1];
+				sums[2] += rgb[2];
+			}
+
+			/* sums of four pixels, offset keeps them positive before shifting */
+			blue[((y / 2) * chroma_width) + (x / 2)] = (ubyte_t)(((-38 * sums[0]) - (74 * sums[1]) + (112 * sums[2]) + (128 << 10) + 512) >> 10);
+			red[((y / 2) * chroma_width) + (x / 2)] = (ubyte_t)(((112 * sums[0]) - (94 * sums[1]) - (18 * sums[2]) + (128 << 10) + 512) >> 10);
+		}
+	}
+}
+
+/* write frames of ring until capture stops (thread entry) */
+static void* run_capture_writer(void* arg)
+{
+	capture_t* capture = arg;
+
+	pthread_mutex_lock(&capture->lock);
+
+	while (true) {
+		while (capture->head == capture->tail && !capture->quit)
+			pthread_cond_wait(&capture->signal, &capture->lock);
+
+		/* frames left are written before stopping */
+		if (capture->head == capture->tail)
+			break;
+
+		const ubyte_t* frame = capture->slots + ((capture->tail % CAPTURE_SLOTS) * capture->slot_size);
+
+		bool written = false;
+
+		pthread_mutex_unlock(&capture->lock);
+
+		if (!capture->failed) {
+			convert_capture_frame(capture, frame);
+
+			written = write_all(capture->fd, capture->record, capture->record_size);
+
+			if (!written)
+				fprintf(stderr, "can't write capture (%s), frames left are dropped\n", strerror(errno));
+		}
+
+		pthread_mutex_lock(&capture->lock);
+		capture->failed = !written;
+		capture->captured += written;
+		capture->dropped += !written;
+		capture->tail++;
+	}
+
+	pthread_mutex_unlock(&capture->lock);
+
+	return NULL;
+}
+#endif
+
+/* write frames left and stop capture */
+void terminate_capture(capture_t* capture)
+{
+	if (capture != NULL) {
+#ifndef __WINDOWS__
+		if (capture->fd != -1) {
+			pthread_mutex_lock(&capture->lock);
+			capture->quit = true;
+			pthread_cond_signal(&capture->signal);
+			pthread_mutex_unlock(&capture->lock);
+
+			pthread_join(capture->thread, NULL);
+			pthread_cond_destroy(&capture->signal);
+			pthread_mutex_destroy(&capture->lock);
+
+			close(capture->fd);
+			capture->fd = -1;
+		}
+
+		free(capture->slots);
+		free(capture->record);
+
+		capture->slots = NULL;
+		capture->record = NULL;
+#endif
+	}
+}
+
+/* start capturing frames of @fb to Y4M file at @path at @frame_rate (nothing is captured if @path is NULL, unpaced frames can't be) */
+bool init_capture(capture_t* capture, framebuffer_t* fb, const char* path, const double frame_rate)
+{
+	bool success = false;
+
+	if (capture != NULL && fb != NULL) {
+		memset(capture, 0, sizeof(capture_t));
+
+#ifdef __WINDOWS__
+		/* NOTE: windows draws straight into the window, there's no back buffer to copy */
+		success = (path == NULL);
+#else
+		capture->fd = -1;
+
+		if (path == NULL)
+			return true;
+
+		/* NOTE: Y4M has one fixed frame rate, unpaced frames (HARVEST_FPS=0) have none */
+		if (frame_rate <= 0.0)
+			return false;
+
+		size_t width = fb->var_info.xres;
+		size_t height = fb->var_info.yres;
+		char header[128];
+		int size = snprintf(header, sizeof(header), "YUV4MPEG2 W%lu H%lu F%lu:1 Ip A1:1 C420jpeg\n", (unsigned long)width, (unsigned long)height,
+			(unsigned long)(frame_rate + 0.5));
+
+		capture->resolution = (vertice_t){ (long_t)width, (long_t)height };
+		capture->line_length = fb->fix_info.line_length;
+		capture->pixel_size = fb->format.size;
+		capture->slot_size = fb->buffer_size;
+		capture->record_size = 6 + (width * height) + (2 * ((width + 1) / 2) * ((height + 1) / 2));
+
+		/* keep 8 most significant bits of each channel and precompute widening */
+		for (size_t i = 0; i < 3; i++) {
+			size_t bits = MIN(fb->format.length[i], 8);
+
+			capture->shifts[i] = (ubyte_t)(fb->format.shift[i] + fb->format.length[i] - bits);
+
+			for (size_t value = 0; value < 256; value++)
+				capture->widen[i][value] = (bits > 0) ? (ubyte_t)(((value & ((1u << bits) - 1)) * 255) / ((1u << bits) - 1)) : 0;
+		}
+
+		capture->direct = is_blend_format(&fb->format);
+		capture->slots = malloc(capture->slot_size * CAPTURE_SLOTS);
+		capture->record = malloc(capture->record_size);
+
+		if (capture->slots != NULL && capture->record != NULL && fb->buffer != NULL && (capture->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) != -1) {
+			memcpy(capture->record, "FRAME\n", 6);
+
+			if (write_all(capture->fd, (const ubyte_t*)header, (size_t)size) && !pthread_mutex_init(&capture->lock, NULL)) {
+				if (!pthread_cond_init(&capture->signal, NULL)) {
+					if (!pthread_create(&capture->thread, NULL, &run_capture_writer, capture))
+						success = true;
+					else
+						pthread_cond_destroy(&capture->signal);
+				}
+
+				if (!success)
+					pthread_mutex_destroy(&capture->lock);
+			}
+
+			if (!success) {
+				close(capture->fd);
+				capture->fd = -1;
+			}
+		}
+#endif
+
+		if (!success)
+			terminate_capture(capture);
+	}
+
+	return success;
+}
+
+/* copy back buffer of @fb to capture ring (frame is dropped if writer is behind or failed) */
+void capture_frame(capture_t* capture, const framebuffer_t* fb)
+{
+#ifndef __WINDOWS__
+	if (capture == NULL || fb == NULL || capture->fd == -1)
+		return;
+
+	/* only calling thread moves head, writer only moves tail */
+	pthread_mutex_lock(&capture->lock);
+	bool drop = (capture->head - capture->tail == CAPTURE_SLOTS || capture->failed);
+	capture->dropped += drop;
+	pthread_mutex_unlock(&capture->lock);
+
+	if (drop)
+		return;
+
+	memcpy(capture->slots + ((capture->head % CAPTURE_SLOTS) * capture->slot_size), fb->buffer, capture->slot_size);
+
+	pthread_mutex_lock(&capture->lock);
+	capture->head++;
+	pthread_cond_signal(&capture->signal);
+	pthread_mutex_unlock(&capture->lock);
+#else
+	(void)capture;
+	(void)fb;
+#endif
+}
+
+#ifndef __WINDOWS__
+/* get primary display output name */
+bool get_active_display_name(char* name, const size_t name_sz)
+{
+	bool success = false;
+
+	/* get primary display name and output to tmp file */
+	system("xrandr | grep \" connected primary\" | awk '{ print $1 }' >/tmp/harvest_config");
+
+	char line[name_sz];
+	FILE* file = fopen("/tmp/harvest_config", "r");
+
+	if (file != NULL) {
+		/* get file stored string */
+		if ((fgets(line, name_sz, file)) != NULL) {
+			for (int i = 0; i < name_sz; i++) {
+				if (line[i] != '\n')
+					name[i] = line[i];
+				else {
+					name[i] = '\0';
+					break;
+				}
+			}
+
+			success = true;
+		}
+
+		/* clean up */
+		fclose(file);
+	}
+
+	/* remove temporary file */
+	remove("/tmp/harvest_config");
+
+	return success;
+}
+#endif
+
+/* calculate box position and size due to scaling */
+rect_t get_scaled_box(framebuffer_t* fb, const long_t left, const long_t top, const long_t bottom, const long_t right, const color_t color)
+{
+	rect_t rect = { { left, top }, { right, bottom }, color };
+
+	if (fb != NULL) {
+#ifdef __WINDOWS__
+		rect.start.y *= fb->resolution.y / BASE_RESOLUTION_HEIGHT;
+		rect.start.x *= fb->resolution.x / BASE_RESOLUTION_HEIGHT;
+		rect.end.y *= rect.start.y / top;
+		rect.end.x *= (rect.start.x / left) / ((fb->resolution.x / fb->resolution.y) / BASE_ASPECT_RATIO);
+#else
+		rect.start.y *= fb->var_info.yres / BASE_RESOLUTION_HEIGHT;
+		rect.start.x *= fb->var_info.xres / BASE_RESOLUTION_HEIGHT;
+		rect.end.y *= rect.start.y / top;
+		rect.end.x *= (rect.start.x / left) / ((fb->var_info.xres / fb->var_info.yres) / BASE_ASPECT_RATIO);
+#endif
+	}
+
+	return rect;
+}
+
+#ifndef __WINDOWS__
+/* open /dev/fb0 and ask for 32-bit pixels and two pages */
+static bool map_device_framebuffer(framebuffer_t* fb)
+{
+	bool success = false;
+
+	/* NOTE: this is not the finest approach but it is the fastest */
+	/* set system default frame buffer */
+	system("export FRAMEBUFFER=/dev/fb0");
+
+	/* open frame buffer file */
+	if ((fb->fd = open("/dev/fb0", O_RDWR)) != -1) {
+		if (!ioctl(fb->fd, FBIOGET_VSCREENINFO, &fb->var_info)) {
+			/* make copy of original variable information */
+			memcpy(&fb->orig_var_info, &fb->var_info, sizeof(struct fb_var_screeninfo));
+
+			/* change buffer info */
+			fb->var_info.grayscale = 0;
+
+			/* ask for 32-bit pixels (driver reports the layout it actually uses) */
+			set_pixel_format(&fb->var_info, "XRGB8888");
+			fb->var_info.xoffset = 0;
+			fb->var_info.yoffset = 0;
+			fb->var_info.activate |= FB_ACTIVATE_NOW | FB_ACTIVATE_FORCE;
+
+			bool applied = false;
+
+			/* ask for two pages to flip between */
+			if (fb->present == PRESENT_FLIP) {
+				fb->var_info.yres_virtual = fb->var_info.yres * 2;
+				applied = (!ioctl(fb->fd, FBIOPUT_VSCREENINFO, &fb->var_info) && fb->var_info.yres_virtual >= fb->var_info.yres * 2);
+
+				if (!applied) {
+					fb->var_info.yres_virtual = fb->var_info.yres;
+					fb->present = PRESENT_COPY;
+				}
+			}
+
+			/* line length may change with new depth */
+			if ((applied || !ioctl(fb->fd, FBIOPUT_VSCREENINFO, &fb->var_info)) && !ioctl(fb->fd, FBIOGET_FSCREENINFO, &fb->fix_info)) {
+				/* get size of buffer */
+				fb->size = fb->fix_info.smem_len;
+
+				/* map buffer to memory */
+				if ((fb->address = mmap(0, fb->size, PROT_READ | PROT_WRITE, MAP_SHARED, fb->fd, 0)) == MAP_FAILED)
+					fb->address = NULL;
+				else
+					success = true;
+			}
+		}
+	}
+
+	return success;
+}
+
+/* map two pages of memory (anonymous or shared by name) instead of a display */
+static bool map_memory_framebuffer(framebuffer_t* fb)
+{
+	bool success = false;
+	const char* size = getenv("HARVEST_SIZE");
+	const char* format = getenv("HARVEST_FORMAT");
+	unsigned long width = MEMORY_WIDTH;
+	unsigned long height = MEMORY_HEIGHT;
+
+	if (size != NULL && (sscanf(size, "%lux%lu", &width, &height) != 2 || width == 0 || height == 0))
+		return false;
+
+	memset(&fb->var_info, 0, sizeof(struct fb_var_screeninfo));
+	memset(&fb->fix_info, 0, sizeof(struct fb_fix_screeninfo));
+
+	if (set_pixel_format(&fb->var_info, (format != NULL) ? format : "XRGB8888")) {
+		fb->var_info.xres = fb->var_info.xres_virtual = width;
+		fb->var_info.yres = height;
+		fb->var_info.yres_virtual = height * 2;
+
+		/* keep lines aligned for wide stores */
+		fb->fix_info.line_length = ((width * (fb->var_info.bits_per_pixel / 8)) + 63) & ~63u;
+		fb->fix_info.smem_len = fb->fix_info.line_length * fb->var_info.yres_virtual;
+		fb->size = fb->fix_info.smem_len;
+
+		memcpy(&fb->orig_var_info, &fb->var_info, sizeof(struct fb_var_screeninfo));
+
+		/* other processes may map pages by name to watch frames */
+		if (fb->shm_name != NULL) {
+			if ((fb->fd = shm_open(fb->shm_name, O_RDWR | O_CREAT, 0600)) != -1 && !ftruncate(fb->fd, fb->size))
+				fb->address = mmap(0, fb->size, PROT_READ | PROT_WRITE, MAP_SHARED, fb->fd, 0);
+		}
+		else
+			fb->address = mmap(0, fb->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+		if (fb->address == MAP_FAILED)
+			fb->address = NULL;
+
+		success = (fb->address != NULL);
+	}
+
+	return success;
+}
+#endif
+
+/* terminate screen frame buffer for full screen */
+void terminate_screen_framebuffer(framebuffer_t* fb)
+{
+	if (fb != NULL) {
+#ifdef __WINDOWS__
+		if (fb->window != NULL) {
+			SetWindowLongPtr(fb->window, GWL_STYLE, WS_OVERLAPPEDWINDOW);
+			SetWindowLongPtr(fb->window, GWL_EXSTYLE, WS_EX_OVERLAPPEDWINDOW);
+			ShowWindow(fb->window, SW_SHOWDEFAULT);
+			MoveWindow(fb->window, 0, 0, 480, 360, true);
+
+			if (fb->device != NULL) {
+				ReleaseDC(fb->window, fb->device);
+				DeleteDC(fb->device);
+			}
+		}
+#else
+		if (fb->address != NULL) {
+			munmap(fb->address, fb->size);
+			fb->address = NULL;
+		}
+		if (fb->buffer != NULL) {
+			free(fb->buffer);
+			fb->buffer = NULL;
+		}
+
+		if (fb->backend == BACKEND_MEMORY) {
+			if (fb->fd != -1) {
+				close(fb->fd);
+				shm_unlink(fb->shm_name);
+				fb->fd = -1;
+			}
+		}
+		else {
+			if (fb->fd != -1) {
+				/* restores original resolution and panning */
+				fb->orig_var_info.activate |= FB_ACTIVATE_NOW | FB_ACTIVATE_FORCE;
+				ioctl(fb->fd, FBIOPUT_VSCREENINFO, &fb->orig_var_info);
+				close(fb->fd);
+				fb->fd = -1;
+			}
+
+			/* get current output display */
+			char display[MAX_DISPLAY_NAME];
+
+			if (get_active_display_name(display, MAX_DISPLAY_NAME)) {
+				char cmd[BUFSIZ];
+
+				/* refresh display output */
+				sprintf(cmd, "xrandr --output %s --off && xrandr --output %s --auto", display, display);
+				system(cmd);
+			}
+		}
+#endif
+	}
+}
+
+/* initialize screen frame buffer for full screen (on Linux, @fb->backend chooses display or memory) */
+bool init_screen_framebuffer(framebuffer_t* fb)
+{
+	bool success = false;
+
+	if (fb != NULL) {
+#ifdef __WINDOWS__
+		/* get window and device */
+		if ((fb->window = GetConsoleWindow()) != NULL) {
+			/* modify styles */
+			fb->win_style = GetWindowLongPtr(fb->window, GWL_STYLE);
+			fb->win_style &= ~WS_BORDER;
+			fb->win_style &= ~WS_DLGFRAME;
+			fb->win_style &= ~WS_THICKFRAME;
+
+			fb->win_ext_style = GetWindowLongPtr(fb->window, GWL_EXSTYLE);
+			fb->win_ext_style &= ~WS_EX_WINDOWEDGE;
+
+			/* set new styles */
+			SetWindowLongPtr(fb->window, GWL_STYLE, fb->win_style | WS_POPUP);
 			SetWindowLongPtr(fb->window, GWL_EXSTYLE, fb->win_ext_style | WS_EX_TOPMOST);
 
-			/* get screen size */
-			fb->resolution.x = GetSystemMetrics(SM_CXSCREEN);
-			fb->resolution.y = GetSystemMetrics(SM_CYSCREEN);
+			/* get screen size */
+			fb->resolution.x = GetSystemMetrics(SM_CXSCREEN);
+			fb->resolution.y = GetSystemMetrics(SM_CYSCREEN);
+
+			fb->size = fb->resolution.x * fb->resolution.y;
+
+			/* resize window (windowed full screen) */
+			/* FIXME: not resizing well if already maximized */
+			MoveWindow(fb->window, 0, 0, fb->resolution.x, fb->resolution.y, true);
+			ShowWindow(fb->window, SW_SHOWMAXIMIZED);
+
+			success = ((fb->device = GetDC(fb->window)) != NULL);
+		}
+#else
+		const char* backend = getenv("HARVEST_BACKEND");
+		const char* present = getenv("HARVEST_PRESENT");
+		const char* vsync = getenv("HARVEST_VSYNC");
+
+		if (backend != NULL && strcmp(backend, "memory") == 0)
+			fb->backend = BACKEND_MEMORY;
+
+		fb->fd = -1;
+		fb->address = NULL;
+		fb->buffer = NULL;
+		fb->page = 0;
+		fb->present = (present != NULL && strcmp(present, "copy") == 0) ? PRESENT_COPY : PRESENT_FLIP;
+		fb->vsync = (vsync != NULL && strcmp(vsync, "0") != 0);
+		fb->shm_name = getenv("HARVEST_SHM");
+		fb->dump_path = getenv("HARVEST_DUMP");
+		fb->dump_count = 0;
+
+		/* pattern is a printf format, anything but one frame number would read missing arguments */
+		if (fb->dump_path != NULL && !is_dump_pattern(fb->dump_path))
+			fprintf(stderr, "HARVEST_DUMP needs exactly one frame number conversion such as %%04lu\n");
+		else if ((fb->backend == BACKEND_MEMORY) ? map_memory_framebuffer(fb) : map_device_framebuffer(fb)) {
+			fb->writer = (find_pixel_format(&fb->var_info, &fb->format)) ? &pixel_writers[fb->format.size] : NULL;
+			fb->buffer_size = fb->fix_info.line_length * fb->var_info.yres;
+
+			/* video memory may be smaller than requested pages */
+			if (fb->buffer_size * 2 > fb->size)
+				fb->present = PRESENT_COPY;
+
+			/* allocate back buffer */
+			if (!posix_memalign((void**)&fb->buffer, 4096, fb->buffer_size))
+				success = (fb->buffer_size <= fb->size && fb->writer != NULL);
+			else
+				fb->buffer = NULL;
+
+			/* pages start with whatever was on screen */
+			if (success) {
+				memset(fb->buffer, 0x0, fb->buffer_size);
+				invalidate_screen(fb);
+
+				fb->cleared_bytes = 0;
+				fb->shown_bytes = 0;
+			}
+		}
+#endif
+	}
+
+	/* clean up if not successful */
+	if (!success)
+		terminate_screen_framebuffer(fb);
+
+	return success;
+}
+
+/* change terminal mode and return old one */
+console_mode_t set_cli_input_mode(const console_mode_t mode)
+{
+	console_mode_t old_mode;
+
+#ifdef __WINDOWS__
+	HANDLE console = GetStdHandle(STD_INPUT_HANDLE);
+
+	if (GetConsoleMode(console, &old_mode))
+		SetConsoleMode(console, mode);
+#else
+	if (!tcgetattr(STDIN_FILENO, &old_mode))
+		tcsetattr(STDIN_FILENO, TCSANOW, &mode);
+#endif
+
+	return old_mode;
+}
+
+/* change terminal mode to raw and return old one */
+console_mode_t set_cli_raw_mode()
+{
+	console_mode_t mode;
+
+#ifdef __WINDOWS__
+	SetConsoleTitle("Harvest");
+
+	mode = ~(ENABLE_LINE_INPUT | ENABLE_PROCESSED_INPUT | ENABLE_WINDOW_INPUT | ENABLE_INSERT_MODE);
+#else
+	cfmakeraw(&mode);
+#endif
+
+	return set_cli_input_mode(mode);
+}
+
+/* change cli output cursor status */
+void show_cli_output_cursor(const bool show)
+{
+#ifdef __WINDOWS__
+	CONSOLE_CURSOR_INFO info = (show) ? (CONSOLE_CURSOR_INFO){ 25, true } : (CONSOLE_CURSOR_INFO){ 1, false };
+
+	SetConsoleCursorInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info);
+#else
+	if (show)
+		printf("\e[?25h");
+	else
+		printf("\e[?25l");
+#endif
+}
+
+/* set cli cursor position */
+void set_cli_cursor_pos(const size_t column, const size_t row)
+{
+#ifdef __WINDOWS__
+	COORD position = { (short)column, (short)row };
+
+	SetConsoleCursorPosition(GetStdHandle(STD_OUTPUT_HANDLE), position);
+#else
+	printf("\e[%d;%dH", row, column);
+#endif
+}
+
+/* get cli size */
+vertice_t get_cli_size()
+{
+	vertice_t size = { 0, 0 };
+
+#ifdef __WINDOWS__
+	CONSOLE_SCREEN_BUFFER_INFO info;
+
+	if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) {
+		size.x = info.dwSize.X;
+		size.y = info.dwSize.Y;
+	}
+#else
+	struct winsize win_sz;
+	
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &win_sz) != -1) {
+		size.x = win_sz.ws_col;
+		size.y = win_sz.ws_row;
+	}
+#endif
+
+	return size;
+}
+
+/* clear cli output stream */
+void clear_cli()
+{
+#ifdef __WINDOWS__
+	HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+	CONSOLE_SCREEN_BUFFER_INFO info;
+
+	if(GetConsoleScreenBufferInfo(console, &info)) {
+		COORD pos = { 0, 0 };
+		DWORD written;
+		DWORD size = info.dwSize.X * info.dwSize.Y;
+
+		/* fill console screen */
+		FillConsoleOutputCharacter(console, (TCHAR)' ', size, pos, &written);
+
+		/* set console attributer */
+		FillConsoleOutputAttribute(console, info.wAttributes, size, pos, &written);
+
+		/* reset cursor */
+		set_cli_cursor_pos(0, 0);
+	}
+#else
+	system("clear && printf '\e[3J'");
+#endif
+}
+
+/* resize cell grids, every cell is written again on next present */
+bool resize_cli_grid(console_t* cli, const vertice_t size)
+{
+	bool success = false;
+
+	if (cli != NULL && size.x > 0 && size.y > 0) {
+		size_t count = (size_t)size.x * size.y;
+		cli_cell_t* cells = realloc(cli->cells, sizeof(cli_cell_t) * count * 2);
+
+		if (cells != NULL) {
+			cli->cells = cells;
+			cli->shown = cells + count;
+			cli->grid_size = size;
+
+			/* blank cells, console holds glyph 0 (never written) so nothing matches it */
+			memset(cells, 0, sizeof(cli_cell_t) * count * 2);
+
+			for (size_t i = 0; i < count; i++)
+				cli->cells[i].glyph = ' ';
+
+			success = true;
+		}
+	}
+
+	return success;
+}
+
+/* free cell grids and output */
+void terminate_cli_grid(console_t* cli)
+{
+	if (cli != NULL) {
+		free(cli->cells);
+		free(cli->output);
+
+		cli->cells = NULL;
+		cli->shown = NULL;
+		cli->grid_size = (vertice_t){ 0, 0 };
+		cli->output = NULL;
+		cli->output_size = 0;
+		cli->output_capacity = 0;
+	}
+}
+
+/* set glyph and style of cell at @column and @row (out of grid is ignored) */
+void put_cli_cell(console_t* cli, const long_t column, const long_t row, const uint32_t glyph, const print_style_t style)
+{
+	if (cli != NULL && column >= 0 && row >= 0 && column < cli->grid_size.x && row < cli->grid_size.y)
+		cli->cells[row * cli->grid_size.x + column] = (cli_cell_t){ glyph, style };
+}
+
+/* put UTF-8 @text into cells starting at @column and @row */
+void put_cli_text(console_t* cli, long_t column, const long_t row, const char* text, const print_style_t style)
+{
+	if (text != NULL) {
+		for (const ubyte_t* c = (const ubyte_t*)text; *c != '\0'; column++) {
+			uint32_t glyph = *c++;
+			size_t trailing = (glyph >= 0xF0) ? 3 : (glyph >= 0xE0) ? 2 : (glyph >= 0xC0) ? 1 : 0;
+
+			/* drop length bits of leading byte, take 6 bits of each trailing one */
+			glyph &= (trailing > 0) ? 0x3F >> trailing : 0x7F;
+
+			for (; trailing > 0 && (*c & 0xC0) == 0x80; trailing--)
+				glyph = (glyph << 6) | (*c++ & 0x3F);
+
+			put_cli_cell(cli, column, row, glyph, style);
+		}
+	}
+}
+
+/* whether two cells look the same on console */
+static bool same_cli_cell(const cli_cell_t* a, const cli_cell_t* b)
+{
+	return a->glyph == b->glyph && a->style.decoration == b->style.decoration && !memcmp(&a->style.foreground, &b->style.foreground, sizeof(color_t)) && !memcmp(&a->style.background, &b->style.background, sizeof(color_t));
+}
+
+#ifndef __WINDOWS__
+/* append @size bytes to output of present */
+static bool append_cli_output(console_t* cli, const char* bytes, const size_t size)
+{
+	if (cli->output_size + size > cli->output_capacity) {
+		size_t capacity = (cli->output_capacity > 0) ? cli->output_capacity : BUFSIZ;
+
+		while (capacity < cli->output_size + size)
+			capacity *= 2;
+
+		char* output = realloc(cli->output, capacity);
+
+		if (output == NULL)
+			return false;
+
+		cli->output = output;
+		cli->output_capacity = capacity;
+	}
+
+	memcpy(cli->output + cli->output_size, bytes, size);
+	cli->output_size += size;
+
+	return true;
+}
+
+/* encode code point as UTF-8 and return its size */
+static size_t encode_utf8(const uint32_t glyph, char* bytes)
+{
+	if (glyph < 0x80) {
+		bytes[0] = (char)glyph;
+		return 1;
+	}
+	if (glyph < 0x800) {
+		bytes[0] = (char)(0xC0 | (glyph >> 6));
+		bytes[1] = (char)(0x80 | (glyph & 0x3F));
+		return 2;
+	}
+	if (glyph < 0x10000) {
+		bytes[0] = (char)(0xE0 | (glyph >> 12));
+		bytes[1] = (char)(0x80 | ((glyph >> 6) & 0x3F));
+		bytes[2] = (char)(0x80 | (glyph & 0x3F));
+		return 3;
+	}
+
+	bytes[0] = (char)(0xF0 | (glyph >> 18));
+	bytes[1] = (char)(0x80 | ((glyph >> 12) & 0x3F));
+	bytes[2] = (char)(0x80 | ((glyph >> 6) & 0x3F));
+	bytes[3] = (char)(0x80 | (glyph & 0x3F));
+	return 4;
+}
+#endif
+
+/* write cells changed since last present to console with a single write */
+void present_cli(console_t* cli)
+{
+	if (cli == NULL || cli->cells == NULL)
+		return;
+
+	size_t count = (size_t)cli->grid_size.x * cli->grid_size.y;
+
+#ifdef __WINDOWS__
+	/* NOTE: old windows versions don't support colored output so don't show it */
+	size_t changed = 0;
+
+	while (changed < count && same_cli_cell(&cli->cells[changed], &cli->shown[changed]))
+		changed++;
+
+	if (changed < count) {
+		HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+		CONSOLE_SCREEN_BUFFER_INFO info;
+		CHAR_INFO* chars = malloc(sizeof(CHAR_INFO) * count);
+
+		if (chars != NULL && GetConsoleScreenBufferInfo(console, &info)) {
+			SMALL_RECT area = { 0, 0, (SHORT)(cli->grid_size.x - 1), (SHORT)(cli->grid_size.y - 1) };
+
+			for (size_t i = 0; i < count; i++) {
+				chars[i].Char.UnicodeChar = (WCHAR)cli->cells[i].glyph;
+				chars[i].Attributes = info.wAttributes;
+			}
+
+			/* whole grid is copied to console buffer at once */
+			if (WriteConsoleOutputW(console, chars, (COORD){ (SHORT)cli->grid_size.x, (SHORT)cli->grid_size.y }, (COORD){ 0, 0 }, &area))
+				memcpy(cli->shown, cli->cells, sizeof(cli_cell_t) * count);
+		}
+
+		free(chars);
+	}
+#else
+	char sequence[MAX_SEQUENCE_SIZE];
+	const print_style_t* style = NULL;
+	size_t cursor = count;
+	bool success = true;
+
+	cli->output_size = 0;
+
+	for (size_t i = 0; i < count && success; i++) {
+		const cli_cell_t* cell = &cli->cells[i];
+
+		if (same_cli_cell(cell, &cli->shown[i]))
+			continue;
+
+		/* move cursor only when cells aren't written in sequence (rows always start with a move) */
+		if (cursor != i || i % cli->grid_size.x == 0) {
+			int size = snprintf(sequence, sizeof(sequence), "\e[%lu;%luH", (unsigned long)(i / cli->grid_size.x + CLI_CURSOR_START_INDEX), (unsigned long)(i % cli->grid_size.x + CLI_CURSOR_START_INDEX));
+
+			success = append_cli_output(cli, sequence, (size_t)size);
+		}
+
+		/* change style only when it differs from last glyph written */
+		if (style == NULL || style->decoration != cell->style.decoration || memcmp(&style->foreground, &cell->style.foreground, sizeof(color_t)) || memcmp(&style->background, &cell->style.background, sizeof(color_t))) {
+			int size = snprintf(sequence, sizeof(sequence), "\e[0;%d;38;2;%d;%d;%d;48;2;%d;%d;%dm", cell->style.decoration,
+				cell->style.foreground.red, cell->style.foreground.green, cell->style.foreground.blue,
+				cell->style.background.red, cell->style.background.green, cell->style.background.blue);
+
+			success = success && append_cli_output(cli, sequence, (size_t)size);
+			style = &cell->style;
+		}
+
+		success = success && append_cli_output(cli, sequence, encode_utf8(cell->glyph, sequence));
+		cursor = i + 1;
+	}
+
+	if (success && style != NULL)
+		success = append_cli_output(cli, "\e[0m", 4);
+
+	/* on failure cells are kept as unknown, so they're written again next time */
+	if (success && cli->output_size > 0) {
+		fwrite(cli->output, 1, cli->output_size, stdout);
+		fflush(stdout);
+
+		memcpy(cli->shown, cli->cells, sizeof(cli_cell_t) * count);
+	}
+#endif
+}
+
+#ifndef __WINDOWS__
+/* write end of resize pipe of console being watched */
+static int resize_fd = -1;
+
+/* SIGWINCH handler, wakes menu loop through self-pipe */
+static void notify_cli_resize(int signal)
+{
+	int old_errno = errno;
+	ubyte_t byte = (ubyte_t)signal;
+
+	/* NOTE: pipe is non-blocking, a full pipe already holds a pending resize */
+	if (write(resize_fd, &byte, 1) == -1) {}
+
+	errno = old_errno;
+}
+#endif
+
+/* get notified of console resizes on wait_cli_event */
+bool watch_cli_resize(console_t* cli)
+{
+	bool success = false;
+
+	if (cli != NULL) {
+#ifdef __WINDOWS__
+		/* NOTE: console size is checked every CLI_RESIZE_POLL_MS instead */
+		success = true;
+#else
+		if (pipe(cli->resize_pipe) != -1) {
+			struct sigaction action;
+
+			memset(&action, 0, sizeof(action));
+			action.sa_handler = &notify_cli_resize;
+			action.sa_flags = SA_RESTART;
+			sigemptyset(&action.sa_mask);
+
+			fcntl(cli->resize_pipe[0], F_SETFL, O_NONBLOCK);
+			fcntl(cli->resize_pipe[1], F_SETFL, O_NONBLOCK);
+			resize_fd = cli->resize_pipe[1];
+
+			success = (sigaction(SIGWINCH, &action, &cli->old_resize) != -1);
+
+			if (!success) {
+				close(cli->resize_pipe[0]);
+				close(cli->resize_pipe[1]);
+				resize_fd = -1;
+			}
+		}
+
+		if (!success)
+			cli->resize_pipe[0] = cli->resize_pipe[1] = -1;
+#endif
+	}
+
+	return success;
+}
+
+/* stop resize notifications and restore previous handler */
+void unwatch_cli_resize(console_t* cli)
+{
+#ifndef __WINDOWS__
+	if (cli != NULL && cli->resize_pipe[0] != -1) {
+		sigaction(SIGWINCH, &cli->old_resize, NULL);
+
+		close(cli->resize_pipe[0]);
+		close(cli->resize_pipe[1]);
+
+		cli->resize_pipe[0] = cli->resize_pipe[1] = -1;
+		resize_fd = -1;
+	}
+#endif
+}
+
+/* sleep until a key arrives or console is resized, return events that happened */
+cli_event_t wait_cli_event(console_t* cli)
+{
+	cli_event_t events = 0;
+
+#ifdef __WINDOWS__
+	(void)cli;
+
+	if (WaitForSingleObject(GetStdHandle(STD_INPUT_HANDLE), CLI_RESIZE_POLL_MS) == WAIT_OBJECT_0 && _kbhit())
+		events |= CLI_EVENT_KEY;
+	else
+		events |= CLI_EVENT_RESIZE;
+#else
+	struct pollfd fds[2] = { { STDIN_FILENO, POLLIN, 0 }, { (cli != NULL) ? cli->resize_pipe[0] : -1, POLLIN, 0 } };
+
+	/* without resize pipe, console size is checked every CLI_RESIZE_POLL_MS */
+	int timeout = (fds[1].fd != -1) ? -1 : CLI_RESIZE_POLL_MS;
+	int ready = poll(fds, 2, timeout);
+
+	if (ready == 0)
+		events |= CLI_EVENT_RESIZE;
+	else if (ready > 0) {
+		/* hang up counts as key, nothing else will ever arrive */
+		if (fds[0].revents)
+			events |= CLI_EVENT_KEY;
+
+		if (fds[1].revents & POLLIN) {
+			ubyte_t bytes[16];
+
+			while (read(fds[1].fd, bytes, sizeof(bytes)) > 0) {}
+
+			events |= CLI_EVENT_RESIZE;
+		}
+	}
+#endif
+
+	return events;
+}
+
+#ifdef HARVEST_BENCH
+/* NOTE: built as bench_harvest, draws scripted scenes on the memory frame buffer (HARVEST_SIZE, HARVEST_FORMAT, HARVEST_PRESENT and HARVEST_DUMP apply) */
+#define BENCH_ITERATIONS 50
+#define BENCH_FRAMES     120
+#define BENCH_SIZE       48 /* maximum side of shapes in pixels */
+#define BENCH_ENTITIES   100000
+#define BENCH_PARTICLES  1000000
+#define BENCH_BURST      1000 /* particles per explosion */
+#define BENCH_SPRITE_SIZE 64 /* side of generated sprite in pixels */
+
+typedef struct bench_scene_s
+{
+	const char* name;      /* scene name */
+	size_t      rects;     /* rectangles per frame */
+	size_t      triangles; /* triangles per frame */
+	size_t      lines;     /* lines per frame */
+	size_t      sprites;   /* sprites per frame */
+} bench_scene_t;
+
+static const bench_scene_t bench_scenes[] = {
+	{ "idle", 0, 0, 0, 0 },
+	{ "player", 0, 1, 0, 0 },
+	{ "rects", 2000, 0, 0, 0 },
+	{ "enemies", 0, 5000, 0, 0 },
+	{ "lines", 0, 0, 5000, 0 },
+	{ "sprites", 0, 0, 0, 500 },
+	{ "mixed", 500, 2000, 1000, 0 }
+};
+
+/* time HUD drawing over @frames frames (microseconds per frame) */
+static double bench_hud(framebuffer_t* fb, const size_t frames)
+{
+	hud_t hud;
+	double total = 0.0;
+
+	if (!init_hud(&hud, fb) || !hud.shown)
+		return 0.0;
+
+	for (size_t i = 0; i < frames; i++) {
+		clear_screen(fb);
+
+		/* frames are timed as if drawn at target rate */
+		double start = get_time();
+
+		draw_hud(fb, &hud, i, (double)i / FRAME_RATE);
+		total += get_time() - start;
+	}
+
+	terminate_hud(&hud);
+
+	return (total * SECOND_MS * SECOND_MS) / frames;
+}
+
+/* make sprite of HARVEST_SPRITE file, or a ball (opaque middle and soft edge) of BENCH_SPRITE_SIZE pixels */
+static bool bench_sprite(framebuffer_t* fb, sprite_t* sprite)
+{
+	const char* path = getenv("HARVEST_SPRITE");
+
+	if (path != NULL)
+		return load_sprite(sprite, fb, path);
+
+	color_t colors[BENCH_SPRITE_SIZE * BENCH_SPRITE_SIZE];
+	double radius = BENCH_SPRITE_SIZE / 2.0;
+
+	for (long_t y = 0; y < BENCH_SPRITE_SIZE; y++) {
+		for (long_t x = 0; x < BENCH_SPRITE_SIZE; x++) {
+			double dx = x + 0.5 - radius;
+			double dy = y + 0.5 - radius;
+			/* outer quarter of radius fades out (by squared distance) */
+			double edge = ((radius * radius) - ((dx * dx) + (dy * dy))) / ((radius * radius) * (1.0 - (0.75 * 0.75)));
+
+			colors[(y * BENCH_SPRITE_SIZE) + x] = (color_t){ 240, (ubyte_t)(120 + y * 2), 60, (ubyte_t)(MAX(MIN(edge, 1.0), 0.0) * 255) };
+		}
+	}
+
+	return init_sprite(sprite, fb, colors, (vertice_t){ BENCH_SPRITE_SIZE, BENCH_SPRITE_SIZE });
+}
+
+/* previous rectangle fill, one put_pixel per pixel */
+static void fill_rect_pixels(framebuffer_t* fb, vertice_t start, vertice_t end, const color_t color)
+{
+	vertice_t position = { start.x + 1, start.y };
+	vertice_t delta = { end.x - start.x, end.y - start.y };
+	size_t size = delta.x * delta.y;
+
+	for (size_t i = 0; i < size; i++) {
+		put_pixel(fb, position, color);
+
+		/* las pixel rendered */
+		if (position.x == end.x && position.y == end.y)
+			break;
+
+		if (position.x == end.x) {
+			position.x = start.x;
+			position.y++;
+		}
+
+		position.x++;
+	}
+}
+
+/* time full screen fills of @fill and return milliseconds per fill */
+static double bench_fill(framebuffer_t* fb, void (*fill)(framebuffer_t*, vertice_t, vertice_t, const color_t))
+{
+	vertice_t start = { 0, 0 };
+	vertice_t end = { fb->var_info.xres, fb->var_info.yres };
+	double begin = get_time();
+
+	for (size_t i = 0; i < BENCH_ITERATIONS; i++)
+		fill(fb, start, end, (color_t){ (ubyte_t)i, 128, 64, 255 });
+
+	return ((get_time() - begin) * SECOND_MS) / BENCH_ITERATIONS;
+}
+
+/* draw @frames frames of @scene with shapes drifting across the screen and print timing (through @cb unless NULL) */
+static bool bench_scene(framebuffer_t* fb, command_buffer_t* cb, const bench_scene_t* scene, const sprite_t* sprite, const size_t frames)
+{
+	char mode[32];
+	size_t count = scene->rects + scene->triangles + scene->lines + scene->sprites;
+	vertice_t* vertices = malloc(sizeof(vertice_t) * ((count * 3) + 1));
+	frame_stats_t stats = { 0, 0.0, 0.0 };
+	size_t traffic = fb->cleared_bytes + fb->shown_bytes;
+	double pixels = 0.0;
+
+	if (vertices == NULL)
+		return false;
+
+	srand(count);
+
+	/* first vertex of each shape is its origin, others are relative to it */
+	for (size_t i = 0; i < count * 3; i += 3) {
+		vertices[i] = (vertice_t){ rand() % fb->var_info.xres, rand() % fb->var_info.yres };
+		vertices[i + 1] = (vertice_t){ (rand() % BENCH_SIZE) - (BENCH_SIZE / 2), (rand() % BENCH_SIZE) - (BENCH_SIZE / 2) };
+		vertices[i + 2] = (vertice_t){ (rand() % BENCH_SIZE) - (BENCH_SIZE / 2), (rand() % BENCH_SIZE) - (BENCH_SIZE / 2) };
+	}
+
+	for (size_t frame = 0; frame < frames; frame++) {
+		double start = get_time();
+
+		clear_screen(fb);
+
+		for (size_t i = 0, j = 0; i < count; i++, j += 3) {
+			vertice_t origin = { (vertices[j].x + (long_t)(frame * ((i % 7) + 1))) % fb->var_info.xres, (vertices[j].y + (long_t)(frame * ((i % 5) + 1))) % fb->var_info.yres };
+			vertice_t b = { origin.x + vertices[j + 1].x, origin.y + vertices[j + 1].y };
+			vertice_t c = { origin.x + vertices[j + 2].x, origin.y + vertices[j + 2].y };
+			color_t color = { (ubyte_t)(i * 37), (ubyte_t)(i * 91), (ubyte_t)(i * 13), 255 };
+
+			if (i < scene->rects) {
+				if (cb != NULL)
+					record_rect(cb, origin, b, color);
+				else
+					draw_rect(fb, origin, b, color);
+
+				pixels += (double)ABS(vertices[j + 1].x) * ABS(vertices[j + 1].y);
+			}
+			else if (i < scene->rects + scene->triangles) {
+				if (cb != NULL)
+					record_triangle(cb, origin, b, c, color);
+				else
+					draw_triangle(fb, origin, b, c, color);
+
+				long_t area = (vertices[j + 1].x * vertices[j + 2].y) - (vertices[j + 1].y * vertices[j + 2].x);
+
+				pixels += ABS(area) / 2.0;
+			}
+			else if (i < scene->rects + scene->triangles + scene->lines) {
+				vertice_t end = { origin.x + (vertices[j + 1].x * 20), origin.y + (vertices[j + 1].y * 20) };
+
+				if (cb != NULL)
+					record_line(cb, origin, end, color);
+				else
+					draw_line(fb, origin, end, color);
+			}
+			else {
+				if (cb != NULL)
+					record_sprite(cb, sprite, origin);
+				else
+					draw_sprite(fb, sprite, origin);
+
+				pixels += (double)sprite->size.x * sprite->size.y;
+			}
+		}
+
+		if (cb != NULL)
+			execute_commands(fb, cb);
+
+		double drawn = get_time();
+
+		present_screen(fb);
+
+		stats.frames++;
+		stats.render_time += drawn - start;
+		stats.present_time += get_time() - drawn;
+	}
+
+	traffic = fb->cleared_bytes + fb->shown_bytes - traffic;
+
+	if (cb != NULL)
+		snprintf(mode, sizeof(mode), "%lu thread%s", (unsigned long)cb->workers_count + 1, (cb->workers_count > 0) ? "s" : "");
+	else
+		snprintf(mode, sizeof(mode), "immediate");
+
+	printf("%-8s %-10s %8.3f ms per frame (drawing %.3f ms, presenting %.3f ms), %9.1f KB cleared and shown",
+		scene->name, mode, ((stats.render_time + stats.present_time) * SECOND_MS) / stats.frames, (stats.render_time * SECOND_MS) / stats.frames,
+		(stats.present_time * SECOND_MS) / stats.frames, traffic / 1024.0 / stats.frames);
+
+	if (pixels > 0.0)
+		printf(", fill %.1f Mpixels/s", pixels / stats.render_time / 1e6);
+
+	if (scene->triangles > 0)
+		printf(", %.2f M triangles/s", (scene->triangles * stats.frames) / stats.render_time / 1e6);
+
+	if (scene->sprites > 0)
+		printf(", %.0f sprites/ms", (scene->sprites * stats.frames) / (stats.render_time * SECOND_MS));
+
+	printf("\n");
+
+	free(vertices);
+
+	return true;
+}
+
+/* spawn entity drifting somewhere on screen */
+static void bench_spawn(entities_t* entities, const region_t screen)
+{
+	long_t speed = screen.end.y / 2;
+
+	spawn_entity(entities, (rand() % 4) ? ENTITY_ENEMY : ENTITY_PROJECTILE, (vertice_t){ rand() % screen.end.x, rand() % screen.end.y },
+		(vertice_t){ (rand() % speed) - (speed / 2), (rand() % speed) - (speed / 2) }, (vertice_t){ 0, (rand() % 64) - 32 },
+		(vertice_t){ 2 + (rand() % 8), 2 + (rand() % 8) }, (color_t){ (ubyte_t)rand(), (ubyte_t)rand(), (ubyte_t)rand(), 255 });
+}
+
+/* update @frames frames of moving entities and find their collisions, respawning those leaving screen or killed, and print timing */
+/* NOTE: entities are kept on a screen part halved @shift times, their count is cut to keep same density */
+static bool bench_entities(framebuffer_t* fb, const size_t shift, const size_t frames)
+{
+	size_t count = BENCH_ENTITIES >> (shift * 2);
+	entities_t entities;
+	collision_grid_t grid;
+	region_t screen = get_screen_region(fb);
+	size_t removed = 0;
+	size_t collisions = 0;
+	double update_time = 0.0;
+	double collision_time = 0.0;
+
+	if (!init_entities(&entities, count))
+		return false;
+
+	if (!init_collision_grid(&grid, screen.end)) {
+		terminate_entities(&entities);
+		return false;
+	}
+
+	screen.end = (vertice_t){ screen.end.x >> shift, screen.end.y >> shift };
+
+	srand(count);
+
+	while (entities.count < count)
+		bench_spawn(&entities, screen);
+
+	for (size_t frame = 0; frame < frames; frame++) {
+		/* some die in game every frame */
+		for (size_t i = frame % 97; i < entities.count; i += 97)
+			kill_entity(&entities, i);
+
+		double start = get_time();
+
+		update_entities(&entities, &entities, 1.0f / 60, screen);
+
+		double updated = get_time();
+
+		build_collision_grid(&grid, &entities);
+		collisions += find_collisions(&grid, &entities);
+
+		collision_time += get_time() - updated;
+		update_time += updated - start;
+		removed += count - entities.count;
+
+		while (entities.count < count)
+			bench_spawn(&entities, screen);
+	}
+
+	printf("%-8s %-10lu %8.3f ms per update (%.1f M entities/s), %.0f removed, %8.3f ms finding %.0f collisions per frame\n", "entities", (unsigned long)count,
+		(update_time * SECOND_MS) / frames, (count * (double)frames) / update_time / 1e6, (double)removed / frames, (collision_time * SECOND_MS) / frames,
+		(double)collisions / frames);
+
+	terminate_collision_grid(&grid);
+	terminate_entities(&entities);
+
+	return true;
+}
+
+/* update and draw (through @cb) @frames frames of BENCH_PARTICLES particles (points and squares) refilled by explosions all over screen, and print timing */
+static bool bench_particles(framebuffer_t* fb, command_buffer_t* cb, const size_t frames)
+{
+	region_t screen = get_screen_region(fb);
+	float speed = screen.end.y / 4.0f;
+	emitter_t emitters[] = {
+		{ 0.0f, 0.0f, speed, 1.0f, 0.5f, 1.5f, { 255, 240, 160, 255 }, { 90, 20, 10, 255 }, 1 },
+		{ 0.0f, speed, speed / 4.0f, 0.5f, 0.5f, 1.5f, { 160, 200, 255, 255 }, { 20, 30, 90, 255 }, 3 }
+	};
+	particles_t particles;
+	size_t emitted = 0;
+	double update_time = 0.0;
+	double emit_time = 0.0;
+	double draw_time = 0.0;
+
+	if (!init_particles(&particles, fb, emitters, sizeof(emitters) / sizeof(emitter_t), BENCH_PARTICLES))
+		return false;
+
+	srand(BENCH_PARTICLES);
 
-			fb->size = fb->resolution.x * fb->resolution.y;
+	for (size_t frame = 0; frame <= frames; frame++) {
+		double start = get_time();
 
-			/* resize window (windowed full screen) */
-			/* FIXME: not resizing well if already maximized */
-			MoveWindow(fb->window, 0, 0, fb->resolution.x, fb->resolution.y, true);
-			ShowWindow(fb->window, SW_SHOWMAXIMIZED);
+		update_particles(&particles, &particles, 1.0f / FRAME_RATE);
 
-			success = ((fb->device = GetDC(fb->window)) != NULL);
-		}
-#else
-		/* NOTE: this is not the finest approach but it is the fastest */
-		/* set system default frame buffer */
-		system("export FRAMEBUFFER=/dev/fb0");
+		double updated = get_time();
+		size_t count = particles.count;
 
-		/* open frame buffer file */
-		if ((fb->fd = open("/dev/fb0", O_RDWR)) != -1) {
-			if (!ioctl(fb->fd, FBIOGET_FSCREENINFO, &fb->fix_info)) {
-				if (!ioctl(fb->fd, FBIOGET_VSCREENINFO, &fb->var_info)) {
-					/* make copy of original variable information */
-					memcpy(&fb->orig_var_info, &fb->var_info, sizeof(struct fb_var_screeninfo));
+		/* one in eight explosions leaves squares */
+		while (particles.count + BENCH_BURST <= particles.capacity)
+			emit_particles(&particles, (rand() % 8) ? 0 : 1, (vertice_t){ rand() % screen.end.x, rand() % screen.end.y }, (vertice_t){ 0, 0 }, BENCH_BURST);
 
-					/* change buffer info */
-					fb->var_info.grayscale = 0;
-					fb->var_info.bits_per_pixel = 32;
-					fb->var_info.activate |= FB_ACTIVATE_NOW | FB_ACTIVATE_FORCE;
+		double filled = get_time();
 
-					if (!ioctl(fb->fd, FBIOPUT_VSCREENINFO, &fb->var_info)) {
-						/* get size of buffer */
-						fb->size = fb->fix_info.smem_len;
+		clear_screen(fb);
+		draw_particles(fb, cb, &particles, 0.0f);
 
-						/* map buffer to memory */
-						success = ((fb->address = mmap(0, fb->size, PROT_READ | PROT_WRITE, MAP_SHARED, fb->fd, 0)) != NULL);
-					}
-				}
-			}
+		double drawn = get_time();
+
+		present_screen(fb);
+
+		/* first frame only fills pool */
+		if (frame > 0) {
+			update_time += updated - start;
+			emit_time += filled - updated;
+			draw_time += drawn - filled;
+			emitted += particles.count - count;
 		}
-#endif
 	}
 
-	/* clean up if not successful */
-	if (!success)
-		terminate_screen_framebuffer(fb);
+	printf("%-8s %-10lu %8.3f ms per update (%.1f M particles/s), %8.3f ms emitting %.0f, %8.3f ms drawing on %lu thread%s (%.1f M particles/s)\n", "particles",
+		(unsigned long)particles.count, (update_time * SECOND_MS) / frames, (particles.count * (double)frames) / update_time / 1e6, (emit_time * SECOND_MS) / frames,
+		(double)emitted / frames, (draw_time * SECOND_MS) / frames, (unsigned long)cb->workers_count + 1, (cb->workers_count > 0) ? "s" : "",
+		(particles.count * (double)frames) / draw_time / 1e6);
 
-	return success;
+	terminate_particles(&particles);
+
+	return true;
 }
 
-/* change terminal mode and return old one */
-console_mode_t set_cli_input_mode(const console_mode_t mode)
+int main(int argc, char* argv[])
 {
-	console_mode_t old_mode;
-
-#ifdef __WINDOWS__
-	HANDLE console = GetStdHandle(STD_INPUT_HANDLE);
+	framebuffer_t fb;
+	size_t frames = (argc > 1) ? (size_t)strtoul(argv[1], NULL, 10) : BENCH_FRAMES;
 
-	if (GetConsoleMode(console, &old_mode))
-		SetConsoleMode(console, mode);
-#else
-	if (!tcgetattr(STDIN_FILENO, &old_mode))
-		tcsetattr(STDIN_FILENO, TCSANOW, &mode);
-#endif
+	memset(&fb, 0, sizeof(framebuffer_t));
 
-	return old_mode;
-}
+	/* always headless */
+	fb.backend = BACKEND_MEMORY;
 
-/* change terminal mode to raw and return old one */
-console_mode_t set_cli_raw_mode()
-{
-	console_mode_t mode;
+	if (frames == 0 || !init_screen_framebuffer(&fb)) {
+		fprintf(stderr, "usage: %s [frames] (check HARVEST_SIZE, HARVEST_FORMAT and HARVEST_DUMP)\n", argv[0]);
+		return EXIT_FAILURE;
+	}
 
-#ifdef __WINDOWS__
-	SetConsoleTitle("Harvest");
+	printf("%s %ux%u, presenting by %s\n", fb.format.name, fb.var_info.xres, fb.var_info.yres, (fb.present == PRESENT_FLIP) ? "flip" : "copy");
 
-	mode = ~(ENABLE_LINE_INPUT | ENABLE_PROCESSED_INPUT | ENABLE_WINDOW_INPUT | ENABLE_INSERT_MODE);
-#else
-	cfmakeraw(&mode);
-#endif
+	/* compare rectangle fill paths */
+	double pixels_time = bench_fill(&fb, &fill_rect_pixels);
+	double spans_time = bench_fill(&fb, &draw_rect);
+	double megabytes = fb.buffer_size / (1024.0 * 1024.0);
 
-	return set_cli_input_mode(mode);
-}
+	printf("%-8s put_pixel %8.3f ms (%7.1f MB/s), spans %8.3f ms (%7.1f MB/s)\n", "fill", pixels_time, (megabytes * SECOND_MS) / pixels_time,
+		spans_time, (megabytes * SECOND_MS) / spans_time);
 
-/* change cli output cursor status */
-void show_cli_output_cursor(const bool show)
-{
-#ifdef __WINDOWS__
-	CONSOLE_CURSOR_INFO info = (show) ? (CONSOLE_CURSOR_INFO){ 25, true } : (CONSOLE_CURSOR_INFO){ 1, false };
+	/* text and frame time graph (HARVEST_HUD and HARVEST_FONT apply) */
+	printf("%-8s %.2f us per frame\n", "hud", bench_hud(&fb, frames));
 
-	SetConsoleCursorInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info);
-#else
-	if (show)
-		printf("\e[?25h");
-	else
-		printf("\e[?25l");
-#endif
-}
+	/* compare immediate drawing with binned commands on one thread and on HARVEST_THREADS (one per processor by default) */
+	const char* threads = getenv("HARVEST_THREADS");
+	command_buffer_t single;
+	command_buffer_t parallel;
 
-/* set cli cursor position */
-void set_cli_cursor_pos(const size_t column, const size_t row)
-{
-#ifdef __WINDOWS__
-	COORD position = { (short)column, (short)row };
+	if (!init_command_buffer(&single, &fb, 1) || !init_command_buffer(&parallel, &fb, (threads != NULL) ? (size_t)strtoul(threads, NULL, 10) : 0)) {
+		terminate_command_buffer(&single);
+		terminate_screen_framebuffer(&fb);
+		return EXIT_FAILURE;
+	}
 
-	SetConsoleCursorPosition(GetStdHandle(STD_OUTPUT_HANDLE), position);
-#else
-	printf("\e[%d;%dH", row, column);
-#endif
-}
+	sprite_t sprite;
 
-/* get cli size */
-vertice_t get_cli_size()
-{
-	vertice_t size = { 0, 0 };
+	if (!bench_sprite(&fb, &sprite)) {
+		fprintf(stderr, "can't load sprite (check HARVEST_SPRITE is an 8-bit PPM or PAM file)\n");
+		terminate_command_buffer(&single);
+		terminate_command_buffer(&parallel);
+		terminate_screen_framebuffer(&fb);
+		return EXIT_FAILURE;
+	}
 
-#ifdef __WINDOWS__
-	CONSOLE_SCREEN_BUFFER_INFO info;
+	for (size_t i = 0; i < sizeof(bench_scenes) / sizeof(bench_scene_t); i++) {
+		bench_scene(&fb, NULL, &bench_scenes[i], &sprite, frames);
+		bench_scene(&fb, &single, &bench_scenes[i], &sprite, frames);
 
-	if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) {
-		size.x = info.dwSize.X;
-		size.y = info.dwSize.Y;
-	}
-#else
-	struct winsize win_sz;
-	
-	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &win_sz) != -1) {
-		size.x = win_sz.ws_col;
-		size.y = win_sz.ws_row;
+		if (parallel.workers_count > 0)
+			bench_scene(&fb, &parallel, &bench_scenes[i], &sprite, frames);
 	}
-#endif
 
-	return size;
-}
+	terminate_sprite(&sprite);
 
-/* clear cli output stream */
-void clear_cli()
-{
-#ifdef __WINDOWS__
-	HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
-	CONSOLE_SCREEN_BUFFER_INFO info;
+	/* collision cost should grow with entity count only */
+	for (size_t shift = 3; shift-- > 0;)
+		bench_entities(&fb, shift, frames);
 
-	if(GetConsoleScreenBufferInfo(console, &info)) {
-		COORD pos = { 0, 0 };
-		DWORD written;
-		DWORD size = info.dwSize.X * info.dwSize.Y;
+	bench_particles(&fb, &single, frames);
 
-		/* fill console screen */
-		FillConsoleOutputCharacter(console, (TCHAR)' ', size, pos, &written);
+	/* sorted particles are timed whatever HARVEST_THREADED_PARTICLES says, to know when they pay off */
+	parallel.threaded_particles = true;
 
-		/* set console attributer */
-		FillConsoleOutputAttribute(console, info.wAttributes, size, pos, &written);
+	if (parallel.workers_count > 0)
+		bench_particles(&fb, &parallel, frames);
 
-		/* reset cursor */
-		set_cli_cursor_pos(0, 0);
-	}
-#else
-	system("clear && printf '\e[3J'");
-#endif
-}
+	terminate_command_buffer(&single);
+	terminate_command_buffer(&parallel);
+	terminate_screen_framebuffer(&fb);
 
-int main()
+	return EXIT_SUCCESS;
+}
+#else
+int main(int argc, char* argv[])
 {
 	scene_t scene;
 
+	memset(&scene, 0, sizeof(scene_t));
+
+#ifndef __WINDOWS__
+	/* draw into memory instead of display */
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--memory") == 0)
+			scene.fb.backend = BACKEND_MEMORY;
+	}
+#endif
+
 	/* get cli raw input */
 	scene.cli.old_mode = set_cli_raw_mode();
 
@@ -796,38 +5793,208 @@ int main()
 
 	clear_cli();
 
-	while (true) {
-		/* store cli size and aspect ratio */
-		scene.cli.size = get_cli_size();
-		scene.cli.aspect_ratio = (double)scene.cli.size.x / scene.cli.size.y;
+	/* menu sleeps until a key arrives or console is resized */
+	watch_cli_resize(&scene.cli);
 
-		/* render */
-		draw_cli_menu(&scene);
+	for (cli_event_t events = CLI_EVENT_RESIZE; !(events & CLI_EVENT_KEY); events = wait_cli_event(&scene.cli)) {
+		vertice_t size = get_cli_size();
 
-		/* stop if any key press */
-		if (get_char() != EOF)
-			break;
+		/* lay menu out again only when console is resized */
+		if (size.x != scene.cli.size.x || size.y != scene.cli.size.y) {
+			/* store cli size and aspect ratio */
+			scene.cli.size = size;
+			scene.cli.aspect_ratio = (double)scene.cli.size.x / scene.cli.size.y;
+
+			if (resize_cli_grid(&scene.cli, size))
+				draw_cli_menu(&scene);
+
+			/* render (only cells that changed are written) */
+			present_cli(&scene.cli);
+		}
 	}
 
+	/* stop on any key press */
+	get_char();
+
+	unwatch_cli_resize(&scene.cli);
+	terminate_cli_grid(&scene.cli);
 	clear_cli();
 
+	scene.stats = (frame_stats_t){ 0, 0.0, 0.0 };
+
 	/* init frame buffer */
 	if (init_screen_framebuffer(&scene.fb)) {
 		clear_screen(&scene.fb);
+		present_screen(&scene.fb);
 
 		/* initialize player */
 		scene.player.bound_box = get_scaled_box(&scene.fb, 663, 703, 753, 703, (color_t){ 255, 255, 255, 255 });
+		scene.player.coord_x = (float)scene.player.bound_box.start.x;
 
-		scene.game_over = false;
+		/* draw commands are binned and drawn by HARVEST_THREADS threads (one per processor by default) */
+		const char* threads = getenv("HARVEST_THREADS");
 
-		while (!scene.game_over) {
-			/* render game */
-			render_game(&scene);
+#ifdef __WINDOWS__
+		vertice_t resolution = scene.fb.resolution;
+#else
+		vertice_t resolution = { scene.fb.var_info.xres, scene.fb.var_info.yres };
+#endif
+
+		scene.game_over = !init_command_buffer(&scene.cb, &scene.fb, (threads != NULL) ? (size_t)strtoul(threads, NULL, 10) : 0);
+		scene.game_over = scene.game_over || !init_collision_grid(&scene.grid, resolution);
+		scene.game_over = scene.game_over || !init_input(&scene.input);
+		scene.game_over = scene.game_over || !init_hud(&scene.hud, &scene.fb);
+
+		/* debris of destroyed enemies flies all around, exhaust trails below player (speeds scale with screen like everything else) */
+		emitter_t emitters[] = {
+			{ 0.0f, 0.0f, resolution.y / 3.0f, 2.0f, 0.4f, 0.5f, { 255, 240, 160, 255 }, { 90, 20, 10, 255 }, (ubyte_t)MAX(resolution.y / 360, 1) },
+			{ 0.0f, resolution.y / 4.0f, resolution.y / 30.0f, 1.0f, 0.15f, 0.15f, { 160, 200, 255, 255 }, { 20, 30, 90, 255 }, 1 }
+		};
+
+		scene.game_time = 0.0;
+		scene.spawn_time = 0.0;
+		scene.score = 0;
+
+		/* keys of every tick are recorded to HARVEST_RECORD or replayed from HARVEST_REPLAY (recorded on same screen size) */
+		if (!scene.game_over && !init_input_log(&scene.input_log, &scene.input, getenv("HARVEST_RECORD"), getenv("HARVEST_REPLAY"), GAME_SEED, resolution)) {
+			fprintf(stderr, "can't open input log (replay needs a log recorded on %ldx%ld)\n", (long)resolution.x, (long)resolution.y);
+			scene.game_over = true;
+		}
+
+		/* same spawns on every run */
+		srand(GAME_SEED);
+
+		for (size_t i = 0; i < SNAPSHOTS; i++) {
+			scene.game_over = scene.game_over || !init_entities(&scene.snapshots[i].entities, MAX_ENTITIES);
+			scene.game_over = scene.game_over || !init_particles(&scene.snapshots[i].particles, &scene.fb, emitters, sizeof(emitters) / sizeof(emitter_t), MAX_PARTICLES);
+		}
+
+		/* frames are drawn HARVEST_FPS times per second (0 for as fast as presenting allows) */
+		const char* fps = getenv("HARVEST_FPS");
+		double frame_rate = (fps != NULL) ? strtod(fps, NULL) : FRAME_RATE;
+		double next_tick = get_time();
+		double next_frame = next_tick;
+		double start_time = next_tick;
+		bool threaded = false;
+		bool replaying = scene.input_log.replaying;
+		bool recording = !replaying && scene.input_log.file != NULL;
+
+		scene.frame_time = (frame_rate > 0.0) ? 1.0 / frame_rate : 0.0;
+
+		/* frames are recorded to HARVEST_CAPTURE (Y4M video) without waiting for disk, at a fixed HARVEST_FPS */
+		if (!init_capture(&scene.capture, &scene.fb, scene.game_over ? NULL : getenv("HARVEST_CAPTURE"), frame_rate)) {
+			fprintf(stderr, "can't capture frames (HARVEST_CAPTURE needs a writable file and HARVEST_FPS above 0)\n");
+			scene.game_over = true;
+		}
+
+		/* snapshot 0 is written first, 1 drawn first and 2 is free */
+		scene.written_snapshot = 0;
+		scene.published_snapshot = 0;
+		scene.drawn_snapshot = 1;
+		scene.entities = &scene.snapshots[0].entities;
+		scene.particles = &scene.snapshots[0].particles;
+		atomic_init(&scene.free_snapshot, 2);
+
+		if (!scene.game_over) {
+			publish_snapshot(&scene, next_tick);
+			atomic_init(&scene.drawing, true);
+
+#ifndef __WINDOWS__
+			/* frames are drawn on their own thread, slow presents don't hold simulation back (replay draws fixed frames itself) */
+			threaded = !replaying && (pthread_create(&scene.render_thread, NULL, &run_renderer, &scene) == 0);
+#endif
+		}
+
+		/* replay runs as fast as possible, drawing a frame every TICK_RATE / FRAME_RATE ticks */
+		while (replaying && !scene.game_over) {
+			advance_snapshot(&scene);
 			handle_input(&scene);
+			update_game(&scene);
+			publish_snapshot(&scene, get_time());
+
+			if (scene.input_log.ticks % (TICK_RATE / FRAME_RATE) == 0 && !scene.game_over)
+				render_game(&scene);
+		}
+
+		while (!scene.game_over) {
+			double now = get_time();
+			size_t ticks = 0;
+
+			/* simulate at fixed rate whatever the frame rate is */
+			while (now >= next_tick && !scene.game_over) {
+				/* too far behind (e.g. suspended), skip lost time */
+				if (ticks++ == MAX_TICKS_PER_FRAME) {
+					next_tick = now;
+					break;
+				}
+
+				/* every tick is published, next one is stepped from it */
+				advance_snapshot(&scene);
+				handle_input(&scene);
+				update_game(&scene);
+				publish_snapshot(&scene, next_tick);
+
+				next_tick += TICK_TIME;
+			}
+
+			/* without render thread, frames are drawn between ticks */
+			if (!threaded && now >= next_frame && !scene.game_over) {
+				render_game(&scene);
+
+				next_frame = (now - next_frame > scene.frame_time) ? now + scene.frame_time : next_frame + scene.frame_time;
+			}
+
+			/* sleep until something is due */
+			sleep_until((threaded || next_tick < next_frame) ? next_tick : next_frame);
 		}
 
+#ifndef __WINDOWS__
+		if (threaded) {
+			atomic_store(&scene.drawing, false);
+			pthread_join(scene.render_thread, NULL);
+		}
+#endif
+
 		clear_screen(&scene.fb);
+		present_screen(&scene.fb);
+
+		for (size_t i = 0; i < SNAPSHOTS; i++) {
+			terminate_entities(&scene.snapshots[i].entities);
+			terminate_particles(&scene.snapshots[i].particles);
+		}
+
+		double run_time = get_time() - start_time;
+
+		terminate_input_log(&scene.input_log);
+		terminate_capture(&scene.capture);
+		terminate_hud(&scene.hud);
+		terminate_input(&scene.input);
+		terminate_collision_grid(&scene.grid);
+		terminate_command_buffer(&scene.cb);
+
+#ifndef __WINDOWS__
+		const char* present = (scene.fb.present == PRESENT_FLIP) ? "flip" : "copy";
+		double traffic = (scene.fb.cleared_bytes + scene.fb.shown_bytes) / 1024.0;
+#else
+		const char* present = "gdi";
+		double traffic = 0.0;
+#endif
+
 		terminate_screen_framebuffer(&scene.fb);
+
+		/* report average frame time */
+		if (scene.stats.frames > 0) {
+			fprintf(stderr, "%lu frames (%s): %.3f ms drawing, %.3f ms presenting, %.1f KB cleared and shown per frame\n", (unsigned long)scene.stats.frames, present,
+				(scene.stats.render_time * SECOND_MS) / scene.stats.frames, (scene.stats.present_time * SECOND_MS) / scene.stats.frames, traffic / scene.stats.frames);
+		}
+
+		if (replaying)
+			fprintf(stderr, "%lu ticks replayed in %.3f s, score %lu\n", (unsigned long)scene.input_log.ticks, run_time, (unsigned long)scene.score);
+		else if (recording)
+			fprintf(stderr, "%lu ticks recorded, score %lu\n", (unsigned long)scene.input_log.ticks, (unsigned long)scene.score);
+
+		if (scene.capture.captured + scene.capture.dropped > 0)
+			fprintf(stderr, "%lu frames captured, %lu dropped\n", (unsigned long)scene.capture.captured, (unsigned long)scene.capture.dropped);
 	}
 
 	/* reset terminal values */
@@ -836,108 +6003,266 @@ int main()
 
 	return EXIT_SUCCESS;
 }
+#endif
 
+/* lay menu out on cli cell grid */
 void draw_cli_menu(scene_t* scene)
 {
 	if (scene != NULL) {
-		vertice_t start = { CLI_CURSOR_START_INDEX + (scene->cli.size.x / 2) - 20, CLI_CURSOR_START_INDEX + (scene->cli.size.y / 2) - 5 };
-		vertice_t end = { CLI_CURSOR_START_INDEX + (scene->cli.size.x / 2) + 20, CLI_CURSOR_START_INDEX + (scene->cli.size.y / 2) + 5 };
+		const print_style_t frame = { (color_t){ 40, 50, 80, 255 }, (color_t){ 232, 215, 162, 255 }, 5 };
+		const print_style_t button = { (color_t){ 232, 215, 162, 255 }, (color_t){ 40, 50, 80, 255 }, 5 };
+		vertice_t start = { (scene->cli.grid_size.x / 2) - 20, (scene->cli.grid_size.y / 2) - 5 };
+		vertice_t end = { (scene->cli.grid_size.x / 2) + 20, (scene->cli.grid_size.y / 2) + 5 };
 
 		/* draw box */
-		for (size_t i = CLI_CURSOR_START_INDEX, j = CLI_CURSOR_START_INDEX; j <= scene->cli.size.y; i++) {
-			if (i > scene->cli.size.x) {
-				i = CLI_CURSOR_START_INDEX;
-				j++;
-			}
-
-			set_cli_cursor_pos(i, j);
-
-			if (j == start.y && i == start.x)
-				fprintfdec(stdout, (print_style_t){ (color_t){ 40, 50, 80, 255 }, (color_t){ 232, 215, 162, 255 }, 5 }, "%s", "\u250C");
-			else if (j == end.y && i == end.x)
-				fprintfdec(stdout, (print_style_t){ (color_t){ 40, 50, 80, 255 }, (color_t){ 232, 215, 162, 255 }, 5 }, "%s", "\u2518");
-			else if (j == end.y && i == start.x)
-				fprintfdec(stdout, (print_style_t){ (color_t){ 40, 50, 80, 255 }, (color_t){ 232, 215, 162, 255 }, 5 }, "%s", "\u2514");
-			else if (j == start.y && i == end.x)
-				fprintfdec(stdout, (print_style_t){ (color_t){ 40, 50, 80, 255 }, (color_t){ 232, 215, 162, 255 }, 5 }, "%s", "\u2510");
-			else if ((j == start.y || j == end.y) && i > start.x && i < end.x)
-				fprintfdec(stdout, (print_style_t){ (color_t){ 40, 50, 80, 255 }, (color_t){ 232, 215, 162, 255 }, 5 }, "%s", "\u2500");
-			else if (j > start.y && j < end.y && (i == start.x || i == end.x))
-				fprintfdec(stdout, (print_style_t){ (color_t){ 40, 50, 80, 255 }, (color_t){ 232, 215, 162, 255 }, 5 }, "%s", "\u2502");
-			else
-				fprintfdec(stdout, (print_style_t){ (color_t){ 232, 215, 162, 255 }, (color_t){ 232, 215, 162, 255 }, 5 }, "%c", ' ');
+		for (long_t j = 0; j < scene->cli.grid_size.y; j++) {
+			for (long_t i = 0; i < scene->cli.grid_size.x; i++) {
+				uint32_t glyph = ' ';
+
+				if (j == start.y && i == start.x)
+					glyph = 0x250C;
+				else if (j == end.y && i == end.x)
+					glyph = 0x2518;
+				else if (j == end.y && i == start.x)
+					glyph = 0x2514;
+				else if (j == start.y && i == end.x)
+					glyph = 0x2510;
+				else if ((j == start.y || j == end.y) && i > start.x && i < end.x)
+					glyph = 0x2500;
+				else if (j > start.y && j < end.y && (i == start.x || i == end.x))
+					glyph = 0x2502;
+
+				put_cli_cell(&scene->cli, i, j, glyph, frame);
+			}
 		}
 
 		/* draw text */
-		set_cli_cursor_pos(start.x + 7, start.y + 3);
-		fprintfdec(stdout, (print_style_t){ (color_t){ 40, 50, 80, 255 }, (color_t){ 232, 215, 162, 255 }, 5 }, "%s", "Space Force Simulator 3049");
+		put_cli_text(&scene->cli, start.x + 7, start.y + 3, "Space Force Simulator 3049", frame);
 
 		/* draw button */
-		set_cli_cursor_pos(start.x + 17, start.y + 7);
-		fprintfdec(stdout, (print_style_t){ (color_t){ 232, 215, 162, 255 }, (color_t){ 40, 50, 80, 255 }, 5 }, "%s", " START! ");
+		put_cli_text(&scene->cli, start.x + 17, start.y + 7, " START! ", button);
 	}
 }
 
-/* render game to screen */
-void render_game(scene_t* scene)
+/* advance game by one tick */
+void update_game(scene_t* scene)
 {
 	if (scene != NULL) {
-		/* only draw maximum num of frames */
 #ifdef __WINDOWS__
-		if (clock()) {
+		vertice_t resolution = scene->fb.resolution;
 #else
-		if ((clock() - scene->frame_delta) / (CLOCKS_PER_SEC / 10000) > FRAME_TIME) {
+		vertice_t resolution = { scene->fb.var_info.xres, scene->fb.var_info.yres };
 #endif
-			scene->frame_delta = clock();
 
-			/* clear screen */
-			clear_screen(&scene->fb);
+		scene->game_time += TICK_TIME;
+
+		while (scene->game_time >= scene->spawn_time) {
+			long_t size = resolution.y / 40;
+
+			spawn_entity(scene->entities, ENTITY_ENEMY, (vertice_t){ rand() % resolution.x, -size }, (vertice_t){ (rand() % 41) - 20, resolution.y / 6 },
+				(vertice_t){ 0, resolution.y / 20 }, (vertice_t){ size, size }, (color_t){ 200, 60 + (rand() % 120), 40, 255 });
+
+			scene->spawn_time += ENEMY_SPAWN_TIME;
+		}
+
+		/* exhaust below player tip */
+		emit_particles(scene->particles, EMITTER_THRUSTER, (vertice_t){ (scene->player.bound_box.start.x + scene->player.bound_box.end.x) / 2, scene->player.bound_box.end.y },
+			(vertice_t){ 0, 0 }, 2);
+
+		/* projectiles destroy enemies they hit, enemies reaching player end game */
+		if (build_collision_grid(&scene->grid, scene->entities)) {
+			size_t count = find_collisions(&scene->grid, scene->entities);
+			uint32_t hit;
+
+			for (size_t i = 0; i < count; i++) {
+				size_t enemy = scene->grid.collisions[i].enemy;
 
-			/* draw player */
-			vertice_t a = { (scene->player.bound_box.end.x - scene->player.bound_box.start.x) / 2 + scene->player.bound_box.start.x, scene->player.bound_box.start.y };
-			vertice_t b = { scene->player.bound_box.start.x, scene->player.bound_box.end.y };
+				/* enemy may be hit by several projectiles at once */
+				if (scene->entities->alive[enemy]) {
+					emit_particles(scene->particles, EMITTER_EXPLOSION, (vertice_t){ (long_t)scene->entities->coord_x[enemy], (long_t)scene->entities->coord_y[enemy] },
+						(vertice_t){ (long_t)scene->entities->velocity_x[enemy], (long_t)scene->entities->velocity_y[enemy] }, 96);
+				}
+
+				scene->score += scene->entities->alive[enemy];
 
-			draw_triangle(&scene->fb, a, b, scene->player.bound_box.end, scene->player.bound_box.color);
+				kill_entity(scene->entities, scene->grid.collisions[i].enemy);
+				kill_entity(scene->entities, scene->grid.collisions[i].projectile);
+			}
 
-			/* draw enemies */
+			if (find_box_collisions(&scene->grid, scene->entities, &scene->player.bound_box, ENTITY_ENEMY, &hit, 1) > 0)
+				scene->game_over = true;
 		}
 	}
 }
 
-/* handle player input */
+/* step state of last published snapshot into written one, which next tick changes */
+void advance_snapshot(scene_t* scene)
+{
+	if (scene != NULL) {
+#ifdef __WINDOWS__
+		vertice_t resolution = scene->fb.resolution;
+#else
+		vertice_t resolution = { scene->fb.var_info.xres, scene->fb.var_info.yres };
+#endif
+		snapshot_t* previous = &scene->snapshots[scene->published_snapshot];
+		snapshot_t* snapshot = &scene->snapshots[scene->written_snapshot];
+
+		scene->entities = &snapshot->entities;
+		scene->particles = &snapshot->particles;
+
+		/* move enemies and projectiles */
+		/* NOTE: enemies spawn above screen, they are only removed once below it */
+		update_entities(scene->entities, &previous->entities, (float)TICK_TIME, (region_t){ { 0, -resolution.y }, resolution });
+		update_particles(scene->particles, &previous->particles, (float)TICK_TIME);
+	}
+}
+
+/* hand state of tick due at @time to drawing (through free snapshot, no thread waits) */
+void publish_snapshot(scene_t* scene, const double time)
+{
+	if (scene != NULL) {
+		snapshot_t* snapshot = &scene->snapshots[scene->written_snapshot];
+
+		snapshot->time = time;
+		snapshot->player = scene->player.bound_box;
+		snapshot->score = scene->score;
+
+		/* written snapshot becomes free one, previous free one is written next (stepped from this one) */
+		scene->published_snapshot = scene->written_snapshot;
+		scene->written_snapshot = atomic_exchange(&scene->free_snapshot, scene->written_snapshot | SNAPSHOT_FRESH) & ~SNAPSHOT_FRESH;
+	}
+}
+
+/* get newest snapshot published (same as last one if nothing new) */
+static const snapshot_t* acquire_snapshot(scene_t* scene)
+{
+	if (atomic_load(&scene->free_snapshot) & SNAPSHOT_FRESH)
+		scene->drawn_snapshot = atomic_exchange(&scene->free_snapshot, scene->drawn_snapshot) & ~SNAPSHOT_FRESH;
+
+	return &scene->snapshots[scene->drawn_snapshot];
+}
+
+/* render newest game state to screen */
+void render_game(scene_t* scene)
+{
+	if (scene != NULL) {
+		double start = get_time();
+		const snapshot_t* snapshot = acquire_snapshot(scene);
+
+		/* draw state between tick of snapshot and one before it */
+		double blend = (start - snapshot->time) / TICK_TIME;
+
+		blend = (blend < 0.0) ? 0.0 : (blend > 1.0) ? 1.0 : blend;
+
+		/* clear screen */
+		clear_screen(&scene->fb);
+
+		/* draw player */
+		vertice_t a = { (snapshot->player.end.x - snapshot->player.start.x) / 2 + snapshot->player.start.x, snapshot->player.start.y };
+		vertice_t b = { snapshot->player.start.x, snapshot->player.end.y };
+
+		record_triangle(&scene->cb, a, b, snapshot->player.end, snapshot->player.color);
+
+		/* draw enemies */
+		draw_entities(&scene->cb, &snapshot->entities, (float)blend);
+
+		execute_commands(&scene->fb, &scene->cb);
+
+		/* particles are drawn after commands finish, where they were a tick ago and blend of the way since */
+		draw_particles(&scene->fb, &scene->cb, &snapshot->particles, (float)((1.0 - blend) * TICK_TIME));
+
+		/* overlay goes over everything else */
+		draw_hud(&scene->fb, &scene->hud, snapshot->score, start);
+
+		double drawn = get_time();
+
+		present_screen(&scene->fb);
+		capture_frame(&scene->capture, &scene->fb);
+
+		/* keep track of frame time */
+		scene->stats.frames++;
+		scene->stats.render_time += drawn - start;
+		scene->stats.present_time += get_time() - drawn;
+	}
+}
+
+#if !defined(__WINDOWS__) && !defined(HARVEST_BENCH)
+/* draw frames until game is over (thread entry) */
+static void* run_renderer(void* arg)
+{
+	scene_t* scene = arg;
+	double next_frame = get_time();
+
+	while (atomic_load(&scene->drawing)) {
+		double now = get_time();
+
+		render_game(scene);
+
+		next_frame = (now - next_frame > scene->frame_time) ? now + scene->frame_time : next_frame + scene->frame_time;
+		sleep_until(next_frame);
+	}
+
+	return NULL;
+}
+#endif
+
+/* handle player input of current tick */
 void handle_input(scene_t* scene)
 {
 	if (scene != NULL) {
 #ifdef __WINDOWS__
 		long_t player_max_pos_left = 10;
 		long_t player_max_pos_right = scene->fb.resolution.x - 10;
+		long_t player_speed = scene->fb.resolution.x / 4;
+		long_t projectile_speed = scene->fb.resolution.y;
 #else
 		long_t player_max_pos_left = 10;
 		long_t player_max_pos_right = scene->fb.var_info.xres - 10;
+		long_t player_speed = scene->fb.var_info.xres / 4;
+		long_t projectile_speed = scene->fb.var_info.yres;
 #endif
 
-		/* handle keyboard input */
-		ubyte_t ch = get_char();
+		/* handle keyboard input (replay is over on its last tick) */
+		if (!poll_logged_input(&scene->input_log, &scene->input))
+			scene->game_over = true;
 
-		switch (ch) {
-			case 'D':
-			case 'd':
-				if (player_max_pos_right > scene->player.bound_box.end.x + 12) {
-					scene->player.bound_box.start.x += 12;
-					scene->player.bound_box.end.x += 12;
-				}
-				break;
+		/* move while key is held, a terminal key press steps until the key repeats */
+		bool right = is_key_held(&scene->input, 'd') || is_key_held(&scene->input, INPUT_KEY_RIGHT);
+		bool left = is_key_held(&scene->input, 'a') || is_key_held(&scene->input, INPUT_KEY_LEFT);
+		double step = 0.0;
 
-			case 'A':
-			case 'a':
-				if (player_max_pos_left < scene->player.bound_box.start.x - 12) {
-					scene->player.bound_box.start.x -= 12;
-					scene->player.bound_box.end.x -= 12;
-				}
-				break;
+		scene->player.velocity.x = 0;
 
-			case '\e':
-				scene->game_over = true;
+		if (right)
+			scene->player.velocity.x += player_speed;
+		else if (was_key_pressed(&scene->input, 'd') || was_key_pressed(&scene->input, INPUT_KEY_RIGHT))
+			step += player_speed * KEY_TAP_TIME;
+
+		if (left)
+			scene->player.velocity.x -= player_speed;
+		else if (was_key_pressed(&scene->input, 'a') || was_key_pressed(&scene->input, INPUT_KEY_LEFT))
+			step -= player_speed * KEY_TAP_TIME;
+
+		/* fractions of a pixel add up over ticks, small screens move at their speed too */
+		long_t width = scene->player.bound_box.end.x - scene->player.bound_box.start.x;
+		float x = scene->player.coord_x + (float)((scene->player.velocity.x * TICK_TIME) + step);
+
+		if (scene->player.velocity.x != 0 || step != 0.0) {
+			x = (x < player_max_pos_left) ? player_max_pos_left : x;
+			x = (x > player_max_pos_right - width) ? player_max_pos_right - width : x;
+
+			scene->player.coord_x = x;
+			scene->player.bound_box.start.x = (long_t)x;
+			scene->player.bound_box.end.x = scene->player.bound_box.start.x + width;
+		}
+
+		/* shoot from player tip (held key keeps shooting as terminal repeats it) */
+		if (was_key_pressed(&scene->input, ' ')) {
+			spawn_entity(scene->entities, ENTITY_PROJECTILE, (vertice_t){ (scene->player.bound_box.start.x + scene->player.bound_box.end.x) / 2, scene->player.bound_box.start.y },
+				(vertice_t){ 0, -projectile_speed }, (vertice_t){ 0, 0 }, (vertice_t){ 2, 8 }, (color_t){ 255, 240, 120, 255 });
 		}
+
+		if (was_key_pressed(&scene->input, INPUT_KEY_ESCAPE))
+			scene->game_over = true;
 	}
 }
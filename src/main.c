@@ -21,6 +21,7 @@
  *************************************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
 #include <time.h>
@@ -34,9 +35,39 @@
 #else /* assume POSIX */
 	#include <sys/select.h>
 	#include <sys/time.h>
+	#include <unistd.h>
+	#include <pthread.h>
+#endif
+
+/* SSE2 is used when available for glyph matching */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define USE_SSE2
+
+	#include <emmintrin.h>
 #endif
 
 #define SECOND_MS 1000 /* how many miliseconds are there in a second */
+#define INDEX_CELL_SIZE 32 /* size of each cell of the canvas spatial index */
+#define MAX_CELL_BYTES 3   /* longest UTF-8 sequence written per terminal cell */
+#define MAX_SGR_BYTES 40   /* longest SGR escape sequence written between cells */
+#define GLYPH_FIRST ' '    /* first glyph used by the converter */
+#define GLYPH_COUNT 96     /* number of glyphs in the feature table (padded to a multiple of 8) */
+#define FEATURE_COUNT 6    /* coverage features per glyph (2x3 subgrid) */
+#define FEATURE_STRIDE 8   /* bytes between features of two glyphs */
+#define FEATURE_BITS 3     /* bits kept from each feature for memoization */
+#define DEFAULT_COLUMNS 200 /* characters per line of converted images */
+#define RAMP_LEVELS 16     /* glyphs of the luminance ramp used for dithering */
+#define BAND_LINES 64      /* source lines read and converted at once */
+#define MAX_WORKERS 16     /* most threads used by the converter */
+
+/* packed cell attributes (see attr_t) */
+#define ATTR_DEFAULT 0ULL                 /* terminal default colors */
+#define ATTR_FG_SET (1ULL << 24)          /* foreground color is set */
+#define ATTR_BG_SET (1ULL << 56)          /* background color is set */
+#define ATTR_FG_MASK (ATTR_FG_SET | 0xFFFFFFULL)
+#define ATTR_BG_MASK (ATTR_FG_MASK << 32)
+#define ATTR_FG(r, g, b) (ATTR_FG_SET | ((attr_t)(r) << 16) | ((attr_t)(g) << 8) | (attr_t)(b))
+#define ATTR_BG(r, g, b) (ATTR_FG(r, g, b) << 32)
 
 /* NOTE: you may wanna change the macros below */
 #define NUM_FRAMES 15    /* number of frames will be loaded */
@@ -44,16 +75,21 @@
 #define FRAME_HEIGHT 25  /* height of frames */
 #define SCREEN_WIDTH 25  /* width of the screen */
 #define SCREEN_HEIGHT 25 /* height of the screen */
+#define CANVAS_WIDTH 800 /* width of the virtual canvas */
+#define CANVAS_HEIGHT 400 /* height of the virtual canvas */
+#define WIDGET_SPACING 5 /* space between images placed on the canvas */
+#define VIEWPORT_STEP 5  /* how many pixels the viewport moves per key press */
 #define FRAME_RATE 60    /* how many frames to be rendered per second */
 
-/* declare functions (forward declarations) */
-void free_memory(void** ptr);
-void clear_cli();
-char get_char(const long timeout_sec, const long timeout_usec);
-char to_lower(const char letter);
-long find_ceil(const double number);
+/* define data types */
+typedef uint64_t attr_t; /* foreground RGB on bits 0-23 and background RGB on bits 32-55 */
 
 /* define struct types */
+typedef struct cell_s {
+	char   _glyph; /* character shown in the cell */
+	attr_t _attr;  /* packed colors of the cell */
+} cell_t;
+
 typedef struct point_s {
 	int _x;
 	int _y;
@@ -70,33 +106,73 @@ typedef enum status_e {
 
 typedef enum option_e {
 	OPTION_NONE,              /* do nothing */
-	OPTION_SHIFT_UP = 'w',    /* move image up */
-	OPTION_SHIFT_DOWN = 's',  /* move image down */
-	OPTION_SHIFT_LEFT = 'a',  /* move image left */
-	OPTION_SHIFT_RIGHT = 'd', /* move image right */
-	OPTION_SHIFT_AUTO = 'p',  /* align image automaticly */
+	OPTION_SHIFT_UP = 'w',    /* move viewport up */
+	OPTION_SHIFT_DOWN = 's',  /* move viewport down */
+	OPTION_SHIFT_LEFT = 'a',  /* move viewport left */
+	OPTION_SHIFT_RIGHT = 'd', /* move viewport right */
+	OPTION_SHIFT_AUTO = 'p',  /* center viewport on first image */
+	OPTION_OUTPUT_MODE = 'm', /* switch between output modes */
+	OPTION_COLOR_MODE = 'c',  /* switch between color modes */
 	OPTION_EXIT = 'o'         /* exit menu */
 } option_t;
 
+typedef enum output_e {
+	OUTPUT_ASCII,      /* one character per pixel */
+	OUTPUT_HALF_BLOCK, /* 1x2 pixels per character using half blocks */
+	OUTPUT_BRAILLE,    /* 2x4 pixels per character using braille patterns */
+	OUTPUT_COUNT       /* number of output modes */
+} output_t;
+
+typedef enum method_e {
+	METHOD_SHAPE,   /* match shape of each character block */
+	METHOD_ORDERED, /* ordered dithering over a luminance ramp */
+	METHOD_DIFFUSE  /* serpentine error diffusion over a luminance ramp */
+} method_t;
+
+typedef enum color_e {
+	COLOR_NONE,      /* no escape sequences at all */
+	COLOR_256,       /* colors quantized to the xterm 256 color palette */
+	COLOR_TRUECOLOR  /* 24-bit colors */
+} color_t;
+
+/* declare functions (forward declarations) */
+void free_memory(void** ptr);
+void build_output_tables();
+color_t find_color_mode();
+void clear_cli();
+char get_char(const long timeout_sec, const long timeout_usec);
+char to_lower(const char letter);
+long find_ceil(const double number);
+bool read_pnm_header(FILE* file, size_t* width, size_t* height, int* channels, int* maxval);
+void build_ramp_tables();
+double get_time();
+
 /* define object types (class emulation) */
 typedef struct frame_s {
-	char*  _pixel_matrix; /* matrix where the pixels can be found */
-	size_t _width;        /* width of the frame */
-	size_t _height;       /* height of the frame */
+	char*   _pixel_matrix; /* matrix where the pixels can be found */
+	attr_t* _attr_matrix;  /* matrix of pixel colors (optional) */
+	bool    _owns_matrix;  /* matrices are freed with the frame */
+	size_t  _width;        /* width of the frame */
+	size_t  _height;       /* height of the frame */
 
 	/* declare methods */
 	void (*dtor)(struct frame_s* self);
 
 	char (*get_pixel)(struct frame_s* self, size_t colunm, size_t line);
 	void (*set_pixel)(struct frame_s* self, const char value, size_t colunm, size_t line);
+	attr_t (*get_attr)(struct frame_s* self, size_t colunm, size_t line);
 
 	bool (*swap_matrix)(struct frame_s* self, char* array, size_t width, size_t height);
+	bool (*swap_attr_matrix)(struct frame_s* self, attr_t* array);
 } frame_t;
 
 typedef struct image_s {
 	frame_t* _frame_array;  /* array of frame_t objects */
 	size_t   _frames_count; /* number of frames in the array */
 	size_t   _curr_frame;   /* frame being prepared for render */
+	point_t  _position;     /* position of the image on the canvas */
+	attr_t   _tint;         /* colors of frames without color matrix */
+	size_t   _visit_mark;   /* last render pass that visited this image */
 
 	/* declare methods */
 	void (*dtor)(struct image_s* self);
@@ -104,6 +180,11 @@ typedef struct image_s {
 	size_t (*get_frames_count)(struct image_s* self);
 	frame_t* (*get_curr_frame)(struct image_s* self);
 	void (*set_curr_frame)(struct image_s* self, size_t curr_frame);
+	point_t* (*get_position)(struct image_s* self);
+	void (*set_position)(struct image_s* self, point_t position);
+	point_t (*find_bounds)(struct image_s* self);
+	attr_t (*get_tint)(struct image_s* self);
+	void (*set_tint)(struct image_s* self, const attr_t tint);
 
 	bool (*add_frame)(struct image_s* self, frame_t* frame);
 } image_t;
@@ -111,19 +192,35 @@ typedef struct image_s {
 typedef struct screen_s {
 	image_t* _render_array;   /* array of pointers to image_t objects that will be rendered */
 	size_t   _images_count;   /* number of images in the array */
-	char*    _render_surface; /* surface to render the images */
-	point_t  _relative_pos;   /* position of the frames relative to the screen */
-	size_t   _width;          /* width of the screen */
-	size_t   _height;         /* height of the screen */
+	cell_t*  _render_surface; /* surface to render the images */
+	point_t  _relative_pos;   /* position of the viewport on the canvas */
+	size_t   _width;          /* width of the screen (viewport) */
+	size_t   _height;         /* height of the screen (viewport) */
+	size_t   _canvas_width;   /* width of the virtual canvas */
+	size_t   _canvas_height;  /* height of the virtual canvas */
+	size_t*  _index_offsets;  /* first entry of each index cell in @_index_items */
+	size_t*  _index_items;    /* image indexes sorted by index cell */
+	size_t*  _visible_items;  /* image indexes intersecting the viewport */
+	size_t   _index_columns;  /* number of index cell columns */
+	size_t   _index_rows;     /* number of index cell rows */
+	bool     _index_dirty;    /* index must be rebuilt before next render */
+	size_t   _visit_count;    /* number of render passes done */
 	short    _frame_rate;     /* rate of frames per second (hertz) */
 	clock_t  _frame_delta;    /* delta time between frames */
 	char*    _menu;           /* array that represents the menu interface */
+	output_t _output_mode;    /* how pixels are packed into characters */
+	color_t  _color_mode;     /* how colors are written */
+	char*    _output_buffer;  /* encoded surface written to stdout */
+	size_t   _output_size;    /* size of the output buffer */
 
 	/* declare methods */
 	void (*dtor)(struct screen_s* self);
 
 	size_t (*get_images_count)(struct screen_s* self);
 	void (*set_size)(struct screen_s* self, size_t width, size_t height);
+	void (*set_canvas_size)(struct screen_s* self, size_t width, size_t height);
+	size_t (*get_canvas_width)(struct screen_s* self);
+	size_t (*get_canvas_height)(struct screen_s* self);
 	point_t* (*get_relative_pos)(struct screen_s* self);
 	void (*set_relative_pos)(struct screen_s* self, point_t relative_pos);
 	size_t (*get_width)(struct screen_s* self);
@@ -131,19 +228,142 @@ typedef struct screen_s {
 	short (*get_frame_rate)(struct screen_s* self);
 	void (*set_frame_rate)(struct screen_s* self, const short frame_rate);
 	void (*swap_menu)(struct screen_s* self, char* menu);
+	output_t (*get_output_mode)(struct screen_s* self);
+	void (*set_output_mode)(struct screen_s* self, const output_t output_mode);
+	color_t (*get_color_mode)(struct screen_s* self);
+	void (*set_color_mode)(struct screen_s* self, const color_t color_mode);
 
 	bool (*add_image)(struct screen_s* self, image_t* image);
+	void (*move_image)(struct screen_s* self, size_t image_index, point_t position);
+	bool (*build_index)(struct screen_s* self);
 	double (*calculate_frame_delta)(struct screen_s* self);
 	point_t (*calculate_pixel_pos)(struct screen_s* self, size_t colunm, size_t line);
 	point_t (*find_image_aligned_pos)(struct screen_s* self, size_t image_index);
+	size_t (*encode_surface)(struct screen_s* self);
 	void (*render)(struct screen_s* self);
 } screen_t;
 
+typedef struct worker_s {
+	struct converter_s* _converter;  /* converter the worker belongs to */
+	size_t              _first_cell; /* first character column converted by the worker */
+	size_t              _last_cell;  /* character column after the last one converted */
+	size_t              _first_x;    /* first source column read by the worker */
+	size_t              _last_x;     /* source column after the last one read */
+	size_t              _generation; /* last job done by the worker */
+#ifndef WINDOWS
+	pthread_t           _thread;     /* thread running the worker */
+#endif
+} worker_t;
+
+typedef struct converter_s {
+	size_t          _target_columns; /* characters per line asked by the user */
+	size_t          _columns;        /* characters per line */
+	size_t          _rows;           /* lines of characters */
+	size_t          _source_width;   /* width of source images */
+	size_t          _source_height;  /* height of source images */
+	int             _channels;       /* samples per source pixel */
+	size_t          _sample_size;    /* bytes per source sample */
+	size_t          _line_bytes;     /* bytes per source line */
+	size_t*         _column_map;     /* subcolumn of each source column */
+	size_t*         _row_map;        /* subrow of each source line of current band (and of the line after it) */
+	size_t*         _column_count;   /* source columns in each subcolumn */
+	size_t*         _row_count;      /* source lines in each subrow */
+	unsigned long*  _sums;           /* luminance sums of current subrow */
+	unsigned char*  _features;       /* ring of features of the last lines of characters */
+	char*           _glyphs;         /* ring of the last lines of characters */
+	size_t          _ring_rows;      /* lines of characters kept by the rings */
+	size_t          _rows_written;   /* lines of characters of current image already written */
+	unsigned char*  _bands[2];       /* source lines being read and converted */
+	size_t          _band_lines;     /* source lines per band */
+	int*            _errors;         /* diffusion errors of current and next line of characters */
+	unsigned char*  _memo;           /* glyph matched for each quantized feature signature */
+	method_t        _method;         /* how characters are chosen */
+	bool            _invert;         /* match dark glyphs on light background */
+	worker_t*       _workers;        /* workers converting parts of each band */
+	size_t          _workers_count;  /* number of workers */
+	size_t          _threads_count;  /* workers running on their own thread */
+	size_t          _target_threads; /* threads asked by the user (0 for one per processor) */
+	unsigned char*  _job_band;       /* band being converted by the workers */
+	size_t          _job_first_line; /* first source line of the band */
+	size_t          _job_last_line;  /* source line after the last one of the band */
+#ifndef WINDOWS
+	pthread_mutex_t _lock;           /* protects the job state below */
+	pthread_cond_t  _work_signal;    /* new job is available */
+	pthread_cond_t  _done_signal;    /* all workers finished the job */
+	size_t          _generation;     /* job counter */
+	size_t          _pending;        /* workers still running the job */
+	bool            _quit;           /* workers must terminate */
+#endif
+
+	/* declare methods */
+	void (*dtor)(struct converter_s* self);
+
+	size_t (*get_columns)(struct converter_s* self);
+	void (*set_columns)(struct converter_s* self, size_t columns);
+	size_t (*get_rows)(struct converter_s* self);
+	void (*set_invert)(struct converter_s* self, const bool invert);
+	void (*set_method)(struct converter_s* self, const method_t method);
+	void (*set_threads)(struct converter_s* self, size_t threads);
+
+	bool (*set_size)(struct converter_s* self, size_t source_width, size_t source_height);
+	char (*match_block)(struct converter_s* self, const unsigned char* features);
+	bool (*convert)(struct converter_s* self, FILE* input, FILE* output, frame_t* frame);
+} converter_t;
+
+/* define lookup tables */
+static char half_block_table[4][MAX_CELL_BYTES + 1]; /* pixel mask (top, bottom) to UTF-8 half block */
+static char braille_table[256][MAX_CELL_BYTES + 1];  /* pixel mask (row-major 2x4) to UTF-8 braille pattern */
+static unsigned char cube_table[256];                /* color component to xterm color cube level */
+static char ramp_table[RAMP_LEVELS];                 /* glyphs of the luminance ramp (darkest first) */
+static unsigned char ramp_values[RAMP_LEVELS];       /* luminance of each glyph of the ramp */
+static unsigned char ramp_lookup[256];               /* luminance to nearest level of the ramp */
+
+/* 4x4 Bayer matrix used for ordered dithering */
+static const unsigned char bayer_table[4][4] = {
+	{  0,  8,  2, 10 },
+	{ 12,  4, 14,  6 },
+	{  3, 11,  1,  9 },
+	{ 15,  7, 13,  5 }
+};
+
+/* coverage of each printable glyph in a 2x3 subgrid (row-major, scaled to 0-255),
+	measured from DejaVu Sans Mono, last entry repeats the space as padding */
+static const unsigned char glyph_features[GLYPH_COUNT][FEATURE_STRIDE] = {
+	{   0,   0,   0,   0,   0,   0,   0,   0 }, {  41,  41,  60,  61,  28,  28,   0,   0 }, {  72,  72,  32,  32,   0,   0,   0,   0 }, {  51,  70, 248, 247,  58,  46,   0,   0 },
+	{  60,  86, 129, 160,  80, 118,   0,   0 }, { 104,   7, 166, 169,   6, 100,   0,   0 }, {  93,  43, 193, 150,  98, 119,   0,   0 }, {  31,  31,  14,  14,   0,   0,   0,   0 },
+	{  15,  63, 135,  16,  34,  68,   0,   0 }, {  63,  15,  16, 135,  69,  34,   0,   0 }, {  62,  62,  78,  78,   0,   0,   0,   0 }, {   6,   6, 144, 144,  16,  16,   0,   0 },
+	{   0,   0,   0,   0,  82,  45,   0,   0 }, {   0,   0,  39,  39,   0,   0,   0,   0 }, {   0,   0,   0,   0,  42,  42,   0,   0 }, {   0,  76,  77,  77,  96,   0,   0,   0 },
+	{  95,  95, 193, 193,  81,  81,   0,   0 }, {  72,  72,  21, 145,  63, 113,   0,   0 }, {  85, 100,  54, 121, 115,  77,   0,   0 }, {  77,  98,  41, 184,  88,  89,   0,   0 },
+	{  20, 104, 179, 195,   0,  59,   0,   0 }, { 113,  59,  98, 154,  85,  82,   0,   0 }, {  91,  68, 210, 158,  80,  88,   0,   0 }, {  86, 124,  33, 129,  65,   3,   0,   0 },
+	{ 103, 103, 179, 180,  92,  91,   0,   0 }, { 104,  94, 144, 208,  68,  75,   0,   0 }, {   0,   0,  39,  39,  42,  42,   0,   0 }, {   0,   0,  39,  39,  82,  45,   0,   0 },
+	{   0,   2, 163, 153,   0,  39,   0,   0 }, {   0,   0, 190, 190,   0,   0,   0,   0 }, {   2,   0, 153, 163,  39,   0,   0,   0 }, {  66, 102,  45, 105,  36,  21,   0,   0 },
+	{  63,  80, 217, 195, 128, 148,   0,   0 }, {  66,  67, 197, 197,  67,  68,   0,   0 }, { 128, 100, 211, 194, 113,  93,   0,   0 }, {  87,  83, 172,   0,  72,  83,   0,   0 },
+	{ 131,  85, 166, 170, 115,  69,   0,   0 }, { 119,  82, 202,  77, 104,  86,   0,   0 }, { 115,  86, 197,  77,  67,   0,   0,   0 }, {  93,  78, 168, 124,  78, 104,   0,   0 },
+	{  83,  83, 216, 216,  67,  67,   0,   0 }, {  96,  96,  83,  83,  88,  88,   0,   0 }, {  41, 105,   0, 166,  96,  69,   0,   0 }, {  83,  95, 255, 125,  67,  78,   0,   0 },
+	{  83,   0, 166,   0, 104,  91,   0,   0 }, { 133, 134, 241, 242,  67,  67,   0,   0 }, { 135,  83, 227, 241,  67, 107,   0,   0 }, { 100, 100, 167, 167,  84,  85,   0,   0 },
+	{ 119, 111, 197, 135,  67,   0,   0,   0 }, { 100, 100, 167, 167,  84, 138,   0,   0 }, { 122,  97, 195, 184,  59,  70,   0,   0 }, { 100,  69, 116, 137,  85,  90,   0,   0 },
+	{ 123, 123,  83,  83,  34,  34,   0,   0 }, {  83,  83, 166, 166,  87,  87,   0,   0 }, {  82,  82, 151, 151,  52,  52,   0,   0 }, {  77,  77, 249, 247,  81,  81,   0,   0 },
+	{  85,  84, 148, 150,  71,  69,   0,   0 }, {  85,  85, 118, 118,  34,  34,   0,   0 }, {  77, 146,  82,  87, 112, 100,   0,   0 }, {  70,  50, 124,  21,  89,  47,   0,   0 },
+	{  77,   0,  99,  55,   0,  96,   0,   0 }, {  50,  70,  21, 124,  47,  89,   0,   0 }, {  74,  74,  34,  34,   0,   0,   0,   0 }, {   0,   0,   0,   0,  47,  47,   0,   0 },
+	{  52,  14,   0,   0,   0,   0,   0,   0 }, {   9,   6, 157, 206,  95, 103,   0,   0 }, {  83,   8, 185, 174,  99,  89,   0,   0 }, {   2,  12, 163,  62,  69,  74,   0,   0 },
+	{   8,  95, 176, 206,  88, 107,   0,   0 }, {   5,   8, 215, 179,  80,  80,   0,   0 }, {  47,  94, 139,  90,  42,  17,   0,   0 }, {   8,   2, 177, 204, 140, 194,   0,   0 },
+	{  83,  10, 179, 170,  59,  59,   0,   0 }, {  27,  26,  98,  83,  80,  92,   0,   0 }, {  14,  45,  60, 145,  93, 106,   0,   0 }, {  93,   6, 210, 156,  67,  73,   0,   0 },
+	{ 120,  12, 124,  21,  28,  78,   0,   0 }, {  12,   8, 244, 221,  84,  76,   0,   0 }, {   6,  10, 179, 170,  59,  59,   0,   0 }, {   6,   6, 177, 177,  83,  83,   0,   0 },
+	{   7,   8, 206, 177, 195,  88,   0,   0 }, {   5,   3, 177, 192,  83, 181,   0,   0 }, {   5,  12, 162,  84,  59,   0,   0,   0 }, {   6,   9, 151, 139,  70,  80,   0,   0 },
+	{  67,  10, 184,  52,  40,  67,   0,   0 }, {   0,   0, 145, 147,  88,  98,   0,   0 }, {   5,   5, 151, 151,  53,  53,   0,   0 }, {   5,   5, 199, 199,  80,  80,   0,   0 },
+	{   5,   5, 149, 149,  69,  69,   0,   0 }, {   5,   5, 153, 151, 139,  63,   0,   0 }, {  10,  10, 100, 142,  98,  62,   0,   0 }, {  25,  87, 127,  60,  41, 109,   0,   0 },
+	{  35,  35,  62,  62,  62,  62,   0,   0 }, {  89,  25,  60, 125, 108,  39,   0,   0 }, {   0,   0,  92,  93,   0,   0,   0,   0 }, {   0,   0,   0,   0,   0,   0,   0,   0 }
+};
+
 /* define methods */
 /* frame_t object destructor */
 static void _frame_dtor(frame_t* self)
 {
-	/*free_memory((void**)&(self->_pixel_matrix));*/
+	/* matrices given by the user are not ours to free */
+	if (self->_owns_matrix) {
+		free_memory((void**)&(self->_pixel_matrix));
+		free_memory((void**)&(self->_attr_matrix));
+	}
 }
 
 /* get pixel value in given position */
@@ -166,6 +386,17 @@ static void _frame_set_pixel(frame_t* self, const char value, size_t colunm, siz
 	}
 }
 
+/* get pixel colors in given position */
+static attr_t _frame_get_attr(frame_t* self, size_t colunm, size_t line)
+{
+	attr_t result = ATTR_DEFAULT;
+
+	if (self != NULL && self->_attr_matrix != NULL)
+		result = (colunm < self->_width && line < self->_height) ? self->_attr_matrix[colunm + (line * self->_width)] : result;
+
+	return result;
+}
+
 /* copy @matrix to @self->_pixel_matrix */
 static bool _frame_swap_matrix(frame_t* self, char* matrix, size_t width, size_t height)
 {
@@ -177,6 +408,24 @@ static bool _frame_swap_matrix(frame_t* self, char* matrix, size_t width, size_t
 		self->_height = height;
 		self->_pixel_matrix = matrix;
 
+		/* colors of previous matrix don't apply anymore */
+		self->_attr_matrix = NULL;
+		self->_owns_matrix = false;
+
+		error = false;
+	}
+
+	return error;
+}
+
+/* copy @matrix to @self->_attr_matrix (same size as pixel matrix) */
+static bool _frame_swap_attr_matrix(frame_t* self, attr_t* matrix)
+{
+	bool error = true;
+
+	if (self != NULL && self->_pixel_matrix != NULL) {
+		self->_attr_matrix = matrix;
+
 		error = false;
 	}
 
@@ -186,6 +435,9 @@ static bool _frame_swap_matrix(frame_t* self, char* matrix, size_t width, size_t
 /* image_t object destructor */
 static void _image_dtor(image_t* self)
 {
+	for (size_t i = 0; i < self->_frames_count; i++)
+		self->_frame_array[i].dtor(&self->_frame_array[i]);
+
 	free_memory((void**)&(self->_frame_array));
 }
 
@@ -208,6 +460,49 @@ static void _image_set_curr_frame(image_t* self, size_t curr_frame)
 		self->_curr_frame = curr_frame;
 }
 
+/* get image position on the canvas */
+static point_t* _image_get_position(image_t* self)
+{
+	return (self != NULL) ? &self->_position : NULL;
+}
+
+/* set image position on the canvas */
+static void _image_set_position(image_t* self, point_t position)
+{
+	if (self != NULL)
+		self->_position = position;
+}
+
+/* get colors of frames without color matrix */
+static attr_t _image_get_tint(image_t* self)
+{
+	return (self != NULL) ? self->_tint : ATTR_DEFAULT;
+}
+
+/* set colors of frames without color matrix */
+static void _image_set_tint(image_t* self, const attr_t tint)
+{
+	if (self != NULL)
+		self->_tint = tint;
+}
+
+/* find largest width and height among all frames of the image */
+static point_t _image_find_bounds(image_t* self)
+{
+	point_t result = { 0, 0 };
+
+	if (self != NULL) {
+		for (size_t i = 0; i < self->_frames_count; i++) {
+			if ((int)self->_frame_array[i]._width > result._x)
+				result._x = (int)self->_frame_array[i]._width;
+			if ((int)self->_frame_array[i]._height > result._y)
+				result._y = (int)self->_frame_array[i]._height;
+		}
+	}
+
+	return result;
+}
+
 /* copy @frame pointer to @self->_frame_array */
 static bool _image_add_frame(image_t* self, frame_t* frame)
 {
@@ -239,6 +534,10 @@ static void _screen_dtor(screen_t* self)
 {
 	free_memory((void**)&(self->_render_array));
 	free_memory((void**)&(self->_render_surface));
+	free_memory((void**)&(self->_index_offsets));
+	free_memory((void**)&(self->_index_items));
+	free_memory((void**)&(self->_visible_items));
+	free_memory((void**)&(self->_output_buffer));
 }
 
 /* get number of images to be rendered */
@@ -253,21 +552,51 @@ static void _screen_set_size(screen_t* self, size_t width, size_t height)
 	if (self != NULL) {
 		self->_width = width;
 		self->_height = height;
+
+		/* canvas is never smaller than the screen */
+		if (self->_canvas_width < width || self->_canvas_height < height)
+			self->set_canvas_size(self, (self->_canvas_width < width) ? width : self->_canvas_width,
+				(self->_canvas_height < height) ? height : self->_canvas_height);
+	}
+}
+
+/* set virtual canvas size */
+static void _screen_set_canvas_size(screen_t* self, size_t width, size_t height)
+{
+	if (self != NULL) {
+		self->_canvas_width = width;
+		self->_canvas_height = height;
+		self->_index_dirty = true;
 	}
 }
 
-/* get frames relative position */
+/* get virtual canvas width */
+static size_t _screen_get_canvas_width(screen_t* self)
+{
+	return (self != NULL) ? self->_canvas_width : 0;
+}
+
+/* get virtual canvas height */
+static size_t _screen_get_canvas_height(screen_t* self)
+{
+	return (self != NULL) ? self->_canvas_height : 0;
+}
+
+/* get viewport position on the canvas */
 static point_t* _screen_get_relative_pos(screen_t* self)
 {
 	return (self != NULL) ? &self->_relative_pos : NULL;
 }
 
-/* set frames relative position */
+/* set viewport position on the canvas (kept inside canvas boundaries) */
 static void _screen_set_relative_pos(screen_t* self, point_t relative_pos)
 {
 	if (self != NULL) {
-		self->_relative_pos._x = relative_pos._x;
-		self->_relative_pos._y = relative_pos._y;
+		int max_x = (self->_canvas_width > self->_width) ? (int)(self->_canvas_width - self->_width) : 0;
+		int max_y = (self->_canvas_height > self->_height) ? (int)(self->_canvas_height - self->_height) : 0;
+
+		self->_relative_pos._x = (relative_pos._x < 0) ? 0 : (relative_pos._x > max_x) ? max_x : relative_pos._x;
+		self->_relative_pos._y = (relative_pos._y < 0) ? 0 : (relative_pos._y > max_y) ? max_y : relative_pos._y;
 	}
 }
 
@@ -303,6 +632,32 @@ static void _screen_swap_menu(screen_t* self, char* menu)
 		self->_menu = menu;
 }
 
+/* get output mode */
+static output_t _screen_get_output_mode(screen_t* self)
+{
+	return (self != NULL) ? self->_output_mode : OUTPUT_ASCII;
+}
+
+/* set output mode */
+static void _screen_set_output_mode(screen_t* self, const output_t output_mode)
+{
+	if (self != NULL && output_mode < OUTPUT_COUNT)
+		self->_output_mode = output_mode;
+}
+
+/* get color mode */
+static color_t _screen_get_color_mode(screen_t* self)
+{
+	return (self != NULL) ? self->_color_mode : COLOR_NONE;
+}
+
+/* set color mode */
+static void _screen_set_color_mode(screen_t* self, const color_t color_mode)
+{
+	if (self != NULL)
+		self->_color_mode = color_mode;
+}
+
 /* copy @image pointer to @self->_render_array */
 static bool _screen_add_image(screen_t* self, image_t* image)
 {
@@ -322,6 +677,9 @@ static bool _screen_add_image(screen_t* self, image_t* image)
 			/* keep track of the number of images */
 			self->_images_count++;
 
+			/* spatial index no longer matches the images */
+			self->_index_dirty = true;
+
 			error = false;
 		}
 	}
@@ -329,41 +687,322 @@ static bool _screen_add_image(screen_t* self, image_t* image)
 	return error;
 }
 
+/* move image to a new position on the canvas */
+static void _screen_move_image(screen_t* self, size_t image_index, point_t position)
+{
+	if (self != NULL && image_index < self->_images_count) {
+		self->_render_array[image_index].set_position(&self->_render_array[image_index], position);
+		self->_index_dirty = true;
+	}
+}
+
+/* rebuild spatial index of images on the canvas (counting sort into cells) */
+static bool _screen_build_index(screen_t* self)
+{
+	bool error = true;
+
+	if (self != NULL) {
+		size_t columns = (self->_canvas_width + INDEX_CELL_SIZE - 1) / INDEX_CELL_SIZE;
+		size_t rows = (self->_canvas_height + INDEX_CELL_SIZE - 1) / INDEX_CELL_SIZE;
+		size_t cells = columns * rows;
+		size_t total = 0;
+
+		/* free up memory */
+		free_memory((void**)&self->_index_offsets);
+		free_memory((void**)&self->_index_items);
+		free_memory((void**)&self->_visible_items);
+
+		if ((self->_index_offsets = calloc(cells + 1, sizeof(size_t))) != NULL) {
+			/* count how many images overlap each cell */
+			for (int pass = 0; pass < 2; pass++) {
+				for (size_t i = 0; i < self->_images_count; i++) {
+					image_t* tmp_image_ptr = &self->_render_array[i];
+					point_t bounds = tmp_image_ptr->find_bounds(tmp_image_ptr);
+					long left = tmp_image_ptr->_position._x;
+					long top = tmp_image_ptr->_position._y;
+					long right = left + bounds._x;
+					long bottom = top + bounds._y;
+
+					/* images outside the canvas are never visible */
+					if (bounds._x == 0 || bounds._y == 0 || right <= 0 || bottom <= 0 ||
+						left >= (long)self->_canvas_width || top >= (long)self->_canvas_height)
+						continue;
+
+					size_t first_column = (left < 0) ? 0 : (size_t)left / INDEX_CELL_SIZE;
+					size_t first_row = (top < 0) ? 0 : (size_t)top / INDEX_CELL_SIZE;
+					size_t last_column = ((size_t)right - 1) / INDEX_CELL_SIZE;
+					size_t last_row = ((size_t)bottom - 1) / INDEX_CELL_SIZE;
+
+					if (last_column >= columns)
+						last_column = columns - 1;
+					if (last_row >= rows)
+						last_row = rows - 1;
+
+					for (size_t k = first_row; k <= last_row; k++) {
+						for (size_t j = first_column; j <= last_column; j++) {
+							if (pass == 0)
+								self->_index_offsets[j + (k * columns) + 1]++;
+							else
+								self->_index_items[self->_index_offsets[j + (k * columns)]++] = i;
+						}
+					}
+				}
+
+				if (pass == 0) {
+					/* turn counts into offsets */
+					for (size_t j = 0; j < cells; j++)
+						self->_index_offsets[j + 1] += self->_index_offsets[j];
+
+					total = self->_index_offsets[cells];
+
+					self->_index_items = malloc(sizeof(size_t) * (total + 1));
+					self->_visible_items = malloc(sizeof(size_t) * (self->_images_count + 1));
+
+					if (self->_index_items == NULL || self->_visible_items == NULL)
+						break;
+				}
+				else {
+					/* filling moved each offset to the start of the next cell */
+					for (size_t j = cells; j > 0; j--)
+						self->_index_offsets[j] = self->_index_offsets[j - 1];
+
+					self->_index_offsets[0] = 0;
+
+					error = false;
+				}
+			}
+		}
+
+		self->_index_columns = columns;
+		self->_index_rows = rows;
+		self->_index_dirty = error;
+	}
+
+	return error;
+}
+
 /* calculate the frame delta time */
 static double _screen_calculate_frame_delta(screen_t* self)
 {
 	return (self != NULL) ? (double)SECOND_MS / self->_frame_rate : 0.0;
 }
 
-/* calculate pixel position (using @self->_relative_pos) on screen */
+/* calculate pixel position on screen from canvas position (using @self->_relative_pos) */
 static point_t _screen_calculate_pixel_pos(screen_t* self, size_t colunm, size_t line)
 {
 	point_t result = { (int)colunm, (int)line };
 
 	if (self != NULL) {
-		/* calculate and store actual colunm/line position after shift */
-		result._x = (int)(((self->_width + self->_relative_pos._x) + colunm) % self->_width);
-		result._y = (int)(((self->_height + self->_relative_pos._y) + line) % self->_height);
+		/* calculate and store actual colunm/line position inside viewport */
+		result._x = (int)colunm - self->_relative_pos._x;
+		result._y = (int)line - self->_relative_pos._y;
 	}
 
 	return result;
 }
 
-/* find image aligned position */
+/* find viewport position that centers the image */
 static point_t _screen_find_image_aligned_pos(screen_t* self, size_t image_index)
 {
 	point_t result = { 0, 0 };
-	image_t* tmp_image_ptr = &self->_render_array[image_index];
-	frame_t* tmp_frame_ptr = &tmp_image_ptr->_frame_array[tmp_image_ptr->_curr_frame];
 
-	if (self != NULL) {
-		result._x = find_ceil((double)(self->_width - tmp_frame_ptr->_width - 2) / 2);
-		result._y = find_ceil((double)(self->_height - tmp_frame_ptr->_height - 2) / 2);
+	if (self != NULL && image_index < self->_images_count) {
+		image_t* tmp_image_ptr = &self->_render_array[image_index];
+		frame_t* tmp_frame_ptr = &tmp_image_ptr->_frame_array[tmp_image_ptr->_curr_frame];
+
+		result._x = tmp_image_ptr->_position._x - (int)find_ceil(((double)self->_width - tmp_frame_ptr->_width - 2) / 2);
+		result._y = tmp_image_ptr->_position._y - (int)find_ceil(((double)self->_height - tmp_frame_ptr->_height - 2) / 2);
 	}
 
 	return result;
 }
 
+/* find nearest color of the xterm 256 color palette */
+static int find_xterm_color(const attr_t color)
+{
+	const int levels[6] = { 0, 95, 135, 175, 215, 255 }; /* values of each color cube level */
+	int red = (int)((color >> 16) & 0xFF);
+	int green = (int)((color >> 8) & 0xFF);
+	int blue = (int)(color & 0xFF);
+
+	/* nearest color of the 6x6x6 cube */
+	int cube_red = levels[cube_table[red]] - red;
+	int cube_green = levels[cube_table[green]] - green;
+	int cube_blue = levels[cube_table[blue]] - blue;
+	int cube_distance = (cube_red * cube_red) + (cube_green * cube_green) + (cube_blue * cube_blue);
+
+	/* nearest color of the grayscale ramp (8 to 238 in steps of 10) */
+	int gray = (((red + green + blue) / 3) - 3) / 10;
+	gray = (gray < 0) ? 0 : (gray > 23) ? 23 : gray;
+
+	int gray_red = (8 + (gray * 10)) - red;
+	int gray_green = (8 + (gray * 10)) - green;
+	int gray_blue = (8 + (gray * 10)) - blue;
+	int gray_distance = (gray_red * gray_red) + (gray_green * gray_green) + (gray_blue * gray_blue);
+
+	if (gray_distance < cube_distance)
+		return 232 + gray;
+
+	return 16 + (36 * cube_table[red]) + (6 * cube_table[green]) + cube_table[blue];
+}
+
+/* write SGR parameters of one color (@base is 38 for foreground and 48 for background) */
+static size_t write_sgr_color(char* output, const attr_t color, const int base, const color_t color_mode)
+{
+	if (!(color & ATTR_FG_SET))
+		return sprintf(output, "%d;", base + 1);
+	else if (color_mode == COLOR_256)
+		return sprintf(output, "%d;5;%d;", base, find_xterm_color(color));
+
+	return sprintf(output, "%d;2;%d;%d;%d;", base, (int)((color >> 16) & 0xFF), (int)((color >> 8) & 0xFF), (int)(color & 0xFF));
+}
+
+/* write SGR escape sequence switching from @current to @next attributes */
+static size_t write_sgr(char* output, const attr_t current, const attr_t next, const color_t color_mode)
+{
+	size_t length = 0;
+
+	if (color_mode != COLOR_NONE && current != next) {
+		output[length++] = '\e';
+		output[length++] = '[';
+
+		/* only write colors that changed */
+		if ((current ^ next) & ATTR_FG_MASK)
+			length += write_sgr_color(&output[length], next & ATTR_FG_MASK, 38, color_mode);
+		if ((current ^ next) & ATTR_BG_MASK)
+			length += write_sgr_color(&output[length], (next >> 32) & ATTR_FG_MASK, 48, color_mode);
+
+		/* replace last separator */
+		output[length - 1] = 'm';
+	}
+
+	return length;
+}
+
+/* encode render surface into output buffer and return its length */
+static size_t _screen_encode_surface(screen_t* self)
+{
+	size_t length = 0;
+
+	if (self != NULL && self->_render_surface != NULL) {
+		/* size of each character in pixels */
+		size_t cell_width = (self->_output_mode == OUTPUT_BRAILLE) ? 2 : 1;
+		size_t cell_height = (self->_output_mode == OUTPUT_BRAILLE) ? 4 : (self->_output_mode == OUTPUT_HALF_BLOCK) ? 2 : 1;
+		size_t columns = (self->_width + cell_width - 1) / cell_width;
+		size_t rows = (self->_height + cell_height - 1) / cell_height;
+		size_t needed = rows * ((columns * (MAX_CELL_BYTES + MAX_SGR_BYTES)) + MAX_SGR_BYTES + 1) + MAX_SGR_BYTES;
+
+		/* attributes set on the terminal so far */
+		attr_t current = ATTR_DEFAULT;
+
+		/* grow buffer when surface gets bigger */
+		if (needed > self->_output_size) {
+			char* tmp_ptr = NULL;
+
+			if ((tmp_ptr = realloc(self->_output_buffer, needed)) == NULL)
+				return 0;
+
+			self->_output_buffer = tmp_ptr;
+			self->_output_size = needed;
+		}
+
+		for (size_t k = 0; k < rows; k++) {
+			for (size_t j = 0; j < columns; j++) {
+				const char* code = NULL;
+				char glyph[2] = { ' ', '\0' };
+				attr_t attr = ATTR_DEFAULT;
+
+				if (self->_output_mode == OUTPUT_ASCII) {
+					cell_t* tmp_cell_ptr = &self->_render_surface[j + (k * self->_width)];
+
+					glyph[0] = (tmp_cell_ptr->_glyph == '\0') ? ' ' : tmp_cell_ptr->_glyph;
+					attr = tmp_cell_ptr->_attr;
+					code = glyph;
+				}
+				else {
+					unsigned mask = 0;
+					attr_t first_attr = ATTR_DEFAULT; /* colors of first lit pixel */
+					attr_t top_attr = ATTR_DEFAULT;   /* colors of first line */
+					attr_t bottom_attr = ATTR_DEFAULT; /* colors of second line */
+
+					/* gather pixels covered by this character */
+					for (size_t y = 0; y < cell_height; y++) {
+						for (size_t x = 0; x < cell_width; x++) {
+							size_t colunm = (j * cell_width) + x;
+							size_t line = (k * cell_height) + y;
+
+							if (colunm < self->_width && line < self->_height) {
+								cell_t* tmp_cell_ptr = &self->_render_surface[colunm + (line * self->_width)];
+
+								if (x == 0 && y == 0)
+									attr = tmp_cell_ptr->_attr;
+								if (y == 0)
+									top_attr = tmp_cell_ptr->_attr;
+								else
+									bottom_attr = tmp_cell_ptr->_attr;
+
+								if (tmp_cell_ptr->_glyph != '\0' && tmp_cell_ptr->_glyph != ' ') {
+									if (mask == 0)
+										first_attr = tmp_cell_ptr->_attr;
+
+									mask |= 1u << (x + (y * cell_width));
+								}
+							}
+						}
+					}
+
+					attr = (mask != 0) ? first_attr : attr;
+
+					/* copy encoded character */
+					if (self->_output_mode == OUTPUT_BRAILLE)
+						code = braille_table[mask];
+					else if (mask == 3 && ((top_attr ^ bottom_attr) & ATTR_FG_MASK)) {
+						/* two colors in one character: top as foreground, bottom as background */
+						code = half_block_table[1];
+						attr = (top_attr & ATTR_FG_MASK) | ((bottom_attr & ATTR_FG_MASK) << 32);
+					}
+					else
+						code = half_block_table[mask];
+				}
+
+				/* foreground doesn't matter for blank characters */
+				if (code[0] == ' ')
+					attr = (attr & ATTR_BG_MASK) | (current & ATTR_FG_MASK);
+
+				/* only change colors when needed */
+				length += write_sgr(&self->_output_buffer[length], current, attr, self->_color_mode);
+				current = attr;
+
+				while (*code != '\0')
+					self->_output_buffer[length++] = *code++;
+			}
+
+			/* avoid background color bleeding into next line */
+			if (current & ATTR_BG_SET) {
+				length += write_sgr(&self->_output_buffer[length], current, current & ATTR_FG_MASK, self->_color_mode);
+				current &= ATTR_FG_MASK;
+			}
+
+			/* break output on end of line */
+			self->_output_buffer[length++] = '\n';
+		}
+
+		/* reset terminal colors */
+		length += write_sgr(&self->_output_buffer[length], current, ATTR_DEFAULT, self->_color_mode);
+	}
+
+	return length;
+}
+
+/* compare image indexes (used to keep images in render order) */
+static int compare_index(const void* a, const void* b)
+{
+	size_t left = *(const size_t*)a;
+	size_t right = *(const size_t*)b;
+
+	return (left > right) - (left < right);
+}
+
 /* render images to screen (call this on a loop) */
 static void _screen_render(screen_t* self)
 {
@@ -377,34 +1016,75 @@ static void _screen_render(screen_t* self)
 				/* free up memory */
 				free_memory((void**)&self->_render_surface);
 
-				/* verify memory was allocated */
-				if ((self->_render_surface = calloc(buff_size, 1)) != NULL) {
+				/* verify memory was allocated and images are indexed */
+				if ((self->_render_surface = calloc(buff_size, sizeof(cell_t))) != NULL && (!self->_index_dirty || !self->build_index(self))) {
 					/* reset frame delta */
 					self->_frame_delta = clock();
 
-					/* for each image */
-					for (size_t i = 0; i < self->_images_count; i++) {
+					/* find index cells intersecting the viewport */
+					size_t first_column = (size_t)self->_relative_pos._x / INDEX_CELL_SIZE;
+					size_t first_row = (size_t)self->_relative_pos._y / INDEX_CELL_SIZE;
+					size_t last_column = ((size_t)self->_relative_pos._x + self->_width - 1) / INDEX_CELL_SIZE;
+					size_t last_row = ((size_t)self->_relative_pos._y + self->_height - 1) / INDEX_CELL_SIZE;
+					size_t visible_count = 0;
+
+					if (last_column >= self->_index_columns)
+						last_column = self->_index_columns - 1;
+					if (last_row >= self->_index_rows)
+						last_row = self->_index_rows - 1;
+
+					self->_visit_count++;
+
+					/* gather each visible image once (images may span several cells) */
+					for (size_t k = first_row; k <= last_row && self->_index_rows > 0; k++) {
+						for (size_t j = first_column; j <= last_column && self->_index_columns > 0; j++) {
+							size_t cell = j + (k * self->_index_columns);
+
+							for (size_t n = self->_index_offsets[cell]; n < self->_index_offsets[cell + 1]; n++) {
+								image_t* tmp_image_ptr = &self->_render_array[self->_index_items[n]];
+
+								if (tmp_image_ptr->_visit_mark != self->_visit_count) {
+									tmp_image_ptr->_visit_mark = self->_visit_count;
+									self->_visible_items[visible_count++] = self->_index_items[n];
+								}
+							}
+						}
+					}
+
+					/* images added later are drawn on top */
+					qsort(self->_visible_items, visible_count, sizeof(size_t), &compare_index);
+
+					/* for each visible image */
+					for (size_t i = 0; i < visible_count; i++) {
 						/* store current image */
-						image_t* tmp_image_ptr = &self->_render_array[i];
+						image_t* tmp_image_ptr = &self->_render_array[self->_visible_items[i]];
 
 						/* get current frame */
 						frame_t* tmp_frame_ptr = &tmp_image_ptr->_frame_array[tmp_image_ptr->_curr_frame];
 
-						/* iterate through pixel matrix and calculate each element position */
-						for (size_t j = 0, k = 0; k < tmp_frame_ptr->_height; j++) {
-							/* control counters */
-							if (j >= tmp_frame_ptr->_width) {
-								j = 0;
-								k++;
-							}
-							if (k == tmp_frame_ptr->_height)
-								break;
+						/* get frame position inside viewport */
+						point_t tmp_pixel_pos = self->calculate_pixel_pos(self, tmp_image_ptr->_position._x, tmp_image_ptr->_position._y);
+
+						/* clip frame to the viewport */
+						long first_x = (tmp_pixel_pos._x < 0) ? -tmp_pixel_pos._x : 0;
+						long first_y = (tmp_pixel_pos._y < 0) ? -tmp_pixel_pos._y : 0;
+						long last_x = (long)self->_width - tmp_pixel_pos._x;
+						long last_y = (long)self->_height - tmp_pixel_pos._y;
 
-							/* get new position */
-							point_t tmp_pixel_pos = self->calculate_pixel_pos(self, j, k);
+						if (last_x > (long)tmp_frame_ptr->_width)
+							last_x = (long)tmp_frame_ptr->_width;
+						if (last_y > (long)tmp_frame_ptr->_height)
+							last_y = (long)tmp_frame_ptr->_height;
 
-							/* store pixel to buffer */
-							self->_render_surface[tmp_pixel_pos._x + (tmp_pixel_pos._y * self->_width)] = tmp_frame_ptr->get_pixel(tmp_frame_ptr, j, k); 
+						/* copy visible part of each line to buffer */
+						for (long k = first_y; k < last_y; k++) {
+							cell_t* tmp_cell_ptr = &self->_render_surface[(tmp_pixel_pos._x + first_x) + ((tmp_pixel_pos._y + k) * self->_width)];
+							size_t offset = first_x + (k * tmp_frame_ptr->_width);
+
+							for (long j = first_x; j < last_x; j++, tmp_cell_ptr++, offset++) {
+								tmp_cell_ptr->_glyph = tmp_frame_ptr->_pixel_matrix[offset];
+								tmp_cell_ptr->_attr = (tmp_frame_ptr->_attr_matrix != NULL) ? tmp_frame_ptr->_attr_matrix[offset] : tmp_image_ptr->_tint;
+							}
 						}
 
 						/* prepare next frame */
@@ -418,17 +1098,7 @@ static void _screen_render(screen_t* self)
 					clear_cli();
 
 					/* render screen surface */
-					for (size_t j = 0; j < buff_size; j++) {
-						/* output to stdout */
-						if (self->_render_surface[j] == '\0')
-							putchar(' ');
-						else
-							putchar(self->_render_surface[j]);
-
-						/* break output on end of line */
-						if ((j + 1) % self->_width == 0)
-							putchar('\n');
-					}
+					fwrite(self->_output_buffer, 1, self->encode_surface(self), stdout);
 
 					/* render screen menu */
 					if (self->_menu != NULL)
@@ -439,80 +1109,841 @@ static void _screen_render(screen_t* self)
 	}
 }
 
-/* define constructors */
-/* frame_t object constructor */
-static void frame_ctor(frame_t* self)
+/* stop worker threads of the converter */
+static void stop_workers(converter_t* self)
 {
-	if (self != NULL) {
-		self->_pixel_matrix = NULL;
-		self->_width = 0;
-		self->_height = 0;
-		self->dtor = &_frame_dtor;
-		self->get_pixel = &_frame_get_pixel;
-		self->set_pixel = &_frame_set_pixel;
-		self->swap_matrix = &_frame_swap_matrix;
+#ifndef WINDOWS
+	if (self->_threads_count > 0) {
+		pthread_mutex_lock(&self->_lock);
+		self->_quit = true;
+		pthread_cond_broadcast(&self->_work_signal);
+		pthread_mutex_unlock(&self->_lock);
+
+		for (size_t i = 0; i < self->_threads_count; i++)
+			pthread_join(self->_workers[i]._thread, NULL);
+
+		self->_quit = false;
 	}
+#endif
+
+	free_memory((void**)&(self->_workers));
+	self->_workers_count = 0;
+	self->_threads_count = 0;
 }
 
-/* image_t object constructor */
-static void image_ctor(image_t* self)
+/* free memory that depends on the source size */
+static void free_maps(converter_t* self)
 {
-	if (self != NULL) {
-		self->_frame_array = NULL;
-		self->_frames_count = 0;
-		self->_curr_frame = 0;
-		self->dtor = &_image_dtor;
-		self->get_frames_count = &_image_get_frames_count;
-		self->get_curr_frame = &_image_get_curr_frame;
-		self->set_curr_frame = &_image_set_curr_frame;
-		self->add_frame = &_image_add_frame;
-	}
+	stop_workers(self);
+
+	free_memory((void**)&(self->_column_map));
+	free_memory((void**)&(self->_row_map));
+	free_memory((void**)&(self->_column_count));
+	free_memory((void**)&(self->_row_count));
+	free_memory((void**)&(self->_sums));
+	free_memory((void**)&(self->_features));
+	free_memory((void**)&(self->_glyphs));
+	free_memory((void**)&(self->_bands[0]));
+	free_memory((void**)&(self->_bands[1]));
+	free_memory((void**)&(self->_errors));
 }
 
-/* screen_t object constructor */
-static void screen_ctor(screen_t* self)
+/* converter_t object destructor */
+static void _converter_dtor(converter_t* self)
 {
-	if (self != NULL) {
-		self->_render_array = NULL;
-		self->_images_count = 0;
-		self->_render_surface = NULL;
-		self->_relative_pos._x = 0;
-		self->_relative_pos._y = 0;
-		self->_width = 0;
-		self->_height = 0;
-		self->_frame_rate = 0;
-		self->_frame_delta = clock();
-		self->_menu = NULL;
-		self->dtor = &_screen_dtor;
-		self->get_images_count = &_screen_get_images_count;
-		self->set_size = &_screen_set_size;
-		self->get_relative_pos = &_screen_get_relative_pos;
-		self->set_relative_pos = &_screen_set_relative_pos;
-		self->get_width = &_screen_get_width;
-		self->get_height = &_screen_get_height;
-		self->get_frame_rate = &_screen_get_frame_rate;
-		self->set_frame_rate = &_screen_set_frame_rate;
-		self->swap_menu = &_screen_swap_menu;
-		self->add_image = &_screen_add_image;
-		self->calculate_frame_delta = &_screen_calculate_frame_delta;
-		self->calculate_pixel_pos = &_screen_calculate_pixel_pos;
-		self->find_image_aligned_pos = &_screen_find_image_aligned_pos;
-		self->render = &_screen_render;
-	}
+	free_maps(self);
+	free_memory((void**)&(self->_memo));
+
+#ifndef WINDOWS
+	pthread_mutex_destroy(&self->_lock);
+	pthread_cond_destroy(&self->_work_signal);
+	pthread_cond_destroy(&self->_done_signal);
+#endif
 }
 
-/* define functions */
-/* deallocate memory */
-void free_memory(void** ptr)
+/* get characters per line */
+static size_t _converter_get_columns(converter_t* self)
 {
-	if (*ptr != NULL) {
-		free(*ptr);
-		*ptr = NULL;
-	}
+	return (self != NULL) ? self->_columns : 0;
 }
 
-/* clear cli output stream */
-void clear_cli()
+/* set characters per line (takes effect on next image) */
+static void _converter_set_columns(converter_t* self, size_t columns)
+{
+	if (self != NULL) {
+		self->_target_columns = columns;
+
+		/* force maps to be rebuilt */
+		self->_source_width = 0;
+		self->_source_height = 0;
+	}
+}
+
+/* get lines of characters (found from source size) */
+static size_t _converter_get_rows(converter_t* self)
+{
+	return (self != NULL) ? self->_rows : 0;
+}
+
+/* match dark glyphs on light background */
+static void _converter_set_invert(converter_t* self, const bool invert)
+{
+	if (self != NULL)
+		self->_invert = invert;
+}
+
+/* set how characters are chosen */
+static void _converter_set_method(converter_t* self, const method_t method)
+{
+	if (self != NULL)
+		self->_method = method;
+}
+
+/* set number of threads (takes effect on next image, 0 for one per processor) */
+static void _converter_set_threads(converter_t* self, size_t threads)
+{
+	if (self != NULL) {
+		self->_target_threads = threads;
+
+		/* force workers to be restarted */
+		self->_source_width = 0;
+		self->_source_height = 0;
+	}
+}
+
+/* find glyph whose coverage is nearest to @features (sum of absolute differences) */
+static char find_nearest_glyph(const unsigned char* features)
+{
+	unsigned best_distance = ~0u;
+	size_t best_index = 0;
+
+#ifdef USE_SSE2
+	/* compare against two glyphs per register, eight glyphs per iteration */
+	__m128i query = _mm_loadl_epi64((const __m128i*)features);
+	__m128i best = _mm_set1_epi16(0x7FFF);
+	__m128i best_indexes = _mm_setzero_si128();
+	__m128i indexes = _mm_setr_epi16(0, 2, 4, 6, 1, 3, 5, 7);
+
+	query = _mm_unpacklo_epi64(query, query);
+
+	for (size_t i = 0; i < GLYPH_COUNT; i += 8) {
+		__m128i distance = _mm_sad_epu8(query, _mm_loadu_si128((const __m128i*)glyph_features[i]));
+
+		/* gather the eight distances as 16-bit lanes */
+		distance = _mm_or_si128(distance, _mm_slli_epi64(_mm_sad_epu8(query, _mm_loadu_si128((const __m128i*)glyph_features[i + 2])), 16));
+		distance = _mm_or_si128(distance, _mm_slli_epi64(_mm_sad_epu8(query, _mm_loadu_si128((const __m128i*)glyph_features[i + 4])), 32));
+		distance = _mm_or_si128(distance, _mm_slli_epi64(_mm_sad_epu8(query, _mm_loadu_si128((const __m128i*)glyph_features[i + 6])), 48));
+
+		/* keep smallest distance of each lane */
+		__m128i closer = _mm_cmplt_epi16(distance, best);
+
+		best = _mm_min_epi16(distance, best);
+		best_indexes = _mm_or_si128(_mm_and_si128(closer, indexes), _mm_andnot_si128(closer, best_indexes));
+		indexes = _mm_add_epi16(indexes, _mm_set1_epi16(8));
+	}
+
+	short lane_distances[8];
+	short lane_indexes[8];
+
+	_mm_storeu_si128((__m128i*)lane_distances, best);
+	_mm_storeu_si128((__m128i*)lane_indexes, best_indexes);
+
+	/* lowest index wins ties */
+	for (size_t i = 0; i < 8; i++) {
+		if ((unsigned)lane_distances[i] < best_distance || ((unsigned)lane_distances[i] == best_distance && (size_t)lane_indexes[i] < best_index)) {
+			best_distance = (unsigned)lane_distances[i];
+			best_index = (size_t)lane_indexes[i];
+		}
+	}
+#else
+	for (size_t i = 0; i < GLYPH_COUNT; i++) {
+		unsigned distance = 0;
+
+		for (size_t j = 0; j < FEATURE_COUNT; j++)
+			distance += (features[j] > glyph_features[i][j]) ? features[j] - glyph_features[i][j] : glyph_features[i][j] - features[j];
+
+		if (distance < best_distance) {
+			best_distance = distance;
+			best_index = i;
+		}
+	}
+#endif
+
+	/* padding entries repeat the space */
+	return (best_index < GLYPH_COUNT - 1) ? (char)(GLYPH_FIRST + best_index) : GLYPH_FIRST;
+}
+
+/* match every quantized feature signature once (table is then shared by all workers) */
+static bool build_memo(converter_t* self)
+{
+	size_t count = (size_t)1 << (FEATURE_BITS * FEATURE_COUNT);
+
+	if (self->_memo == NULL && (self->_memo = malloc(count)) != NULL) {
+		for (size_t signature = 0; signature < count; signature++) {
+			/* match quantized features (spread over 0-255) so results only depend on the signature */
+			unsigned char quantized[FEATURE_STRIDE] = { 0 };
+
+			for (size_t i = 0; i < FEATURE_COUNT; i++)
+				quantized[i] = (unsigned char)((((signature >> (i * FEATURE_BITS)) & ((1 << FEATURE_BITS) - 1)) * 255) / ((1 << FEATURE_BITS) - 1));
+
+			self->_memo[signature] = (unsigned char)find_nearest_glyph(quantized);
+		}
+	}
+
+	return (self->_memo == NULL);
+}
+
+/* find glyph for a block of features (memoized by quantized signature) */
+static char _converter_match_block(converter_t* self, const unsigned char* features)
+{
+	char result = GLYPH_FIRST;
+
+	if (self != NULL && features != NULL && self->_memo != NULL) {
+		size_t signature = 0;
+
+		for (size_t i = 0; i < FEATURE_COUNT; i++)
+			signature |= (size_t)(features[i] >> (8 - FEATURE_BITS)) << (i * FEATURE_BITS);
+
+		result = (char)self->_memo[signature];
+	}
+
+	return result;
+}
+
+/* find ramp glyph of a block using ordered dithering */
+static char find_ordered_glyph(const unsigned char* features, const size_t column, const size_t row)
+{
+	int value = 0;
+
+	for (size_t i = 0; i < FEATURE_COUNT; i++)
+		value += features[i];
+
+	/* move luminance up to half a ramp step in either direction */
+	value = (value / FEATURE_COUNT) + ((((int)bayer_table[row % 4][column % 4] * 2) - 15) * 255) / (32 * (RAMP_LEVELS - 1));
+	value = (value < 0) ? 0 : (value > 255) ? 255 : value;
+
+	return ramp_table[ramp_lookup[value]];
+}
+
+/* convert lines of the current job that belong to @worker */
+static void convert_band(worker_t* worker)
+{
+	converter_t* self = worker->_converter;
+
+	for (size_t line = self->_job_first_line; line < self->_job_last_line; line++) {
+		const unsigned char* samples = &self->_job_band[(line - self->_job_first_line) * self->_line_bytes];
+		size_t subrow = self->_row_map[line - self->_job_first_line];
+
+		/* accumulate luminance of each subcolumn (most significant byte of 16-bit samples) */
+		if (self->_channels == 1) {
+			for (size_t i = worker->_first_x; i < worker->_last_x; i++)
+				self->_sums[self->_column_map[i]] += samples[i * self->_sample_size];
+		}
+		else {
+			for (size_t i = worker->_first_x, j = worker->_first_x * 3 * self->_sample_size; i < worker->_last_x; i++, j += 3 * self->_sample_size)
+				self->_sums[self->_column_map[i]] += (77 * samples[j] + 150 * samples[j + self->_sample_size] + 29 * samples[j + (2 * self->_sample_size)]) >> 8;
+		}
+
+		/* subrow is complete */
+		if (line + 1 == self->_source_height || self->_row_map[line + 1 - self->_job_first_line] != subrow) {
+			size_t slot = (subrow / 3) % self->_ring_rows;
+			unsigned char* features = &self->_features[slot * self->_columns * FEATURE_STRIDE];
+			char* glyphs = &self->_glyphs[slot * self->_columns];
+
+			for (size_t i = worker->_first_cell * 2; i < worker->_last_cell * 2; i++) {
+				unsigned long area = (unsigned long)(self->_column_count[i] * self->_row_count[subrow]);
+				unsigned long value = (area > 0) ? self->_sums[i] / area : 0;
+
+				features[((i / 2) * FEATURE_STRIDE) + ((subrow % 3) * 2) + (i % 2)] = (unsigned char)(self->_invert ? 255 - value : value);
+				self->_sums[i] = 0;
+			}
+
+			/* line of characters is complete (diffusion is done in order by the converter itself) */
+			if (subrow % 3 == 2 && self->_method != METHOD_DIFFUSE) {
+				for (size_t i = worker->_first_cell; i < worker->_last_cell; i++) {
+					if (self->_method == METHOD_SHAPE)
+						glyphs[i] = self->match_block(self, &features[i * FEATURE_STRIDE]);
+					else
+						glyphs[i] = find_ordered_glyph(&features[i * FEATURE_STRIDE], i, subrow / 3);
+				}
+			}
+		}
+	}
+}
+
+#ifndef WINDOWS
+/* wait for jobs and convert them (thread entry) */
+static void* run_worker(void* arg)
+{
+	worker_t* worker = arg;
+	converter_t* self = worker->_converter;
+
+	while (true) {
+		pthread_mutex_lock(&self->_lock);
+
+		while (worker->_generation == self->_generation && !self->_quit)
+			pthread_cond_wait(&self->_work_signal, &self->_lock);
+
+		worker->_generation = self->_generation;
+
+		/* read while locked, stop_workers writes it */
+		bool quit = self->_quit;
+
+		pthread_mutex_unlock(&self->_lock);
+
+		if (quit)
+			break;
+
+		convert_band(worker);
+
+		/* last worker to finish wakes up the converter */
+		pthread_mutex_lock(&self->_lock);
+
+		if (--self->_pending == 0)
+			pthread_cond_signal(&self->_done_signal);
+
+		pthread_mutex_unlock(&self->_lock);
+	}
+
+	return NULL;
+}
+#endif
+
+/* start converting source lines from @first_line to @last_line */
+static void start_job(converter_t* self, unsigned char* band, const size_t first_line, const size_t last_line)
+{
+	self->_job_band = band;
+	self->_job_first_line = first_line;
+	self->_job_last_line = last_line;
+
+	/* subrows of band lines only, so memory doesn't grow with image height */
+	for (size_t line = first_line; line <= last_line; line++)
+		self->_row_map[line - first_line] = (line * self->_rows * 3) / self->_source_height;
+
+#ifndef WINDOWS
+	if (self->_workers_count > 1) {
+		pthread_mutex_lock(&self->_lock);
+		self->_pending = self->_workers_count;
+		self->_generation++;
+		pthread_cond_broadcast(&self->_work_signal);
+		pthread_mutex_unlock(&self->_lock);
+
+		return;
+	}
+#endif
+
+	/* single worker runs on the caller thread */
+	convert_band(&self->_workers[0]);
+}
+
+/* wait until all workers finished the current job */
+static void finish_job(converter_t* self)
+{
+#ifndef WINDOWS
+	if (self->_workers_count > 1) {
+		pthread_mutex_lock(&self->_lock);
+
+		while (self->_pending > 0)
+			pthread_cond_wait(&self->_done_signal, &self->_lock);
+
+		pthread_mutex_unlock(&self->_lock);
+	}
+#endif
+}
+
+/* start workers, each one converts a slice of character columns */
+static bool start_workers(converter_t* self)
+{
+	size_t count = self->_target_threads;
+
+#ifdef WINDOWS
+	count = 1;
+#else
+	if (count == 0)
+		count = (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+	count = (count < 1) ? 1 : (count > MAX_WORKERS) ? MAX_WORKERS : count;
+	count = (count > self->_columns) ? self->_columns : count;
+
+	if ((self->_workers = calloc(count, sizeof(worker_t))) == NULL)
+		return true;
+
+	for (size_t i = 0; i < count; i++) {
+		worker_t* worker = &self->_workers[i];
+
+		worker->_converter = self;
+		worker->_first_cell = (i * self->_columns) / count;
+		worker->_last_cell = ((i + 1) * self->_columns) / count;
+		worker->_generation = 0;
+
+		/* source columns belonging to the slice */
+		worker->_first_x = 0;
+		worker->_last_x = 0;
+
+		for (size_t j = 0; j < self->_source_width; j++) {
+			size_t cell = self->_column_map[j] / 2;
+
+			if (cell < worker->_first_cell)
+				worker->_first_x = j + 1;
+			if (cell < worker->_last_cell)
+				worker->_last_x = j + 1;
+		}
+
+#ifndef WINDOWS
+		if (count > 1) {
+			worker->_generation = self->_generation;
+
+			if (pthread_create(&worker->_thread, NULL, &run_worker, worker) != 0) {
+				/* stop the workers already running */
+				stop_workers(self);
+
+				return true;
+			}
+
+			self->_threads_count = i + 1;
+		}
+#endif
+
+		self->_workers_count = i + 1;
+	}
+
+	return false;
+}
+
+/* prepare conversion of @source_width x @source_height images */
+static bool _converter_set_size(converter_t* self, size_t source_width, size_t source_height)
+{
+	bool error = true;
+
+	if (self != NULL && source_width > 0 && source_height > 0) {
+		size_t columns = (self->_target_columns > 0) ? self->_target_columns : DEFAULT_COLUMNS;
+
+		/* each character needs at least one source pixel per subcell */
+		if (columns * 2 > source_width)
+			columns = source_width / 2;
+
+		/* terminal characters are about twice as tall as they are wide */
+		size_t rows = (source_height * columns) / (source_width * 2);
+
+		if (rows * 3 > source_height)
+			rows = source_height / 3;
+
+		free_maps(self);
+
+		self->_columns = columns;
+		self->_rows = rows;
+		self->_source_width = source_width;
+		self->_source_height = source_height;
+		self->_band_lines = (source_height < BAND_LINES) ? source_height : BAND_LINES;
+
+		/* rings keep every line of characters finished during the last two bands */
+		self->_ring_rows = (rows > 0) ? 2 * ((self->_band_lines / (source_height / rows)) + 2) : 0;
+
+		self->_column_map = malloc(sizeof(size_t) * source_width);
+		self->_row_map = malloc(sizeof(size_t) * (self->_band_lines + 1));
+		self->_column_count = calloc(columns * 2, sizeof(size_t));
+		self->_row_count = calloc(rows * 3 + 1, sizeof(size_t));
+		self->_sums = calloc(columns * 2, sizeof(unsigned long));
+		self->_features = calloc(self->_ring_rows * columns, FEATURE_STRIDE);
+		self->_glyphs = malloc(self->_ring_rows * columns + 1);
+		self->_bands[0] = malloc(self->_band_lines * source_width * 6);
+		self->_bands[1] = malloc(self->_band_lines * source_width * 6);
+		self->_errors = calloc((columns + 2) * 2, sizeof(int));
+
+		if (columns > 0 && rows > 0 && self->_column_map != NULL && self->_row_map != NULL && self->_column_count != NULL &&
+			self->_row_count != NULL && self->_sums != NULL && self->_features != NULL && self->_glyphs != NULL &&
+			self->_bands[0] != NULL && self->_bands[1] != NULL && self->_errors != NULL) {
+			/* spread source pixels evenly over subcells */
+			for (size_t i = 0; i < source_width; i++) {
+				self->_column_map[i] = (i * columns * 2) / source_width;
+				self->_column_count[self->_column_map[i]]++;
+			}
+
+			for (size_t i = 0; i < source_height; i++)
+				self->_row_count[(i * rows * 3) / source_height]++;
+
+			error = start_workers(self);
+		}
+
+		/* try again on next image */
+		if (error)
+			self->_source_width = 0;
+	}
+
+	return error;
+}
+
+/* choose ramp glyphs of a line of characters using serpentine error diffusion (Floyd-Steinberg) */
+static void diffuse_row(converter_t* self, const size_t row, const unsigned char* features, char* glyphs)
+{
+	/* errors are kept in sixteenths, with one extra column on each side */
+	int* current = &self->_errors[(row % 2) * (self->_columns + 2)];
+	int* next = &self->_errors[((row + 1) % 2) * (self->_columns + 2)];
+	int direction = (row % 2 == 0) ? 1 : -1;
+
+	memset(next, 0, sizeof(int) * (self->_columns + 2));
+
+	for (size_t i = 0; i < self->_columns; i++) {
+		size_t column = (direction > 0) ? i : self->_columns - 1 - i;
+		int value = 0;
+
+		for (size_t j = 0; j < FEATURE_COUNT; j++)
+			value += features[(column * FEATURE_STRIDE) + j];
+
+		value = (value / FEATURE_COUNT) + (current[column + 1] / 16);
+		value = (value < 0) ? 0 : (value > 255) ? 255 : value;
+
+		unsigned char level = ramp_lookup[value];
+		int error = value - ramp_values[level];
+
+		glyphs[column] = ramp_table[level];
+
+		/* push error forward and to the next line */
+		current[column + 1 + direction] += error * 7;
+		next[column + 1 - direction] += error * 3;
+		next[column + 1] += error * 5;
+		next[column + 1 + direction] += error;
+	}
+}
+
+/* write finished lines of characters up to @last_row to @output or @matrix */
+static bool write_rows(converter_t* self, const size_t last_row, FILE* output, char* matrix)
+{
+	bool error = false;
+
+	for (; self->_rows_written < last_row && !error; self->_rows_written++) {
+		size_t slot = self->_rows_written % self->_ring_rows;
+		char* glyphs = &self->_glyphs[slot * self->_columns];
+
+		if (self->_method == METHOD_DIFFUSE)
+			diffuse_row(self, self->_rows_written, &self->_features[slot * self->_columns * FEATURE_STRIDE], glyphs);
+
+		if (output != NULL) {
+			error = (fwrite(glyphs, 1, self->_columns, output) != self->_columns);
+			error = error || (fputc('\n', output) == EOF);
+		}
+		else
+			memcpy(&matrix[self->_rows_written * self->_columns], glyphs, self->_columns);
+	}
+
+	return error;
+}
+
+/* convert next PGM/PPM image of @input, lines of characters are written to @output as they
+	are finished or, without output, stored in @frame (frame owns the new matrix) */
+static bool _converter_convert(converter_t* self, FILE* input, FILE* output, frame_t* frame)
+{
+	bool error = true;
+	size_t width = 0;
+	size_t height = 0;
+	int channels = 0;
+	int maxval = 0;
+
+	if (self != NULL && (output != NULL || frame != NULL) && !read_pnm_header(input, &width, &height, &channels, &maxval)) {
+		char* matrix = NULL;
+
+		/* source size changed */
+		if (width != self->_source_width || height != self->_source_height)
+			error = self->set_size(self, width, height);
+		else
+			error = false;
+
+		error = error || (self->_method == METHOD_SHAPE && build_memo(self));
+		error = error || (output == NULL && (matrix = malloc(self->_columns * self->_rows)) == NULL);
+
+		if (!error) {
+			self->_channels = channels;
+			self->_sample_size = (maxval > 255) ? 2 : 1;
+			self->_line_bytes = width * (size_t)channels * self->_sample_size;
+			self->_rows_written = 0;
+
+			memset(self->_errors, 0, sizeof(int) * (self->_columns + 2) * 2);
+
+			/* read first band */
+			size_t lines = self->_band_lines;
+			error = (fread(self->_bands[0], self->_line_bytes, lines, input) != lines);
+
+			for (size_t first_line = 0, band = 0; first_line < height && !error; first_line += lines, band++) {
+				size_t next_lines = 0;
+
+				lines = (height - first_line < self->_band_lines) ? height - first_line : self->_band_lines;
+
+				/* workers convert this band while previous lines are written and next band is read */
+				start_job(self, self->_bands[band % 2], first_line, first_line + lines);
+
+				error = write_rows(self, self->_row_map[0] / 3, output, matrix);
+
+				if (first_line + lines < height) {
+					next_lines = (height - first_line - lines < self->_band_lines) ? height - first_line - lines : self->_band_lines;
+					error = error || (fread(self->_bands[(band + 1) % 2], self->_line_bytes, next_lines, input) != next_lines);
+				}
+
+				finish_job(self);
+			}
+
+			/* write remaining lines */
+			error = error || write_rows(self, self->_rows, output, matrix);
+		}
+
+		if (output == NULL) {
+			if (!error && !frame->swap_matrix(frame, matrix, self->_columns, self->_rows))
+				frame->_owns_matrix = true;
+			else {
+				free(matrix);
+				error = true;
+			}
+		}
+	}
+
+	return error;
+}
+
+/* define constructors */
+/* frame_t object constructor */
+static void frame_ctor(frame_t* self)
+{
+	if (self != NULL) {
+		self->_pixel_matrix = NULL;
+		self->_attr_matrix = NULL;
+		self->_owns_matrix = false;
+		self->_width = 0;
+		self->_height = 0;
+		self->dtor = &_frame_dtor;
+		self->get_pixel = &_frame_get_pixel;
+		self->set_pixel = &_frame_set_pixel;
+		self->get_attr = &_frame_get_attr;
+		self->swap_matrix = &_frame_swap_matrix;
+		self->swap_attr_matrix = &_frame_swap_attr_matrix;
+	}
+}
+
+/* image_t object constructor */
+static void image_ctor(image_t* self)
+{
+	if (self != NULL) {
+		self->_frame_array = NULL;
+		self->_frames_count = 0;
+		self->_curr_frame = 0;
+		self->_position._x = 0;
+		self->_position._y = 0;
+		self->_visit_mark = 0;
+		self->_tint = ATTR_DEFAULT;
+		self->dtor = &_image_dtor;
+		self->get_frames_count = &_image_get_frames_count;
+		self->get_curr_frame = &_image_get_curr_frame;
+		self->set_curr_frame = &_image_set_curr_frame;
+		self->get_position = &_image_get_position;
+		self->set_position = &_image_set_position;
+		self->find_bounds = &_image_find_bounds;
+		self->get_tint = &_image_get_tint;
+		self->set_tint = &_image_set_tint;
+		self->add_frame = &_image_add_frame;
+	}
+}
+
+/* screen_t object constructor */
+static void screen_ctor(screen_t* self)
+{
+	if (self != NULL) {
+		self->_render_array = NULL;
+		self->_images_count = 0;
+		self->_render_surface = NULL;
+		self->_relative_pos._x = 0;
+		self->_relative_pos._y = 0;
+		self->_width = 0;
+		self->_height = 0;
+		self->_canvas_width = 0;
+		self->_canvas_height = 0;
+		self->_index_offsets = NULL;
+		self->_index_items = NULL;
+		self->_visible_items = NULL;
+		self->_index_columns = 0;
+		self->_index_rows = 0;
+		self->_index_dirty = true;
+		self->_visit_count = 0;
+		self->_frame_rate = 0;
+		self->_frame_delta = clock();
+		self->_menu = NULL;
+		self->_output_mode = OUTPUT_ASCII;
+		self->_color_mode = find_color_mode();
+		self->_output_buffer = NULL;
+		self->_output_size = 0;
+		self->dtor = &_screen_dtor;
+		self->get_images_count = &_screen_get_images_count;
+		self->set_size = &_screen_set_size;
+		self->set_canvas_size = &_screen_set_canvas_size;
+		self->get_canvas_width = &_screen_get_canvas_width;
+		self->get_canvas_height = &_screen_get_canvas_height;
+		self->get_relative_pos = &_screen_get_relative_pos;
+		self->set_relative_pos = &_screen_set_relative_pos;
+		self->get_width = &_screen_get_width;
+		self->get_height = &_screen_get_height;
+		self->get_frame_rate = &_screen_get_frame_rate;
+		self->set_frame_rate = &_screen_set_frame_rate;
+		self->swap_menu = &_screen_swap_menu;
+		self->get_output_mode = &_screen_get_output_mode;
+		self->set_output_mode = &_screen_set_output_mode;
+		self->get_color_mode = &_screen_get_color_mode;
+		self->set_color_mode = &_screen_set_color_mode;
+		self->add_image = &_screen_add_image;
+		self->move_image = &_screen_move_image;
+		self->build_index = &_screen_build_index;
+		self->calculate_frame_delta = &_screen_calculate_frame_delta;
+		self->calculate_pixel_pos = &_screen_calculate_pixel_pos;
+		self->find_image_aligned_pos = &_screen_find_image_aligned_pos;
+		self->encode_surface = &_screen_encode_surface;
+		self->render = &_screen_render;
+
+		build_output_tables();
+	}
+}
+
+/* converter_t object constructor */
+static void converter_ctor(converter_t* self)
+{
+	if (self != NULL) {
+		self->_target_columns = DEFAULT_COLUMNS;
+		self->_columns = 0;
+		self->_rows = 0;
+		self->_source_width = 0;
+		self->_source_height = 0;
+		self->_channels = 1;
+		self->_sample_size = 1;
+		self->_line_bytes = 0;
+		self->_column_map = NULL;
+		self->_row_map = NULL;
+		self->_column_count = NULL;
+		self->_row_count = NULL;
+		self->_sums = NULL;
+		self->_features = NULL;
+		self->_glyphs = NULL;
+		self->_ring_rows = 0;
+		self->_rows_written = 0;
+		self->_bands[0] = NULL;
+		self->_bands[1] = NULL;
+		self->_band_lines = BAND_LINES;
+		self->_errors = NULL;
+		self->_memo = NULL;
+		self->_method = METHOD_SHAPE;
+		self->_invert = false;
+		self->_workers = NULL;
+		self->_workers_count = 0;
+		self->_threads_count = 0;
+		self->_target_threads = 0;
+		self->_job_band = NULL;
+		self->_job_first_line = 0;
+		self->_job_last_line = 0;
+#ifndef WINDOWS
+		pthread_mutex_init(&self->_lock, NULL);
+		pthread_cond_init(&self->_work_signal, NULL);
+		pthread_cond_init(&self->_done_signal, NULL);
+		self->_generation = 0;
+		self->_pending = 0;
+		self->_quit = false;
+#endif
+		self->dtor = &_converter_dtor;
+		self->get_columns = &_converter_get_columns;
+		self->set_columns = &_converter_set_columns;
+		self->get_rows = &_converter_get_rows;
+		self->set_invert = &_converter_set_invert;
+		self->set_method = &_converter_set_method;
+		self->set_threads = &_converter_set_threads;
+		self->set_size = &_converter_set_size;
+		self->match_block = &_converter_match_block;
+		self->convert = &_converter_convert;
+
+		build_ramp_tables();
+	}
+}
+
+/* define functions */
+/* deallocate memory */
+void free_memory(void** ptr)
+{
+	if (*ptr != NULL) {
+		free(*ptr);
+		*ptr = NULL;
+	}
+}
+
+/* write UTF-8 sequence of @code to @output */
+static void encode_utf8(char* output, const unsigned long code)
+{
+	/* only code points from the basic multilingual plane are used */
+	if (code < 0x80) {
+		output[0] = (char)code;
+		output[1] = '\0';
+	}
+	else if (code < 0x800) {
+		output[0] = (char)(0xC0 | (code >> 6));
+		output[1] = (char)(0x80 | (code & 0x3F));
+		output[2] = '\0';
+	}
+	else {
+		output[0] = (char)(0xE0 | (code >> 12));
+		output[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+		output[2] = (char)(0x80 | (code & 0x3F));
+		output[3] = '\0';
+	}
+}
+
+/* precompute characters used by dense output modes */
+void build_output_tables()
+{
+	/* braille dot bit for each pixel of a 2x4 cell (row-major) */
+	const unsigned braille_dots[8] = { 0x01, 0x08, 0x02, 0x10, 0x04, 0x20, 0x40, 0x80 };
+	static bool built = false;
+
+	if (!built) {
+		encode_utf8(half_block_table[0], ' ');
+		encode_utf8(half_block_table[1], 0x2580); /* upper half block */
+		encode_utf8(half_block_table[2], 0x2584); /* lower half block */
+		encode_utf8(half_block_table[3], 0x2588); /* full block */
+
+		for (unsigned mask = 0; mask < 256; mask++) {
+			unsigned dots = 0;
+
+			for (unsigned i = 0; i < 8; i++) {
+				if (mask & (1u << i))
+					dots |= braille_dots[i];
+			}
+
+			/* keep empty cells as plain spaces */
+			if (mask == 0)
+				encode_utf8(braille_table[mask], ' ');
+			else
+				encode_utf8(braille_table[mask], 0x2800 + dots);
+		}
+
+		/* color cube levels are 0, 95, 135, 175, 215 and 255 */
+		for (int i = 0; i < 256; i++)
+			cube_table[i] = (i < 48) ? 0 : (i < 115) ? 1 : (unsigned char)((i - 35) / 40);
+
+		built = true;
+	}
+}
+
+/* find which colors the terminal supports */
+color_t find_color_mode()
+{
+	color_t result = COLOR_NONE;
+
+#ifndef WINDOWS
+	const char* colorterm = getenv("COLORTERM");
+	const char* term = getenv("TERM");
+
+	if (colorterm != NULL && (strstr(colorterm, "truecolor") != NULL || strstr(colorterm, "24bit") != NULL))
+		result = COLOR_TRUECOLOR;
+	else if (term != NULL && strcmp(term, "dumb") != 0)
+		result = COLOR_256;
+#endif
+
+	return result;
+}
+
+/* clear cli output stream */
+void clear_cli()
 {
 #ifdef WINDOWS
 	system("cls");
@@ -546,6 +1977,271 @@ char to_lower(const char letter)
 	return (letter >= 65 && letter <= 90) ? letter + 32 : letter;
 }
 
+/* skip whitespace and comments of a PNM header */
+static int skip_pnm_space(FILE* file)
+{
+	int ch = fgetc(file);
+
+	while (ch == '#' || ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
+		/* comments last until end of line */
+		if (ch == '#') {
+			while (ch != '\n' && ch != EOF)
+				ch = fgetc(file);
+		}
+
+		ch = fgetc(file);
+	}
+
+	return ch;
+}
+
+/* read next decimal value of a PNM header */
+static bool read_pnm_value(FILE* file, size_t* value)
+{
+	int ch = skip_pnm_space(file);
+
+	*value = 0;
+
+	if (ch < '0' || ch > '9')
+		return true;
+
+	while (ch >= '0' && ch <= '9') {
+		*value = (*value * 10) + (size_t)(ch - '0');
+		ch = fgetc(file);
+	}
+
+	/* header ends with a single whitespace */
+	return (ch == EOF);
+}
+
+/* read header of binary PGM (P5) or PPM (P6) image, images may follow each other in the same stream */
+bool read_pnm_header(FILE* file, size_t* width, size_t* height, int* channels, int* maxval)
+{
+	bool error = true;
+
+	if (file != NULL && width != NULL && height != NULL && channels != NULL && maxval != NULL) {
+		int magic = skip_pnm_space(file);
+		int kind = fgetc(file);
+		size_t value = 0;
+
+		if (magic == 'P' && (kind == '5' || kind == '6') && !read_pnm_value(file, width) && !read_pnm_value(file, height) &&
+			!read_pnm_value(file, &value) && value > 0 && value < 65536) {
+			*channels = (kind == '5') ? 1 : 3;
+			*maxval = (int)value;
+
+			error = (*width == 0 || *height == 0);
+		}
+	}
+
+	return error;
+}
+
+/* pick evenly spaced glyphs (by coverage) for dithering */
+void build_ramp_tables()
+{
+	static bool built = false;
+
+	if (!built) {
+		unsigned coverage[GLYPH_COUNT - 1];
+		unsigned darkest = ~0u;
+		unsigned brightest = 0;
+
+		for (size_t i = 0; i < GLYPH_COUNT - 1; i++) {
+			coverage[i] = 0;
+
+			for (size_t j = 0; j < FEATURE_COUNT; j++)
+				coverage[i] += glyph_features[i][j];
+
+			darkest = (coverage[i] < darkest) ? coverage[i] : darkest;
+			brightest = (coverage[i] > brightest) ? coverage[i] : brightest;
+		}
+
+		for (size_t level = 0; level < RAMP_LEVELS; level++) {
+			unsigned target = darkest + (unsigned)(((brightest - darkest) * level) / (RAMP_LEVELS - 1));
+			size_t best = 0;
+
+			for (size_t i = 1; i < GLYPH_COUNT - 1; i++) {
+				unsigned distance = (coverage[i] > target) ? coverage[i] - target : target - coverage[i];
+				unsigned best_distance = (coverage[best] > target) ? coverage[best] - target : target - coverage[best];
+
+				if (distance < best_distance)
+					best = i;
+			}
+
+			ramp_table[level] = (char)(GLYPH_FIRST + best);
+			ramp_values[level] = (unsigned char)(((coverage[best] - darkest) * 255) / (brightest - darkest));
+		}
+
+		/* nearest level of each luminance */
+		for (size_t value = 0, level = 0; value < 256; value++) {
+			while (level + 1 < RAMP_LEVELS && (unsigned)ramp_values[level] + ramp_values[level + 1] <= value * 2)
+				level++;
+
+			ramp_lookup[value] = (unsigned char)level;
+		}
+
+		built = true;
+	}
+}
+
+/* get wall clock time in seconds */
+double get_time()
+{
+#ifdef WINDOWS
+	return (double)clock() / CLOCKS_PER_SEC;
+#else
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	return (double)now.tv_sec + ((double)now.tv_usec / 1000000.0);
+#endif
+}
+
+/* load text frames (as written by the converter) from @input, returns how many were loaded */
+static size_t load_frames(FILE* input, image_t* image)
+{
+	size_t count = 0;
+	size_t size = 0;
+	size_t capacity = 0;
+	char* text = NULL;
+	int ch = 0;
+
+	/* read whole frame up to form feed */
+	while (ch != EOF) {
+		ch = fgetc(input);
+
+		if (ch != '\f' && ch != EOF) {
+			if (size == capacity) {
+				char* larger = realloc(text, (capacity > 0) ? capacity * 2 : 4096);
+
+				if (larger == NULL)
+					break;
+
+				text = larger;
+				capacity = (capacity > 0) ? capacity * 2 : 4096;
+			}
+
+			text[size++] = (char)ch;
+			continue;
+		}
+
+		/* skip line break after form feed */
+		if (ch == '\f' && (ch = fgetc(input)) != '\n' && ch != EOF)
+			ungetc(ch, input);
+
+		/* frame size is the longest line by the number of lines */
+		size_t width = 0;
+		size_t height = 0;
+
+		for (size_t i = 0, start = 0; i < size; i++) {
+			if (text[i] == '\n' || i + 1 == size) {
+				size_t length = i - start + (text[i] != '\n');
+
+				width = (length > width) ? length : width;
+				height++;
+				start = i + 1;
+			}
+		}
+
+		char* matrix = (width > 0) ? malloc(width * height) : NULL;
+
+		if (matrix != NULL) {
+			memset(matrix, ' ', width * height);
+
+			for (size_t i = 0, x = 0, y = 0; i < size; i++) {
+				if (text[i] == '\n') {
+					x = 0;
+					y++;
+				}
+				else if (text[i] != '\r')
+					matrix[(y * width) + x++] = text[i];
+			}
+
+			frame_t frame;
+			frame_ctor(&frame);
+
+			if (frame.swap_matrix(&frame, matrix, width, height)) {
+				free(matrix);
+				break;
+			}
+
+			/* frames kept by the image are freed with it */
+			frame._owns_matrix = true;
+
+			if (image->add_frame(image, &frame)) {
+				frame.dtor(&frame);
+				break;
+			}
+
+			count++;
+		}
+
+		size = 0;
+	}
+
+	free(text);
+
+	return count;
+}
+
+/* convert every image of @input_path, writing frames to @output or adding them to @image, and return how many were converted
+	(text frames are loaded as they are) */
+static size_t convert_frames(const char* input_path, FILE* output, const size_t columns, const bool invert, const method_t method, const size_t threads, image_t* image)
+{
+	size_t count = 0;
+	FILE* input = (strcmp(input_path, "-") == 0) ? stdin : fopen(input_path, "rb");
+
+	if (input != NULL) {
+		int magic = fgetc(input);
+
+		if (magic != EOF)
+			ungetc(magic, input);
+
+		if (magic != 'P' && output == NULL)
+			count = load_frames(input, image);
+		else if (magic == 'P') {
+			converter_t converter;
+			converter_ctor(&converter);
+			converter.set_columns(&converter, columns);
+			converter.set_invert(&converter, invert);
+			converter.set_method(&converter, method);
+			converter.set_threads(&converter, threads);
+
+			/* images follow each other until end of stream */
+			while (true) {
+				bool error = false;
+
+				if (output != NULL)
+					error = converter.convert(&converter, input, output, NULL) || fputs("\f\n", output) == EOF;
+				else {
+					frame_t frame;
+					frame_ctor(&frame);
+
+					error = converter.convert(&converter, input, NULL, &frame);
+
+					/* frames kept by the image are freed with it */
+					if (!error && image->add_frame(image, &frame)) {
+						frame.dtor(&frame);
+						error = true;
+					}
+				}
+
+				if (error)
+					break;
+
+				count++;
+			}
+
+			converter.dtor(&converter);
+		}
+
+		if (input != stdin)
+			fclose(input);
+	}
+
+	return count;
+}
+
 /* find ceiling */
 long find_ceil(const double number)
 {
@@ -553,14 +2249,39 @@ long find_ceil(const double number)
 }
 
 /* entry point */
-int main()
+int main(int argc, char* argv[])
 {
 	/* program status */
 	status_t status = STATUS_ERROR;
 
+	/* command line options */
+	const char* input_path = NULL;  /* PGM/PPM images to convert ("-" for stdin) */
+	const char* output_path = NULL; /* write converted frames here instead of playing them */
+	size_t columns = DEFAULT_COLUMNS;
+	size_t threads = 0;             /* 0 for one per processor */
+	method_t method = METHOD_SHAPE;
+	bool invert = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+			columns = (size_t)strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			output_path = argv[++i];
+		else if (strcmp(argv[i], "-i") == 0)
+			invert = true;
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			threads = (size_t)strtoul(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+			i++;
+			method = (strcmp(argv[i], "ordered") == 0) ? METHOD_ORDERED : (strcmp(argv[i], "diffuse") == 0) ? METHOD_DIFFUSE : METHOD_SHAPE;
+		}
+		else
+			input_path = argv[i];
+	}
+
 	/* initialize stuff */
 	/* menu for the user */
-	char menu_array[] = "\nPlease, enter an option:\n| W - Move up | S - Move down | A - Move left | D - Move right |\n| P - Align automaticly | O - EXIT |\n";
+	char menu_array[] = "\nPlease, enter an option:\n| W - Move up | S - Move down | A - Move left | D - Move right |\n| P - Go to first image | M - Switch output mode | C - Switch colors | O - EXIT |\n";
 
 	/* each line is a frame (DO NOT USE LINE BREAKS - those are put during rendering) */
 	char* pixel_matrix[NUM_FRAMES] = {
@@ -588,24 +2309,80 @@ int main()
 	screen_t screen;
 	screen_ctor(&screen);
 
-	/* initialize image */
-	for (int i = 0; i < NUM_FRAMES; i++) {
-		if (!frame.swap_matrix(&frame, pixel_matrix[i], FRAME_WIDTH, FRAME_HEIGHT)) {
-			if (image.add_frame(&image, &frame))
-				break;
+	/* convert given images */
+	if (input_path != NULL) {
+		FILE* output = (output_path != NULL) ? fopen(output_path, "wb") : NULL;
+
+		if (output_path == NULL || output != NULL) {
+			double start = get_time();
+			size_t count = convert_frames(input_path, output, columns, invert, method, threads, &image);
+			double seconds = get_time() - start;
+
+			fprintf(stderr, "Converted %lu frames in %.2f seconds (%.1f frames per second)\n",
+				(unsigned long)count, seconds, (seconds > 0.0) ? count / seconds : 0.0);
+
+			/* only converting to file */
+			if (output != NULL) {
+				fclose(output);
+				image.dtor(&image);
+
+				return (count > 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+			}
+		}
+	}
+	else {
+		/* initialize image */
+		for (int i = 0; i < NUM_FRAMES; i++) {
+			if (!frame.swap_matrix(&frame, pixel_matrix[i], FRAME_WIDTH, FRAME_HEIGHT)) {
+				if (image.add_frame(&image, &frame))
+					break;
+			}
 		}
 	}
 
 	/* set screen values */
-	screen.set_size(&screen, SCREEN_WIDTH, SCREEN_HEIGHT); 
 	screen.set_frame_rate(&screen, FRAME_RATE);
 	screen.swap_menu(&screen, menu_array);
 
-	if (!screen.add_image(&screen, &image))
-		status = STATUS_START;
+	if (input_path != NULL) {
+		/* show whole converted image */
+		point_t bounds = image.find_bounds(&image);
+
+		screen.set_canvas_size(&screen, (size_t)bounds._x, (size_t)bounds._y);
+		screen.set_size(&screen, (size_t)bounds._x, (size_t)bounds._y);
+	}
+	else {
+		screen.set_canvas_size(&screen, CANVAS_WIDTH, CANVAS_HEIGHT);
+		screen.set_size(&screen, SCREEN_WIDTH, SCREEN_HEIGHT);
+	}
+
+	/* colors of each copy of the image */
+	attr_t palette[] = {
+		ATTR_FG(232, 215, 162), ATTR_FG(120, 200, 240), ATTR_FG(240, 120, 120),
+		ATTR_FG(150, 230, 130), ATTR_FG(200, 150, 240), ATTR_FG(250, 190, 90)
+	};
 
-	/* keep track of the image shift */
-	point_t shift = { 17, 17 };
+	/* lay out copies of the image over the whole canvas */
+	status = STATUS_START;
+
+	if (input_path != NULL) {
+		if (image.get_frames_count(&image) == 0 || screen.add_image(&screen, &image))
+			status = STATUS_ERROR;
+	}
+	else for (int i = 0, y = 0; y + FRAME_HEIGHT <= CANVAS_HEIGHT; y += FRAME_HEIGHT + WIDGET_SPACING) {
+		for (int x = 0; x + FRAME_WIDTH <= CANVAS_WIDTH; x += FRAME_WIDTH + WIDGET_SPACING, i++) {
+			image.set_position(&image, (point_t){ x, y });
+			image.set_curr_frame(&image, i % NUM_FRAMES);
+			image.set_tint(&image, palette[i % (sizeof(palette) / sizeof(attr_t))]);
+
+			if (image.get_frames_count(&image) == 0 || screen.add_image(&screen, &image))
+				status = STATUS_ERROR;
+		}
+	}
+
+	/* keep track of the viewport position */
+	point_t shift = screen.find_image_aligned_pos(&screen, 0);
+	screen.set_relative_pos(&screen, shift);
 
 	/* main loop */
 	bool run = true;
@@ -644,25 +2421,33 @@ int main()
 				if ((tmp_ch = get_char(0, 0)) != EOF) {
 					switch (to_lower(tmp_ch)) {
 						case OPTION_SHIFT_UP:
-							shift._y += -1;
+							shift._y += -VIEWPORT_STEP;
 							break;
 
 						case OPTION_SHIFT_DOWN:
-							shift._y += 1;
+							shift._y += VIEWPORT_STEP;
 							break;
 
 						case OPTION_SHIFT_LEFT:
-							shift._x += -1;
+							shift._x += -VIEWPORT_STEP;
 							break;
 
 						case OPTION_SHIFT_RIGHT:
-							shift._x += 1;
+							shift._x += VIEWPORT_STEP;
 							break;
 
 						case OPTION_SHIFT_AUTO:
 							shift = screen.find_image_aligned_pos(&screen, 0);
 							break;
 
+						case OPTION_OUTPUT_MODE:
+							screen.set_output_mode(&screen, (screen.get_output_mode(&screen) + 1) % OUTPUT_COUNT);
+							break;
+
+						case OPTION_COLOR_MODE:
+							screen.set_color_mode(&screen, (screen.get_color_mode(&screen) + 1) % (COLOR_TRUECOLOR + 1));
+							break;
+
 						case OPTION_EXIT:
 							status = STATUS_EXIT;
 							break;
@@ -674,8 +2459,9 @@ int main()
 				else
 					status = STATUS_WORK;
 
-				/* update images position for next render */
+				/* update viewport position for next render */
 				screen.set_relative_pos(&screen, shift);
+				shift = *screen.get_relative_pos(&screen);
 				break;
 
 